@@ -1,14 +1,50 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "correlation_arena.h"
 
-/* Generate random data */
+typedef enum {
+	CORRELATION_BACKEND_DFE = 0,	/* Sliding window over the whole series on the DFE, up to 6000 Timeseries */
+	CORRELATION_BACKEND_CPU		/* Standardized series and a multi-threaded SYRK on the CPU */
+} correlation_backend_t;
+
+typedef enum {
+	CORRELATION_OUTPUT_DENSE = 0,	/* All correlations as double, in calc_index order */
+	CORRELATION_OUTPUT_SPARSE,	/* Only pairs with |r| >= threshold, as a list of coordinates */
+	CORRELATION_OUTPUT_PACKED_F32	/* All correlations as float, in calc_index order */
+} correlation_output_mode_t;
+
+// Where and how correlate_output and correlate_rows_output write the correlations
+typedef struct {
+	correlation_output_mode_t mode;	/* Output mode */
+	double* correlations;		/* DENSE: calc_num_correlations(numTimeseries) doubles */
+	float* correlations_f32;	/* PACKED_F32: calc_num_correlations(numTimeseries) floats */
+	double threshold;		/* SPARSE: smallest |r| kept */
+	uint64_t maxPairs;		/* SPARSE: room in values and indices */
+	double* values;			/* SPARSE: correlations of the kept pairs, in calc_index order */
+	uint32_t* indices;		/* SPARSE: pair (i,j), i>j, of every kept correlation, 2 per pair */
+	uint64_t numPairs;		/* SPARSE: [out] pairs reaching threshold; only the first maxPairs are written */
+} correlate_output_t;
+
+// Maxfile and engine loaded once for many calls, see correlate_session_open
+typedef struct correlate_session correlate_session_t;
+
+
+/* Generate random data, uniform in [0, 1) and the same on every call */
 void random_data (
 	double** data,			/* Array of Timeseries */ 
 	uint64_t numTimeseries, 	/* Number of Timeseries */ 
 	uint64_t sizeTimeseries		/* Size of each Timeseries */
 );
 
+/* Generate random data, the same for the same seed */
+void random_data_seeded (
+	double** data,			/* Array of Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	uint64_t sizeTimeseries,	/* Size of each Timeseries */
+	uint64_t seed			/* Seed */
+);
+
 /* Calculate cross correlations among all numTimeseries. */
 void correlate (
 	double** data, 			/* Input data */
@@ -17,6 +53,103 @@ void correlate (
 	double* correlations		/* Output correlations */
 );
 
+/* Calculate cross correlations among all numTimeseries from time-major data */
+void correlate_rows (
+	const double* data, 		/* Input data, data[s*numTimeseries + i] is element s of Timeseries i */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	double* correlations		/* Output correlations */
+);
+
+/* correlate, written in the mode of output */
+void correlate_output (
+	double** data, 			/* Input data */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	correlate_output_t* output	/* Output correlations */
+);
+
+/* correlate_rows, written in the mode of output */
+void correlate_rows_output (
+	const double* data, 		/* Input data, data[s*numTimeseries + i] is element s of Timeseries i */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	correlate_output_t* output	/* Output correlations */
+);
+
+/* Choose where correlate and correlate_rows run; the DFE is the default */
+void correlate_set_backend (
+	correlation_backend_t backend	/* Backend for the following calls */
+);
+
+/* Give back the buffers and the DFE session correlate and correlate_rows keep between calls.
+ * These are shared by all calls that do not bring a session or an arena of their own, so such
+ * calls must not run at the same time. */
+void correlate_free_buffers (void);
+
+/* Load the maxfile once for many calls; every call only zeroes SUM(x,y) in LMem */
+correlate_session_t* correlate_session_open (void);
+
+/* Unload the engine and free the session */
+void correlate_session_close (
+	correlate_session_t* session	/* Session */
+);
+
+/* correlate on the engine of a session */
+void correlate_session_series (
+	correlate_session_t* session,	/* Session */
+	double** data, 			/* Input data */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	double* correlations		/* Output correlations */
+);
+
+/* correlate_rows on the engine of a session */
+void correlate_session_rows (
+	correlate_session_t* session,	/* Session */
+	const double* data, 		/* Input data, data[s*numTimeseries + i] is element s of Timeseries i */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	double* correlations		/* Output correlations */
+);
+
+/* correlate_output on the engine of a session */
+void correlate_session_output_series (
+	correlate_session_t* session,	/* Session */
+	double** data, 			/* Input data */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	correlate_output_t* output	/* Output correlations */
+);
+
+/* correlate_rows_output on the engine of a session */
+void correlate_session_output_rows (
+	correlate_session_t* session,	/* Session */
+	const double* data, 		/* Input data, data[s*numTimeseries + i] is element s of Timeseries i */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	correlate_output_t* output	/* Output correlations */
+);
+
+/* correlate_output on the CPU, with the buffers sliced from a caller-owned arena (correlation_arena.h).
+ * The arena is reset at the start of the call; calls in different arenas can run at the same time. */
+void correlate_cpu_output_series (
+	correlation_arena_t* arena,	/* Arena for the buffers of the call */
+	double** data, 			/* Input data */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	correlate_output_t* output	/* Output correlations */
+);
+
+/* correlate_rows_output on the CPU, with the buffers sliced from a caller-owned arena */
+void correlate_cpu_output_rows (
+	correlation_arena_t* arena,	/* Arena for the buffers of the call */
+	const double* data, 		/* Input data, data[s*numTimeseries + i] is element s of Timeseries i */
+	uint64_t sizeTimeseries, 	/* Size of each Timeseries */
+	uint64_t numTimeseries, 	/* Number of Timeseries */
+	correlate_output_t* output	/* Output correlations */
+);
+
 /* Calculate index of correlation between (i,j) in correlations array */
 uint64_t calc_index (
 	uint64_t i,	/* ith Timeseries */ 
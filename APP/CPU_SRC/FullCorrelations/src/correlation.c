@@ -2,18 +2,43 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include "correlationSAPI.h"
+#include "correlationMAPI.h"
+#include "correlation_encoder.h"
+#include "correlation_syrk.h"
+#include "correlation_arena.h"
+#include "correlation_profile.h"
+#include "correlation_random.h"
 
-void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries) {
+static correlation_backend_t backend = CORRELATION_BACKEND_DFE;
 
-	srand(time(NULL));
-    
-	for (uint64_t i=0; i<numTimeseries; i++) {
-		for (uint64_t j=0; j<sizeTimeseries; j++) {
-			data[i][j] = ((double)rand()/(double)RAND_MAX);
-		}
+// Buffers of the CPU backend calls without an arena of their own are sliced from here, so repeated calls
+// neither allocate nor fault them in
+static correlation_arena_t arena;
+static int arena_ready = 0;
+
+// Session of correlate and correlate_rows, opened with the first DFE call
+static correlate_session_t* default_session = NULL;
+
+static correlation_arena_t* shared_arena (void) {
+	if (!arena_ready) {
+		correlation_arena_init (&arena, 0);
+		arena_ready = 1;
 	}
+	return &arena;
+}
+
+void random_data_seeded (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries, uint64_t seed) {
+
+	correlation_random_t model;
+	correlation_random_init (&model, seed);
+	correlation_random_series (&model, data, numTimeseries, 0, sizeTimeseries);
+}
+
+void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries) {
+	random_data_seeded (data, numTimeseries, sizeTimeseries, 0);
 }
 
 // Calculate number of bursts for initializing LMem
@@ -27,7 +52,8 @@ static size_t calcNumBursts (size_t numTimeseries) {
 }
 
 
-static void prepare_data_for_dfe (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+// Input is either time-major (data_rows[s*numTimeseries + i]) or one row per timeseries (data_series[i][s])
+static void prepare_data_for_dfe (const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
 
 	if (numTimeseries > correlation_maxNumTimeseries) {
 		fprintf(stderr, "Number of Time series should be less or equal to %d. Terminating!\n", correlation_maxNumTimeseries);
@@ -47,63 +73,17 @@ static void prepare_data_for_dfe (double** data, uint64_t sizeTimeseries, uint64
 		exit(-1);
 	}
 	
-	int64_t old_index;
-	double old, new;
-	
-	double** sums = (double**) malloc (numTimesteps*sizeof (double*));
-	double** sums_sq = (double**) malloc (numTimesteps*sizeof (double*));
-	double** inv = (double**) malloc (numTimesteps*sizeof (double*));
-
-	for (uint64_t i=0; i < numTimesteps; i++) {
-		sums[i] = (double*) malloc (numTimeseries*sizeof(double));
-		sums_sq[i] = (double*) malloc (numTimeseries*sizeof(double));
-		inv[i] = (double*) malloc (numTimeseries*sizeof(double));
-	}
+	// Running SUM(x), SUM(x^2) and the window are the only state
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, numTimeseries, (uint64_t)windowSize);
 
 	// 2 DFE input streams: precalculations and data pairs 
-	for (uint64_t i=0; i<numTimesteps; i++) {
-
-		old_index = i - (uint64_t)windowSize;
-
-		for (uint64_t j=0; j<numTimeseries; j++) {
-			if (old_index<0)
-				old = 0;
-			else
-				old = data [j][old_index];
-
-			new = data [j][i];
+	if (data_rows)
+		correlation_encoder_push_block (&encoder, data_rows, numTimesteps, precalculations, data_pairs);
+	else
+		correlation_encoder_push_series_block (&encoder, data_series, 0, numTimesteps, precalculations, data_pairs);
 
-			if (i==0) {
-				sums [i][j] = new;
-				sums_sq [i][j] = new*new;
-			}
-			else {
-				sums [i][j] = sums [i-1][j] + new - old;
-				sums_sq [i][j] = sums_sq [i-1][j] + new*new - old*old;
-			}
-			
-			inv [i][j] = 1/sqrt((uint64_t)windowSize*sums_sq[i][j] - sums[i][j]*sums[i][j]);
-			
-			//Precalculations REORDERED in DFE ORDER
-			precalculations [2*i*numTimeseries + 2*j] = sums[i][j];
-			precalculations [2*i*numTimeseries + 2*j + 1] = inv [i][j];
-
-			//Data pairs REORDERED in DFE ORDER
-			data_pairs[2*i*numTimeseries + 2*j] = new;
-			data_pairs[2*i*numTimeseries + 2*j + 1] = old;
-		}
-	}
-
-	for (uint64_t i=0; i<numTimesteps; i++) {
-		free (sums[i]);
-		free (sums_sq[i]);
-		free (inv[i]);
-	}
-	
-	free (sums);
-	free (sums_sq);
-	free (inv);
-			
+	correlation_encoder_free (&encoder);
 }
 
 uint64_t calc_num_correlations(uint64_t numTimeseries) {
@@ -125,49 +105,289 @@ uint64_t calc_index (uint64_t i, uint64_t j) {
 	return (i*(i-1))/2+j;
 }
 
-void correlate (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* correlations) {
+void correlate_set_backend (correlation_backend_t new_backend) {
+	backend = new_backend;
+}
 
-	uint64_t numTimesteps = sizeTimeseries;	
-	double windowSize = (uint64_t)sizeTimeseries;
+void correlate_free_buffers (void) {
+	if (arena_ready)
+		correlation_arena_free (&arena);
+	arena_ready = 0;
+
+	if (default_session)
+		correlate_session_close (default_session);
+	default_session = NULL;
+}
+
+// Start of row i, the correlations of (i,0) ... (i,i-1), in the last step written by the engine: rows are padded to whole pipes
+static uint64_t engine_row (uint64_t i) {
+	uint64_t q = i/correlation_numPipes;
+	uint64_t r = i%correlation_numPipes;
+	return correlation_numPipes * (correlation_numPipes*q*(q+1)/2 + r*(q+1));
+}
 
+// Start of row i in the dense array, see calc_index
+static uint64_t dense_row (uint64_t i) {
+	return (i*(i-1))/2;
+}
+
+// Write all correlations in the mode of output, rows in parallel; counts holds numTimeseries values
+static void unpack (const double* source, uint64_t (*source_row) (uint64_t), uint64_t numTimeseries, correlate_output_t* output, uint64_t* counts) {
+
+	int64_t N = numTimeseries;
+
+	switch (output->mode) {
+
+		case CORRELATION_OUTPUT_DENSE:
+			#pragma omp parallel for schedule(dynamic, 16)
+			for (int64_t i=1; i<N; i++)
+				memcpy(&output->correlations[dense_row(i)], &source[source_row(i)], i*sizeof(double));
+			break;
+
+		case CORRELATION_OUTPUT_PACKED_F32:
+			#pragma omp parallel for schedule(dynamic, 16)
+			for (int64_t i=1; i<N; i++) {
+				const double* row = &source[source_row(i)];
+				float* out = &output->correlations_f32[dense_row(i)];
+				for (int64_t j=0; j<i; j++)
+					out[j] = (float) row[j];
+			}
+			break;
+
+		case CORRELATION_OUTPUT_SPARSE: {
+			double threshold = output->threshold;
+
+			// Pairs kept in every row first, so that every row knows where its pairs go
+			#pragma omp parallel for schedule(dynamic, 16)
+			for (int64_t i=0; i<N; i++) {
+				const double* row = &source[source_row(i)];
+				uint64_t count = 0;
+				for (int64_t j=0; j<i; j++)
+					count += fabs(row[j]) >= threshold;
+				counts[i] = count;
+			}
+
+			uint64_t numPairs = 0;
+			for (int64_t i=0; i<N; i++) {
+				uint64_t count = counts[i];
+				counts[i] = numPairs;
+				numPairs += count;
+			}
+			output->numPairs = numPairs;
+
+			#pragma omp parallel for schedule(dynamic, 16)
+			for (int64_t i=0; i<N; i++) {
+				const double* row = &source[source_row(i)];
+				uint64_t k = counts[i];
+				for (int64_t j=0; j<i && k<output->maxPairs; j++) {
+					if (fabs(row[j]) >= threshold) {
+						output->values[k] = row[j];
+						output->indices[2*k] = i;
+						output->indices[2*k+1] = j;
+						k++;
+					}
+				}
+			}
+			break;
+		}
+	}
+}
+
+// CPU backend: the window is the whole series, so all correlations are one SYRK of the standardized series
+static void correlate_cpu (correlation_arena_t* buffers, const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries,
+				correlate_output_t* output) {
+
+	if (sizeTimeseries <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	correlation_arena_reset (buffers);
+
+	double* z = (double*) correlation_arena_alloc (buffers, sizeTimeseries * correlation_syrk_columns (numTimeseries) * sizeof(double), 0);
+
+	if (data_rows)
+		correlation_syrk_standardize_rows (data_rows, sizeTimeseries, numTimeseries, z);
+	else
+		correlation_syrk_standardize (data_series, sizeTimeseries, numTimeseries, z);
+
+	if (output->mode == CORRELATION_OUTPUT_DENSE) {
+		correlation_syrk (z, sizeTimeseries, numTimeseries, output->correlations);
+		return;
+	}
+
+	double* correlations = (double*) correlation_arena_alloc (buffers, calc_num_correlations (numTimeseries) * sizeof(double), 0);
+	uint64_t* counts = (uint64_t*) correlation_arena_alloc (buffers, numTimeseries * sizeof(uint64_t), 0);
+
+	correlation_syrk (z, sizeTimeseries, numTimeseries, correlations);
+
+	correlation_profile_begin (CORRELATION_PHASE_UNPACK);
+	unpack (correlations, dense_row, numTimeseries, output, counts);
+	correlation_profile_end (CORRELATION_PHASE_UNPACK);
+}
+
+// The maxfile and the engine outlive the calls of a session
+struct correlate_session {
+	max_file_t* maxfile;
+	max_engine_t* engine;
+	int32_t loopLength;
+	uint64_t numBursts;		/* Bursts memLoad holds, 0 before the first call */
+	void* memLoad;			/* Zeros written to LMem at the start of every call */
+	correlation_arena_t arena;	/* Buffers of one call */
+};
+
+correlate_session_t* correlate_session_open (void) {
+
+	correlate_session_t* session = (correlate_session_t*) calloc (1, sizeof(correlate_session_t));
+
+	session->maxfile = correlation_init();
+	session->engine = max_load(session->maxfile, "*");
+	if (!session->engine) {
+		fprintf(stderr, "Cannot load the correlation maxfile. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	session->loopLength = correlation_get_CorrelationKernel_loopLength();
+	correlation_arena_init (&session->arena, 0);
+
+	return session;
+}
+
+void correlate_session_close (correlate_session_t* session) {
+
+	max_unload(session->engine);
+	max_file_free(session->maxfile);
+	correlation_arena_free (&session->arena);
+	free(session->memLoad);
+	free(session);
+}
+
+/*
+ * The window is the whole series, so the old value of every data pair is 0 and LMem only ever
+ * adds x[i]*x[j]. The engine stays loaded for the whole session, but SUM(x,y) in LMem is set
+ * back to 0 at the start of every call, so the result of a call depends on its own data only.
+ * The zeros are allocated, and the PCIe buffer for them faulted in, only when numBursts grows.
+ */
+static void session_steps (correlate_session_t* session, const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+
+	double windowSize = (uint64_t)sizeTimeseries;
+	uint64_t numTimesteps = sizeTimeseries;
 	uint64_t numBursts = calcNumBursts (numTimeseries);
-	int32_t loopLength = correlation_get_CorrelationKernel_loopLength();	
-	
-	double* precalculations = (double*) malloc (2 * numTimeseries * numTimesteps * sizeof(double));
-	double* data_pairs = (double*) malloc (2 * numTimeseries * numTimesteps * sizeof(double));
-	
+	int32_t loopLength = session->loopLength;
+
+	correlation_arena_t* buffers = &session->arena;
+	correlation_arena_reset (buffers);
+
 	int burstSize = 384/2;//for anything other than ISCA this should be 384
-	void* in_memLoad = (void*) malloc (numBursts * burstSize);
-	memset(in_memLoad,0,numBursts*burstSize);
+	if (numBursts > session->numBursts) {
+		free(session->memLoad);
+		if (posix_memalign(&session->memLoad, correlation_PCIE_ALIGNMENT, numBursts * burstSize)) {
+			fprintf(stderr, "Cannot allocate %lu bursts for LMem. Terminating!\n", numBursts);
+			fflush(stderr);
+			exit(-1);
+		}
+		memset(session->memLoad, 0, numBursts * burstSize);
+		session->numBursts = numBursts;
+	}
 
-	double* out_correlation = (double*) malloc ((numTimesteps * loopLength * correlation_numTopScores * correlation_numPipes + numBursts * 48) * sizeof(double));
-	uint32_t* out_indices = (uint32_t*) malloc (2 * numTimesteps * loopLength * correlation_numTopScores * correlation_numPipes * sizeof(uint32_t));	
+	correlation_loadLMem_actions_t load_actions = {
+		.param_numBursts = numBursts,
+		.param_CorrelationKernel_loopLength = &loopLength,
+		.instream_in_memLoad = session->memLoad
+	};
+	correlation_profile_begin (CORRELATION_PHASE_LMEM_LOAD);
+	correlation_loadLMem_run(session->engine, &load_actions);
+	correlation_profile_end (CORRELATION_PHASE_LMEM_LOAD);
+
+	// Streams are aligned for the PCIe transfers
+	double* precalculations = (double*) correlation_arena_alloc (buffers, 2 * numTimeseries * numTimesteps * sizeof(double), correlation_PCIE_ALIGNMENT);
+	double* data_pairs = (double*) correlation_arena_alloc (buffers, 2 * numTimeseries * numTimesteps * sizeof(double), correlation_PCIE_ALIGNMENT);
+
+	double* out_correlation = (double*) correlation_arena_alloc (buffers, (numTimesteps * loopLength * correlation_numTopScores * correlation_numPipes + numBursts * 48) * sizeof(double),
+									correlation_PCIE_ALIGNMENT);
+	uint32_t* out_indices = (uint32_t*) correlation_arena_alloc (buffers, 2 * numTimesteps * loopLength * correlation_numTopScores * correlation_numPipes * sizeof(uint32_t),
+									correlation_PCIE_ALIGNMENT);
+	uint64_t* counts = (uint64_t*) correlation_arena_alloc (buffers, numTimeseries * sizeof(uint64_t), 0);
+
+	correlation_profile_begin (CORRELATION_PHASE_REORDER);
+	prepare_data_for_dfe (data_rows, data_series, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
+	correlation_profile_end (CORRELATION_PHASE_REORDER);
+
+	correlation_actions_t actions = {
+		.param_numBursts = numBursts,
+		.param_numSteps = numTimesteps,
+		.param_numVariables = numTimeseries,
+		.param_outputLastStep = 1,
+		.param_windowSize = windowSize,
+		.instream_in_precalculations = precalculations,
+		.instream_in_variable_pair = data_pairs,
+		.outstream_out_correlation = out_correlation,
+		.outstream_out_indices = out_indices
+	};
+	correlation_profile_begin (CORRELATION_PHASE_DFE_RUN);
+	correlation_run(session->engine, &actions);
+	correlation_profile_end (CORRELATION_PHASE_DFE_RUN);
 
-	prepare_data_for_dfe (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
-	
-	correlation_loadLMem(numBursts, &loopLength, in_memLoad);
-	printf("LMem initialized!\n");
-	
-	//Executing correlation action
-	correlation(numBursts, numTimesteps, numTimeseries, 1, windowSize,	// scalar inputs 
-				precalculations, data_pairs,			// streaming reordered inputs
-				out_correlation, out_indices			// streaming unordered outputs
-	);
-
-	uint64_t position = 0;
-	uint64_t index = 0;
 	uint64_t start = (numTimesteps-1) * loopLength * correlation_numTopScores * correlation_numPipes;
+	correlation_profile_begin (CORRELATION_PHASE_UNPACK);
+	unpack (&out_correlation[start], engine_row, numTimeseries, output, counts);
+	correlation_profile_end (CORRELATION_PHASE_UNPACK);
+}
 
-	for (uint64_t i=0; i< numTimeseries; i++) {
-		memcpy(&correlations[index], &out_correlation[start+position], i*sizeof(double));
-		index += i;
-		position += ((i/12)+1)*12;	
-	}
-						
-	free (precalculations);
-	free (data_pairs);
-	free (in_memLoad);
-	free (out_correlation);
-	free (out_indices);
-	
+void correlate_session_output_rows (correlate_session_t* session, const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+	session_steps (session, data, NULL, sizeTimeseries, numTimeseries, output);
+}
+
+void correlate_session_output_series (correlate_session_t* session, double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+	session_steps (session, NULL, data, sizeTimeseries, numTimeseries, output);
+}
+
+void correlate_session_rows (correlate_session_t* session, const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* correlations) {
+	correlate_output_t output = {.mode = CORRELATION_OUTPUT_DENSE, .correlations = correlations};
+	session_steps (session, data, NULL, sizeTimeseries, numTimeseries, &output);
+}
+
+void correlate_session_series (correlate_session_t* session, double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* correlations) {
+	correlate_output_t output = {.mode = CORRELATION_OUTPUT_DENSE, .correlations = correlations};
+	session_steps (session, NULL, data, sizeTimeseries, numTimeseries, &output);
+}
+
+void correlate_cpu_output_rows (correlation_arena_t* arena, const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+	correlate_cpu (arena, data, NULL, sizeTimeseries, numTimeseries, output);
+}
+
+void correlate_cpu_output_series (correlation_arena_t* arena, double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+	correlate_cpu (arena, NULL, data, sizeTimeseries, numTimeseries, output);
+}
+
+static correlate_session_t* run_session (void) {
+	if (!default_session)
+		default_session = correlate_session_open();
+	return default_session;
+}
+
+void correlate_rows_output (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+	if (backend == CORRELATION_BACKEND_CPU)
+		correlate_cpu_output_rows (shared_arena(), data, sizeTimeseries, numTimeseries, output);
+	else
+		correlate_session_output_rows (run_session(), data, sizeTimeseries, numTimeseries, output);
+}
+
+void correlate_output (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, correlate_output_t* output) {
+	if (backend == CORRELATION_BACKEND_CPU)
+		correlate_cpu_output_series (shared_arena(), data, sizeTimeseries, numTimeseries, output);
+	else
+		correlate_session_output_series (run_session(), data, sizeTimeseries, numTimeseries, output);
+}
+
+void correlate_rows (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* correlations) {
+	correlate_output_t output = {.mode = CORRELATION_OUTPUT_DENSE, .correlations = correlations};
+	correlate_rows_output (data, sizeTimeseries, numTimeseries, &output);
+}
+
+void correlate (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* correlations) {
+	correlate_output_t output = {.mode = CORRELATION_OUTPUT_DENSE, .correlations = correlations};
+	correlate_output (data, sizeTimeseries, numTimeseries, &output);
 }
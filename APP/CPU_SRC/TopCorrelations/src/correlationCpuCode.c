@@ -38,6 +38,12 @@
 
 
 #include "correlationSAPI.h"
+#include "correlation_topk.h"
+#include "correlation_encoder.h"
+#include "correlation_blocks.h"
+#include "correlation_merge.h"
+#include "correlation_profile.h"
+#include "correlation_random.h"
 
 
 //Time measuring
@@ -58,34 +64,86 @@ size_t calcNumBursts (size_t numTimeseries) {
 }
 
 
-//Calculate top correlations
-void topCorrelations (double* correlations, uint32_t* indices, uint64_t numCorrelations, double* correlations_top, uint32_t* indices_top, int numTopScores) {
+// Input is either time-major (data_rows[s*numTimeseries + i]) or one row per timeseries (data_series[i][s])
+static void prepare_data_for_dfe_steps (const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+
+	if (numTimeseries > correlation_maxNumTimeseries) {
+		fprintf(stderr, "Number of Time series should be less or equal to %d. Terminating!\n", correlation_maxNumTimeseries);
+		fflush(stderr);
+		exit(-1);
+	}
 	
-	for (uint64_t step=0; step<numCorrelations-1; ++step) {
-		for (uint64_t i=0; i<numCorrelations-step-1; ++i) {
-			if (correlations[i]<correlations[i+1]) {
-				double temp_corr = correlations[i];
-				uint32_t temp_in1 = indices[2*i];
-				uint32_t temp_in2 = indices[2*i+1];
-				
-				correlations[i] = correlations[i+1];
-				indices[2*i] = indices[2*(i+1)];
-				indices[2*i+1] = indices[2*(i+1)+1];
-
-				correlations[i+1] = temp_corr;
-				indices[2*(i+1)] = temp_in1;
-				indices[2*(i+1)+1] = temp_in2;
-					
-			}	
-		}	
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
 	}
 
-	memcpy(correlations_top, correlations, numTopScores*sizeof(double));
-	memcpy(indices_top, indices, 2*numTopScores*sizeof(uint32_t));
+	if (numTimesteps > sizeTimeseries) {
+		fprintf(stderr, "Number of Time steps should be less or equal to size of Time series. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+	
+	// Running SUM(x), SUM(x^2) and the window are the only state
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, numTimeseries, (uint64_t)windowSize);
+
+	// 2 DFE input streams: precalculations and data pairs 
+	if (data_rows)
+		correlation_encoder_push_block (&encoder, data_rows, numTimesteps, precalculations, data_pairs);
+	else
+		correlation_encoder_push_series_block (&encoder, data_series, 0, numTimesteps, precalculations, data_pairs);
+
+	correlation_encoder_free (&encoder);
 }
 
+// Time-major input: data[s*numTimeseries + i] is x[s] of timeseries i
+void prepare_data_for_dfe_rows (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+	prepare_data_for_dfe_steps (data, NULL, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
+}
 
+// One row per timeseries: data[i][s] is x[s] of timeseries i
 void prepare_data_for_dfe (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+	prepare_data_for_dfe_steps (NULL, data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
+}
+
+// The same data for the same seed
+void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries, uint64_t seed) {
+
+	correlation_random_t model;
+	correlation_random_init (&model, seed);
+	correlation_random_series (&model, data, numTimeseries, 0, sizeTimeseries);
+}
+
+
+// Merge the per-pipe DFE outputs of numSteps timesteps into the top correlations of every timestep
+static void sort_outputs (const double* out_correlation, const uint32_t* out_indices, uint64_t numSteps, uint64_t correlations_per_step,
+				double* correlations_final, uint32_t* indices_final) {
+
+	correlation_merge_steps (out_correlation, out_indices, numSteps, correlations_per_step, correlation_numTopScores,
+				correlations_final, indices_final);
+}
+
+// Encode the DFE inputs of chunk k, continuing from the previous chunk
+static void encode_chunk (correlation_encoder_t* encoder, double** data, uint64_t k, uint64_t numTimesteps, uint64_t numTimestepsPerChunk,
+				double* precalculations, double* data_pairs) {
+
+	uint64_t first = k*numTimestepsPerChunk;
+	uint64_t last = first+numTimestepsPerChunk < numTimesteps ? first+numTimestepsPerChunk : numTimesteps;
+
+	correlation_encoder_push_series_block (encoder, data, first, last-first, precalculations, data_pairs);
+}
+
+/*
+ * Pipelined run: the timesteps are cut into chunks of numTimestepsPerChunk. While the DFE correlates chunk k,
+ * the CPU encodes the inputs of chunk k+1 and sorts the outputs of chunk k-1, using two buffers for each stream.
+ * SUM(x,y) stays in LMem between the runs and the encoder carries SUM(x), SUM(x^2) and the window over, so the
+ * result is the same as one run over all timesteps. Time spent in each CPU stage and waiting for the DFE is
+ * added to its phase of correlation_profile.
+ */
+void correlation_pipelined (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, uint64_t numTimestepsPerChunk,
+				double* correlations_final, uint32_t* indices_final) {
 
 	if (numTimeseries > correlation_maxNumTimeseries) {
 		fprintf(stderr, "Number of Time series should be less or equal to %d. Terminating!\n", correlation_maxNumTimeseries);
@@ -104,89 +162,353 @@ void prepare_data_for_dfe (double** data, uint64_t sizeTimeseries, uint64_t numT
 		fflush(stderr);
 		exit(-1);
 	}
-	
-	int64_t old_index;
-	double old, new;
-	
-	double** sums = (double**) malloc (numTimesteps*sizeof (double*));
-	double** sums_sq = (double**) malloc (numTimesteps*sizeof (double*));
-	double** inv = (double**) malloc (numTimesteps*sizeof (double*));
-
-	for (uint64_t i=0; i < numTimesteps; i++) {
-		sums[i] = (double*) malloc (numTimeseries*sizeof(double));
-		sums_sq[i] = (double*) malloc (numTimeseries*sizeof(double));
-		inv[i] = (double*) malloc (numTimeseries*sizeof(double));
+
+	if (numTimestepsPerChunk < 1) {
+		fprintf(stderr, "Number of Time steps per chunk must be at least 1. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
 	}
 
-	// 2 DFE input streams: precalculations and data pairs 
-	for (uint64_t i=0; i<numTimesteps; i++) {
-
-		old_index = i - (uint64_t)windowSize;
-
-		for (uint64_t j=0; j<numTimeseries; j++) {
-			if (old_index<0)
-				old = 0;
-			else
-				old = data [j][old_index];
-
-			new = data [j][i];
-
-			if (i==0) {
-				sums [i][j] = new;
-				sums_sq [i][j] = new*new;
-			}
-			else {
-				sums [i][j] = sums [i-1][j] + new - old;
-				sums_sq [i][j] = sums_sq [i-1][j] + new*new - old*old;
-			}
-			
-			inv [i][j] = 1/sqrt((uint64_t)windowSize*sums_sq[i][j] - sums[i][j]*sums[i][j]);
-			
-			//Precalculations REORDERED in DFE ORDER
-			precalculations [2*i*numTimeseries + 2*j] = sums[i][j];
-			precalculations [2*i*numTimeseries + 2*j + 1] = inv [i][j];
-
-			//Data pairs REORDERED in DFE ORDER
-			data_pairs[2*i*numTimeseries + 2*j] = new;
-			data_pairs[2*i*numTimeseries + 2*j + 1] = old;
+	// A chunk longer than the run only makes the buffers larger
+	if (numTimestepsPerChunk > numTimesteps && numTimesteps > 0)
+		numTimestepsPerChunk = numTimesteps;
+
+	uint64_t numBursts = calcNumBursts (numTimeseries);
+	int32_t loopLength = correlation_get_CorrelationKernel_loopLength();
+	uint64_t numChunks = (numTimesteps + numTimestepsPerChunk - 1) / numTimestepsPerChunk;
+
+	int burstSize = 384/2;//For anything other than isca this should be 384
+	void* in_memLoad = (void*) malloc (numBursts * burstSize);
+	memset(in_memLoad,0,numBursts*burstSize);
+
+	//Executing loadLMem action
+	correlation_profile_begin (CORRELATION_PHASE_LMEM_LOAD);
+	correlation_loadLMem(numBursts, &loopLength, in_memLoad);
+	correlation_profile_end (CORRELATION_PHASE_LMEM_LOAD);
+
+	uint64_t correlations_per_step = loopLength * correlation_numTopScores * correlation_numPipes; // number of correlations in output per timestep 
+
+	// Double buffered DFE inputs and outputs, one chunk each
+	double* precalculations[2];
+	double* data_pairs[2];
+	double* out_correlation[2];
+	uint32_t* out_indices[2];
+
+	for (int b=0; b<2; b++) {
+		precalculations[b] = (double*) malloc (2 * numTimeseries * numTimestepsPerChunk * sizeof(double));
+		data_pairs[b] = (double*) malloc (2 * numTimeseries * numTimestepsPerChunk * sizeof(double));
+		out_correlation[b] = (double*) malloc (numTimestepsPerChunk * correlations_per_step * sizeof(double));
+		out_indices[b] = (uint32_t*) malloc (2 * numTimestepsPerChunk * correlations_per_step * sizeof(uint32_t));
+	}
+
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, numTimeseries, (uint64_t)windowSize);
+
+	// Chunk 0 is encoded up front
+	correlation_profile_begin (CORRELATION_PHASE_REORDER);
+	encode_chunk (&encoder, data, 0, numTimesteps, numTimestepsPerChunk, precalculations[0], data_pairs[0]);
+	correlation_profile_end (CORRELATION_PHASE_REORDER);
+
+	for (uint64_t k=0; k<numChunks; k++) {
+
+		int b = k%2;
+		uint64_t first = k*numTimestepsPerChunk;
+		uint64_t numSteps = first+numTimestepsPerChunk < numTimesteps ? numTimestepsPerChunk : numTimesteps-first;
+
+		//Executing correlation action on chunk k
+		max_run_t* run = correlation_nonblock(numBursts, numSteps, numTimeseries, 0, windowSize,	// scalar inputs 
+						precalculations[b], data_pairs[b],			// streaming reordered inputs
+						out_correlation[b], out_indices[b]			// streaming unordered outputs
+						);
+
+		// Meanwhile, encode chunk k+1 ...
+		if (k+1 < numChunks) {
+			correlation_profile_begin (CORRELATION_PHASE_REORDER);
+			encode_chunk (&encoder, data, k+1, numTimesteps, numTimestepsPerChunk, precalculations[1-b], data_pairs[1-b]);
+			correlation_profile_end (CORRELATION_PHASE_REORDER);
+		}
+
+		// ... and sort chunk k-1
+		if (k > 0) {
+			correlation_profile_begin (CORRELATION_PHASE_SORT);
+			sort_outputs (out_correlation[1-b], out_indices[1-b], numTimestepsPerChunk, correlations_per_step,
+					&correlations_final[(first-numTimestepsPerChunk)*correlation_numTopScores],
+					&indices_final[2*(first-numTimestepsPerChunk)*correlation_numTopScores]);
+			correlation_profile_end (CORRELATION_PHASE_SORT);
+		}
+
+		correlation_profile_begin (CORRELATION_PHASE_DFE_RUN);
+		max_wait(run);
+		correlation_profile_end (CORRELATION_PHASE_DFE_RUN);
+
+		// The last chunk has nobody to overlap with
+		if (k == numChunks-1) {
+			correlation_profile_begin (CORRELATION_PHASE_SORT);
+			sort_outputs (out_correlation[b], out_indices[b], numSteps, correlations_per_step,
+					&correlations_final[first*correlation_numTopScores], &indices_final[2*first*correlation_numTopScores]);
+			correlation_profile_end (CORRELATION_PHASE_SORT);
 		}
 	}
 
-	for (uint64_t i=0; i<numTimesteps; i++) {
-		free (sums[i]);
-		free (sums_sq[i]);
-		free (inv[i]);
+	correlation_encoder_free (&encoder);
+
+	for (int b=0; b<2; b++) {
+		free (out_indices[b]);
+		free (out_correlation[b]);
+		free (data_pairs[b]);
+		free (precalculations[b]);
 	}
-	
-	free (sums);
-	free (sums_sq);
-	free (inv);
-			
+	free (in_memLoad);
 }
 
-void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries) {
+/*
+ * Sharded run over an array of numEngines DFEs: engine e correlates the timesteps
+ * [e*numTimesteps/numEngines, (e+1)*numTimesteps/numEngines). Its stream starts windowSize timesteps
+ * earlier, from empty LMem, so that SUM(x,y) covers the whole window when its first own timestep comes;
+ * the outputs of these warm-up timesteps are dropped. All engines run concurrently and the host merges
+ * the per-pipe candidates of every timestep into its top correlations.
+ */
+void correlation_sharded (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, int numEngines,
+				double* correlations_final, uint32_t* indices_final) {
 
-	srand(time(NULL));
+	if (numTimeseries > correlation_maxNumTimeseries) {
+		fprintf(stderr, "Number of Time series should be less or equal to %d. Terminating!\n", correlation_maxNumTimeseries);
+		fflush(stderr);
+		exit(-1);
+	}
 	
-	for (uint64_t i=0; i<numTimeseries; i++) {
-		for (uint64_t j=0; j<sizeTimeseries; j++) {
-			data[i][j] = ((double)rand()/(double)RAND_MAX);
-		}
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
 	}
+
+	if (numTimesteps > sizeTimeseries) {
+		fprintf(stderr, "Number of Time steps should be less or equal to size of Time series. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	// Every engine needs at least one timestep of its own
+	if ((uint64_t)numEngines > numTimesteps)
+		numEngines = numTimesteps;
+
+	uint64_t numBursts = calcNumBursts (numTimeseries);
+	int32_t loopLength = correlation_get_CorrelationKernel_loopLength();
+	uint64_t correlations_per_step = loopLength * correlation_numTopScores * correlation_numPipes; // number of correlations in output per timestep 
+
+	max_file_t* maxfile = correlation_init();
+	max_engarray_t* engarray = max_load_array(maxfile, numEngines, "*");
+	if (!engarray) {
+		fprintf(stderr, "Could not load %d engines. Terminating!\n", numEngines);
+		fflush(stderr);
+		exit(-1);
+	}
+
+	int burstSize = 384/2;//For anything other than isca this should be 384
+	void* in_memLoad = (void*) malloc (numBursts * burstSize);
+	memset(in_memLoad,0,numBursts*burstSize);
+
+	uint64_t* first = (uint64_t*) malloc ((numEngines+1) * sizeof(uint64_t));
+	uint64_t* warmup = (uint64_t*) malloc (numEngines * sizeof(uint64_t));
+	int32_t* loopLengths = (int32_t*) malloc (numEngines * sizeof(int32_t));
+	correlation_loadLMem_actions_t* load_actions = (correlation_loadLMem_actions_t*) malloc (numEngines * sizeof(correlation_loadLMem_actions_t));
+	correlation_actions_t* actions = (correlation_actions_t*) malloc (numEngines * sizeof(correlation_actions_t));
+	correlation_loadLMem_actions_t** load_actions_array = (correlation_loadLMem_actions_t**) malloc (numEngines * sizeof(correlation_loadLMem_actions_t*));
+	correlation_actions_t** actions_array = (correlation_actions_t**) malloc (numEngines * sizeof(correlation_actions_t*));
+
+	for (int e=0; e<=numEngines; e++)
+		first[e] = (e*numTimesteps)/numEngines;
+
+	/*==================== REORDERING DATA for every engine ====================*/
+
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, numTimeseries, (uint64_t)windowSize);
+
+	correlation_profile_begin (CORRELATION_PHASE_REORDER);
+	for (int e=0; e<numEngines; e++) {
+
+		warmup[e] = first[e] < (uint64_t)windowSize ? first[e] : (uint64_t)windowSize;
+		uint64_t numSteps = first[e+1] - first[e] + warmup[e];
+
+		double* precalculations = (double*) malloc (2 * numTimeseries * numSteps * sizeof(double));
+		double* data_pairs = (double*) malloc (2 * numTimeseries * numSteps * sizeof(double));
+
+		correlation_encoder_reset (&encoder);
+		correlation_encoder_push_series_block (&encoder, data, first[e]-warmup[e], numSteps, precalculations, data_pairs);
+
+		load_actions[e].param_numBursts = numBursts;
+		load_actions[e].param_CorrelationKernel_loopLength = &loopLengths[e];
+		load_actions[e].instream_in_memLoad = in_memLoad;
+		load_actions_array[e] = &load_actions[e];
+
+		actions[e].param_numBursts = numBursts;
+		actions[e].param_numSteps = numSteps;
+		actions[e].param_numVariables = numTimeseries;
+		actions[e].param_outputLastStep = 0;
+		actions[e].param_windowSize = windowSize;
+		actions[e].instream_in_precalculations = precalculations;
+		actions[e].instream_in_variable_pair = data_pairs;
+		actions[e].outstream_out_correlation = (double*) malloc (numSteps * correlations_per_step * sizeof(double));
+		actions[e].outstream_out_indices = (uint32_t*) malloc (2 * numSteps * correlations_per_step * sizeof(uint32_t));
+		actions_array[e] = &actions[e];
+	}
+	correlation_profile_end (CORRELATION_PHASE_REORDER);
+
+	correlation_encoder_free (&encoder);
+
+	/*==================== Computation ====================*/
+
+	correlation_profile_begin (CORRELATION_PHASE_LMEM_LOAD);
+	correlation_loadLMem_run_array(engarray, load_actions_array);
+	correlation_profile_end (CORRELATION_PHASE_LMEM_LOAD);
+
+	correlation_profile_begin (CORRELATION_PHASE_DFE_RUN);
+	correlation_run_array(engarray, actions_array);
+	correlation_profile_end (CORRELATION_PHASE_DFE_RUN);
+
+	// Warm-up timesteps of every engine are skipped
+	correlation_profile_begin (CORRELATION_PHASE_SORT);
+	for (int e=0; e<numEngines; e++) {
+		sort_outputs (&actions[e].outstream_out_correlation[warmup[e]*correlations_per_step], &actions[e].outstream_out_indices[2*warmup[e]*correlations_per_step],
+				first[e+1] - first[e], correlations_per_step,
+				&correlations_final[first[e]*correlation_numTopScores], &indices_final[2*first[e]*correlation_numTopScores]);
+	}
+	correlation_profile_end (CORRELATION_PHASE_SORT);
+
+	//Deallocating memory
+	for (int e=0; e<numEngines; e++) {
+		free ((void*) actions[e].instream_in_precalculations);
+		free ((void*) actions[e].instream_in_variable_pair);
+		free (actions[e].outstream_out_correlation);
+		free (actions[e].outstream_out_indices);
+	}
+	free (actions_array);
+	free (load_actions_array);
+	free (actions);
+	free (load_actions);
+	free (loopLengths);
+	free (warmup);
+	free (first);
+	free (in_memLoad);
+
+	max_unload_array(engarray);
+	max_file_free(maxfile);
 }
 
+/*
+ * Block-decomposed run for more than correlation_maxNumTimeseries timeseries. The triangle is cut into
+ * passes of at most correlation_maxNumTimeseries timeseries (see correlation_blocks.h); every pass
+ * streams all timesteps of its timeseries through the DFE from empty LMem, and its per-pipe candidates
+ * are merged into the top correlations of every timestep on the host.
+ */
+void correlation_blocked (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize,
+				double* correlations_final, uint32_t* indices_final) {
+
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	if (numTimesteps > sizeTimeseries) {
+		fprintf(stderr, "Number of Time steps should be less or equal to size of Time series. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	correlation_blocks_t blocks;
+	correlation_blocks_init (&blocks, numTimeseries, correlation_maxNumTimeseries);
+
+	uint64_t maxPassSize = blocks.numPasses == 1 ? numTimeseries : 2*blocks.blockSize;
+	uint64_t maxNumBursts = calcNumBursts (maxPassSize);
+	int32_t loopLength = correlation_get_CorrelationKernel_loopLength();
+	uint64_t max_correlations_per_step = loopLength * correlation_numTopScores * correlation_numPipes;
+
+	int burstSize = 384/2;//For anything other than isca this should be 384
+	void* in_memLoad = (void*) malloc (maxNumBursts * burstSize);
+	memset(in_memLoad,0,maxNumBursts*burstSize);
+
+	// Timeseries of the current pass, as rows of the original data
+	uint32_t* series = (uint32_t*) malloc (maxPassSize * sizeof(uint32_t));
+	double** pass_data = (double**) malloc (maxPassSize * sizeof(double*));
+
+	double* precalculations = (double*) malloc (2 * maxPassSize * numTimesteps * sizeof(double));
+	double* data_pairs = (double*) malloc (2 * maxPassSize * numTimesteps * sizeof(double));
+	double* out_correlation = (double*) malloc (numTimesteps * max_correlations_per_step * sizeof(double));
+	uint32_t* out_indices = (uint32_t*) malloc (2 * numTimesteps * max_correlations_per_step * sizeof(uint32_t));
+
+	// Global top correlations of every timestep, fed by all passes
+	correlation_topk_t* topk = (correlation_topk_t*) malloc (numTimesteps * sizeof(correlation_topk_t));
+	for (uint64_t s=0; s<numTimesteps; s++)
+		correlation_topk_init (&topk[s], correlation_numTopScores);
+
+	for (uint64_t p=0; p<blocks.numPasses; p++) {
+
+		uint64_t numPassTimeseries = correlation_blocks_pass (&blocks, p, series);
+		uint64_t numBursts = calcNumBursts (numPassTimeseries);
+
+		for (uint64_t i=0; i<numPassTimeseries; i++)
+			pass_data[i] = data[series[i]];
+
+		correlation_profile_begin (CORRELATION_PHASE_REORDER);
+		correlation_encoder_t encoder;
+		correlation_encoder_init (&encoder, numPassTimeseries, (uint64_t)windowSize);
+		correlation_encoder_push_series_block (&encoder, pass_data, 0, numTimesteps, precalculations, data_pairs);
+		correlation_encoder_free (&encoder);
+		correlation_profile_end (CORRELATION_PHASE_REORDER);
+
+		correlation_profile_begin (CORRELATION_PHASE_LMEM_LOAD);
+		correlation_loadLMem(numBursts, &loopLength, in_memLoad);
+		correlation_profile_end (CORRELATION_PHASE_LMEM_LOAD);
+
+		correlation_profile_begin (CORRELATION_PHASE_DFE_RUN);
+		correlation(numBursts, numTimesteps, numPassTimeseries, 0, windowSize,	// scalar inputs 
+					precalculations, data_pairs,			// streaming reordered inputs
+					out_correlation, out_indices			// streaming unordered outputs
+					);
+		correlation_profile_end (CORRELATION_PHASE_DFE_RUN);
+
+		uint64_t correlations_per_step = loopLength * correlation_numTopScores * correlation_numPipes;
+
+		// Every timestep has its own selector
+		correlation_profile_begin (CORRELATION_PHASE_SORT);
+		#pragma omp parallel for schedule(static)
+		for (uint64_t s=0; s<numTimesteps; s++)
+			correlation_blocks_push (&blocks, p, series, numPassTimeseries, &out_correlation[s*correlations_per_step], &out_indices[2*s*correlations_per_step],
+						correlations_per_step, &topk[s]);
+		correlation_profile_end (CORRELATION_PHASE_SORT);
+	}
+
+	for (uint64_t s=0; s<numTimesteps; s++) {
+		correlation_topk_result (&topk[s], &correlations_final[s*correlation_numTopScores], &indices_final[2*s*correlation_numTopScores]);
+		correlation_topk_free (&topk[s]);
+	}
+
+	//Deallocating memory
+	free (topk);
+	free (out_indices);
+	free (out_correlation);
+	free (data_pairs);
+	free (precalculations);
+	free (pass_data);
+	free (series);
+	free (in_memLoad);
+}
 
 int main () {
 
 	uint64_t numTimesteps = 12;	// not limited by DFE
-	uint64_t numTimeseries = 200;	// DFE supports 200 - 6000, Simulation supports 250 - 6000
+	uint64_t numTimeseries = 200;	// DFE supports 200 - 6000, Simulation supports 250 - 6000; more run in blocks
 	double windowSize = 9;
 
 	uint64_t sizeTimeseries = 100;	// number of elements in the timeseries
+	uint64_t seed = 1;		// of the random data
+	uint64_t numTimestepsPerChunk = 4;	// timesteps per DFE run, overlapped with CPU work
+	int numEngines = 1;			// DFEs to shard the timesteps over
 
-	uint64_t numBursts = calcNumBursts (numTimeseries);
-	int32_t loopLength = correlation_get_CorrelationKernel_loopLength();
-	double start_time, reorder_time, DFE_time, sort_time, total_time;
+	double start_time, total_time;
+	correlation_profile_t profile;
 
 	
 	/*===================== INITIALIZING =====================*/
@@ -196,73 +518,43 @@ int main () {
 		data[i] = (double*) malloc (sizeTimeseries*sizeof(double));
 
 	printf("Generating data!\n");
-	random_data (data, numTimeseries, sizeTimeseries);		
-
-	double* precalculations = (double*) malloc (2 * numTimeseries * numTimesteps * sizeof(double));
-	double* data_pairs = (double*) malloc (2 * numTimeseries * numTimesteps * sizeof(double));
+	random_data (data, numTimeseries, sizeTimeseries, seed);		
 
-	int burstSize = 384/2;//For anything other than isca this should be 384
-	void* in_memLoad = (void*) malloc (numBursts * burstSize);
-	memset(in_memLoad,0,numBursts*burstSize);
-	
-	// DFE outputs
-	double* out_correlation = (double*) malloc (numTimesteps * loopLength * correlation_numTopScores * correlation_numPipes * sizeof(double));
-	uint32_t* out_indices = (uint32_t*) malloc (2 * numTimesteps * loopLength * correlation_numTopScores * correlation_numPipes * sizeof(uint32_t));
-		
 	// Top correlations for every timestep	
 	double* correlations_final = (double*) malloc (correlation_numTopScores*numTimesteps*sizeof(double));
 	uint32_t* indices_final = (uint32_t*) malloc (2 * correlation_numTopScores*numTimesteps*sizeof(double));
 	
 	
-	/*==================== REORDERING DATA for the DFE ====================*/
-	
-	printf("Reordering data for the DFE.\n");
-	start_time = gettime();
-	prepare_data_for_dfe (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
-	reorder_time = gettime() - start_time;
-		
 	/*==================== Computation ====================*/
 
+	// One engine overlaps reordering, DFE and sorting of consecutive chunks; several engines split the timesteps
 	printf("CORRELATE!\n");
+	correlation_profile_enable (1);
 	start_time = gettime();
 	
-	//Executing loadLMem action
-	correlation_loadLMem(numBursts, &loopLength, in_memLoad);
-	printf("LMem initialized!\n");
+	if (numTimeseries > correlation_maxNumTimeseries)
+		correlation_blocked (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize,
+					correlations_final, indices_final);
+	else if (numEngines > 1)
+		correlation_sharded (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numEngines,
+					correlations_final, indices_final);
+	else
+		correlation_pipelined (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numTimestepsPerChunk,
+					correlations_final, indices_final);
 	
-	//Executing correlation action
-	correlation(numBursts, numTimesteps, numTimeseries, 0, windowSize,	// scalar inputs 
-				precalculations, data_pairs,			// streaming reordered inputs
-				out_correlation, out_indices			// streaming unordered outputs
-				);				
-				
-	DFE_time = gettime() - start_time;
+	total_time = gettime() - start_time;
 	printf("DFE done!\n");
 	
-	//CPU sorting outputs
-	int correlations_per_step = loopLength * correlation_numTopScores * correlation_numPipes; // number of correlations in output per timestep 
-	start_time = gettime();
-	
-	printf("Sorting outputs.\n");
-	for (uint64_t i=0; i<numTimesteps; i++) {
-		topCorrelations (&out_correlation[i*correlations_per_step], &out_indices[2*i*correlations_per_step], correlations_per_step,
-		&correlations_final[i*correlation_numTopScores], &indices_final[i*correlation_numTopScores], correlation_numTopScores); 	
-	}
-	sort_time = gettime() - start_time;
-	
-	total_time = reorder_time + DFE_time + sort_time;
-	
-	printf("Data reordering time: %.5lfs\n", reorder_time);
-	printf("DFE execution time: %.5lfs\n", DFE_time);
-	printf("Sorting time: %.5lfs\n", sort_time);
+	correlation_profile_get (&profile);
+	printf("Data reordering time: %.5lfs\n", profile.phases[CORRELATION_PHASE_REORDER].seconds);
+	printf("LMem load time: %.5lfs\n", profile.phases[CORRELATION_PHASE_LMEM_LOAD].seconds);
+	printf("DFE wait time: %.5lfs\n", profile.phases[CORRELATION_PHASE_DFE_RUN].seconds);
+	printf("Sorting time: %.5lfs\n", profile.phases[CORRELATION_PHASE_SORT].seconds);
 	printf("Total execution time: %.5lfs\n", total_time);
+	correlation_profile_dump (stdout);
+	correlation_profile_disable ();
 	
 	//Deallocating memory
-	free (out_indices);
-	free (out_correlation);
-	free (in_memLoad);
-	free (data_pairs);
-	free (precalculations);
 	free (correlations_final);
 	free (indices_final);
 
@@ -0,0 +1,652 @@
+/**
+ * File: bench.c
+ * Purpose: benchmarks of the CPU correlation paths and of the host side of the DFE paths
+ *
+ * Every benchmark runs on the same deterministic data for every point of a sweep over the number
+ * of timeseries (N), the window and the number of timesteps:
+ *	orig			- ORIG correlation, top correlations of every step in double
+ *	orig_f32		- ORIG correlation_f32, the same in single precision
+ *	split_control_flow	- SPLIT control flow, the DFE input streams of every step
+ *	split_data_flow		- SPLIT data flow, top correlations from those streams
+ *	dfe_prepare		- encoding of the DFE input streams from time-major data (host side of APP)
+ *	dfe_sort		- topCorrelations on the per-pipe candidates the DFE writes per step
+ *	dfe_merge		- correlation_merge_steps on the same candidates
+ *	full_cpu		- all correlations of one window (FullCorrelations on the CPU)
+ *
+ * The data come from correlation_random with the given seed, uniform noise or, with --plant B,
+ * B pairs of correlation 0.9 planted in normal noise.
+ *
+ * The DFE itself is not run; its host paths are timed through the COMMON code APP links in. A DFE
+ * step writes loopLength*120 candidates (10 per pipe and iteration, 12 pipes); loopLength is a
+ * constant of the maxfile, so it is a parameter here.
+ *
+ * Each benchmark reports the best time of its repetitions, work units (pairs, input values or
+ * candidates) per second and ns per unit, a model of the bytes moved through memory and the peak
+ * resident set of the process during its runs. The report is JSON, one result per line; with
+ * --baseline, results slower than a stored report by more than the tolerance are listed and the
+ * exit status is 1.
+ *
+ * With --verify the same sweep checks every variant against an independent naive reference
+ * instead, see verify.c; the exit status is 1 if any variant differs by more than its tolerance.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <omp.h>
+
+#include "correlation_topk.h"
+#include "correlation_kernel.h"
+#include "correlation_encoder.h"
+#include "correlation_merge.h"
+#include "correlation_syrk.h"
+#include "correlation_random.h"
+
+#include "bench.h"
+
+#define bench_maxValues (16)
+#define bench_maxResults (4096)
+
+// Inputs and outputs of one point of the sweep, shared by all benchmarks
+typedef struct {
+	uint64_t numTimeseries;		/* N */
+	uint64_t windowSize;		/* Window for correlation */
+	uint64_t numTimesteps;		/* Timesteps correlated */
+	uint64_t numCandidates;		/* DFE candidates per timestep */
+	int numTopScores;		/* Top correlations per timestep and ranking */
+	unsigned rankings;		/* correlation_rank_t values or-ed together */
+	double** series;		/* One row per timeseries, numTimesteps values each */
+	double* rows;			/* The same time-major */
+	double* precalculations;	/* DFE streams of all timesteps, from SPLIT control flow */
+	double* data_pairs;
+	double* correlations;		/* Top correlations */
+	uint32_t* indices;
+	double* candidates;		/* DFE candidates of all timesteps */
+	uint32_t* candidate_indices;
+	double* z;			/* Standardized window for full_cpu */
+	double* full;			/* All correlations of one window */
+} bench_data_t;
+
+typedef struct {
+	const char* name;
+	const char* unit;				/* What units counts */
+	int usesWindow;					/* Run for every window, or only the first */
+	int usesSteps;					/* Run for every number of timesteps, or only the last */
+	void (*run) (bench_data_t* d);			/* One run */
+	double (*units) (const bench_data_t* d);	/* Work of one run */
+	double (*bytes) (const bench_data_t* d);	/* Modelled bytes moved by one run */
+} bench_t;
+
+typedef struct {
+	const char* name;
+	const char* unit;
+	uint64_t numTimeseries;
+	uint64_t windowSize;
+	uint64_t numTimesteps;
+	double seconds;			/* Best of the repetitions */
+	double units;
+	double bytes;
+	uint64_t peakRss;		/* Bytes */
+} bench_result_t;
+
+
+//Time measuring
+static double gettime (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Peak resident set since the last reset_peak_rss, from VmHWM
+static uint64_t peak_rss (void) {
+
+	FILE* status = fopen ("/proc/self/status", "r");
+	char line[256];
+	uint64_t kb = 0;
+
+	if (!status)
+		return 0;
+	while (fgets (line, sizeof(line), status))
+		if (sscanf (line, "VmHWM: %lu kB", &kb) == 1)
+			break;
+	fclose (status);
+
+	return kb*1024;
+}
+
+// Without the reset (older kernels) the peak is that of the whole process so far
+static void reset_peak_rss (void) {
+
+	FILE* clear = fopen ("/proc/self/clear_refs", "w");
+	if (clear) {
+		fputs ("5", clear);
+		fclose (clear);
+	}
+}
+
+static double num_pairs (const bench_data_t* d) {
+	return 0.5 * d->numTimeseries * (d->numTimeseries - 1);
+}
+
+
+static void run_orig (bench_data_t* d) {
+	correlation (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, d->numTopScores, d->rankings, d->correlations, d->indices);
+}
+
+static void run_orig_f32 (bench_data_t* d) {
+	correlation_f32 (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, d->numTopScores, d->rankings, d->correlations, d->indices);
+}
+
+static void run_split_control_flow (bench_data_t* d) {
+	correlation_control_flow (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, d->precalculations, d->data_pairs);
+}
+
+static void run_split_data_flow (bench_data_t* d) {
+	correlation_data_flow (d->numTimesteps, d->numTimeseries, d->windowSize, d->numTopScores, d->rankings, d->precalculations, d->data_pairs,
+				d->correlations, d->indices);
+}
+
+static void run_dfe_prepare (bench_data_t* d) {
+
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, d->numTimeseries, d->windowSize);
+	correlation_encoder_push_block (&encoder, d->rows, d->numTimesteps, d->precalculations, d->data_pairs);
+	correlation_encoder_free (&encoder);
+}
+
+static void run_dfe_sort (bench_data_t* d) {
+
+	int numTopScores = d->numTopScores;
+
+	for (uint64_t s=0; s<d->numTimesteps; s++)
+		topCorrelations (&d->candidates[s*d->numCandidates], &d->candidate_indices[2*s*d->numCandidates], d->numCandidates,
+				&d->correlations[s*numTopScores], &d->indices[2*s*numTopScores], numTopScores);
+}
+
+static void run_dfe_merge (bench_data_t* d) {
+	correlation_merge_steps (d->candidates, d->candidate_indices, d->numTimesteps, d->numCandidates, d->numTopScores,
+				d->correlations, d->indices);
+}
+
+// The window is the whole series: the last windowSize values
+static void run_full_cpu (bench_data_t* d) {
+
+	double* window[d->numTimeseries];
+	for (uint64_t i=0; i<d->numTimeseries; i++)
+		window[i] = &d->series[i][d->numTimesteps - d->windowSize];
+
+	correlation_syrk_standardize (window, d->windowSize, d->numTimeseries, d->z);
+	correlation_syrk (d->z, d->windowSize, d->numTimeseries, d->full);
+}
+
+static double steps_pairs (const bench_data_t* d) {
+	return num_pairs (d) * d->numTimesteps;
+}
+
+static double steps_values (const bench_data_t* d) {
+	return (double) d->numTimeseries * d->numTimesteps;
+}
+
+static double steps_candidates (const bench_data_t* d) {
+	return (double) d->numCandidates * d->numTimesteps;
+}
+
+static double window_pairs (const bench_data_t* d) {
+	return num_pairs (d);
+}
+
+// SUM(x,y) read and written every step, SUM(x), SUM(x^2) and the two cross-sections beside it
+static double bytes_orig (const bench_data_t* d) {
+	return d->numTimesteps * (16*num_pairs (d) + 32.0*d->numTimeseries);
+}
+
+static double bytes_orig_f32 (const bench_data_t* d) {
+	return d->numTimesteps * (8*num_pairs (d) + 32.0*d->numTimeseries);
+}
+
+// x[s] read, x[s-n] read back from the window, 4 doubles of streams written
+static double bytes_streams (const bench_data_t* d) {
+	return 48 * steps_values (d);
+}
+
+// The streams read, SUM(x,y) read and written every step
+static double bytes_data_flow (const bench_data_t* d) {
+	return d->numTimesteps * (16*num_pairs (d) + 32.0*d->numTimeseries);
+}
+
+// A correlation and a pair of indices per candidate
+static double bytes_candidates (const bench_data_t* d) {
+	return 16 * steps_candidates (d);
+}
+
+// The window read and Z written once, the correlations written once
+static double bytes_full (const bench_data_t* d) {
+	return 16.0*d->windowSize*d->numTimeseries + 8*num_pairs (d);
+}
+
+static const bench_t benches[] = {
+	{"orig",		"pair",		1, 1, run_orig,			steps_pairs,		bytes_orig},
+	{"orig_f32",		"pair",		1, 1, run_orig_f32,		steps_pairs,		bytes_orig_f32},
+	{"split_control_flow",	"value",	1, 1, run_split_control_flow,	steps_values,		bytes_streams},
+	{"split_data_flow",	"pair",		1, 1, run_split_data_flow,	steps_pairs,		bytes_data_flow},
+	{"dfe_prepare",		"value",	1, 1, run_dfe_prepare,		steps_values,		bytes_streams},
+	{"dfe_sort",		"candidate",	0, 1, run_dfe_sort,		steps_candidates,	bytes_candidates},
+	{"dfe_merge",		"candidate",	0, 1, run_dfe_merge,		steps_candidates,	bytes_candidates},
+	{"full_cpu",		"pair",		1, 0, run_full_cpu,		window_pairs,		bytes_full},
+};
+
+#define bench_numBenches ((int)(sizeof(benches)/sizeof(benches[0])))
+
+
+static void* bench_malloc (size_t size) {
+
+	void* p = malloc (size ? size : 1);
+	if (!p) {
+		fprintf(stderr, "Cannot allocate %zu bytes. Terminating!\n", size);
+		fflush(stderr);
+		exit(-1);
+	}
+	return p;
+}
+
+// Same data for a given model and sizes, whichever benchmarks run
+static void data_init (bench_data_t* d, const correlation_random_t* model, uint64_t numTimeseries, uint64_t windowSize, uint64_t numTimesteps, uint64_t loopLength,
+			int numTopScores, unsigned rankings) {
+
+	uint64_t numScores = correlation_num_scores (numTopScores, rankings);
+
+	d->numTimeseries = numTimeseries;
+	d->numTopScores = numTopScores;
+	d->rankings = rankings;
+	d->windowSize = windowSize;
+	d->numTimesteps = numTimesteps;
+	d->numCandidates = loopLength*120;
+
+	d->series = (double**) bench_malloc (numTimeseries*sizeof(double*));
+	d->rows = (double*) bench_malloc (numTimesteps*numTimeseries*sizeof(double));
+	for (uint64_t i=0; i<numTimeseries; i++)
+		d->series[i] = (double*) bench_malloc (numTimesteps*sizeof(double));
+	correlation_random_series (model, d->series, numTimeseries, 0, numTimesteps);
+	for (uint64_t s=0; s<numTimesteps; s++)
+		for (uint64_t i=0; i<numTimeseries; i++)
+			d->rows[s*numTimeseries + i] = d->series[i][s];
+
+	d->precalculations = (double*) bench_malloc (2*numTimesteps*numTimeseries*sizeof(double));
+	d->data_pairs = (double*) bench_malloc (2*numTimesteps*numTimeseries*sizeof(double));
+	correlation_control_flow (d->series, numTimesteps, numTimeseries, numTimesteps, windowSize, d->precalculations, d->data_pairs);
+
+	d->correlations = (double*) bench_malloc (numScores*numTimesteps*sizeof(double));
+	d->indices = (uint32_t*) bench_malloc (2*numScores*numTimesteps*sizeof(uint32_t));
+
+	d->candidates = (double*) bench_malloc (d->numCandidates*numTimesteps*sizeof(double));
+	d->candidate_indices = (uint32_t*) bench_malloc (2*d->numCandidates*numTimesteps*sizeof(uint32_t));
+
+	// Candidates in [-1, 1) with random pairs, from noise of another seed
+	correlation_random_t noise;
+	correlation_random_init (&noise, ~model->seed);
+	for (uint64_t s=0; s<numTimesteps; s++)
+		for (uint64_t c=0; c<d->numCandidates; c++) {
+			uint64_t n = s*d->numCandidates + c;
+			d->candidates[n] = 2*correlation_random_value (&noise, 3*c, s) - 1;
+			d->candidate_indices[2*n] = correlation_random_value (&noise, 3*c+1, s) * numTimeseries;
+			d->candidate_indices[2*n+1] = correlation_random_value (&noise, 3*c+2, s) * numTimeseries;
+		}
+
+	d->z = NULL;
+	d->full = NULL;
+	if (windowSize <= numTimesteps) {
+		d->z = (double*) bench_malloc (windowSize*correlation_syrk_columns (numTimeseries)*sizeof(double));
+		d->full = (double*) bench_malloc ((numTimeseries*(numTimeseries-1)/2)*sizeof(double));
+	}
+}
+
+static void data_free (bench_data_t* d) {
+
+	for (uint64_t i=0; i<d->numTimeseries; i++)
+		free (d->series[i]);
+	free (d->series);
+	free (d->rows);
+	free (d->precalculations);
+	free (d->data_pairs);
+	free (d->correlations);
+	free (d->indices);
+	free (d->candidates);
+	free (d->candidate_indices);
+	free (d->z);
+	free (d->full);
+}
+
+static bench_result_t run_bench (const bench_t* bench, bench_data_t* d, int numReps) {
+
+	bench_result_t result;
+
+	result.name = bench->name;
+	result.unit = bench->unit;
+	result.numTimeseries = d->numTimeseries;
+	result.windowSize = d->windowSize;
+	result.numTimesteps = d->numTimesteps;
+	result.units = bench->units (d);
+	result.bytes = bench->bytes (d);
+	result.seconds = INFINITY;
+
+	reset_peak_rss();
+
+	for (int r=0; r<numReps; r++) {
+		double start = gettime();
+		bench->run (d);
+		double seconds = gettime() - start;
+		if (seconds < result.seconds)
+			result.seconds = seconds;
+	}
+
+	result.peakRss = peak_rss();
+
+	// Buffers kept between calls are given back, so the next benchmark starts from the same state
+	correlation_free_buffers();
+	correlation_data_flow_free_buffers();
+
+	return result;
+}
+
+static void print_result (FILE* out, const bench_result_t* r, int last) {
+
+	fprintf(out, "    {\"bench\": \"%s\", \"N\": %lu, \"window\": %lu, \"steps\": %lu, \"unit\": \"%s\", \"units\": %.0f, "
+			"\"seconds\": %.9f, \"units_per_sec\": %.6g, \"ns_per_unit\": %.6g, \"bytes_moved\": %.0f, \"bytes_per_sec\": %.6g, \"peak_rss\": %lu}%s\n",
+		r->name, r->numTimeseries, r->windowSize, r->numTimesteps, r->unit, r->units,
+		r->seconds, r->units / r->seconds, 1e9 * r->seconds / r->units, r->bytes, r->bytes / r->seconds, r->peakRss,
+		last ? "" : ",");
+}
+
+// Value of "key": in a line of a report, as a string or a number
+static int json_string (const char* line, const char* key, char* value, size_t size) {
+
+	char pattern[64];
+	snprintf (pattern, sizeof(pattern), "\"%s\": \"", key);
+
+	const char* start = strstr (line, pattern);
+	if (!start)
+		return 0;
+	start += strlen (pattern);
+
+	const char* end = strchr (start, '"');
+	if (!end || (size_t)(end - start) >= size)
+		return 0;
+	memcpy (value, start, end - start);
+	value[end - start] = 0;
+	return 1;
+}
+
+static int json_number (const char* line, const char* key, double* value) {
+
+	char pattern[64];
+	snprintf (pattern, sizeof(pattern), "\"%s\": ", key);
+
+	const char* start = strstr (line, pattern);
+	return start && sscanf (start + strlen (pattern), "%lf", value) == 1;
+}
+
+// Results more than tolerance slower per unit than the same point of the baseline; returns their number
+static int compare_baseline (const char* path, const bench_result_t* results, int numResults, double tolerance) {
+
+	FILE* in = fopen (path, "r");
+	if (!in) {
+		fprintf(stderr, "Cannot open baseline %s. Terminating!\n", path);
+		fflush(stderr);
+		exit(-1);
+	}
+
+	char line[1024];
+	int numRegressions = 0;
+	int numCompared = 0;
+
+	while (fgets (line, sizeof(line), in)) {
+
+		char name[64];
+		double n, window, steps, nsPerUnit;
+
+		if (!json_string (line, "bench", name, sizeof(name)) || !json_number (line, "N", &n) || !json_number (line, "window", &window)
+		    || !json_number (line, "steps", &steps) || !json_number (line, "ns_per_unit", &nsPerUnit))
+			continue;
+
+		for (int r=0; r<numResults; r++) {
+			const bench_result_t* result = &results[r];
+			if (strcmp (result->name, name) != 0 || result->numTimeseries != (uint64_t)n
+			    || result->windowSize != (uint64_t)window || result->numTimesteps != (uint64_t)steps)
+				continue;
+
+			double current = 1e9 * result->seconds / result->units;
+			double change = current / nsPerUnit - 1;
+
+			numCompared++;
+			if (change > tolerance) {
+				fprintf(stderr, "Regression: %s N=%lu window=%lu steps=%lu: %.4g ns/%s, baseline %.4g (%+.1f%%)\n",
+					name, result->numTimeseries, result->windowSize, result->numTimesteps, current, result->unit, nsPerUnit, 100*change);
+				numRegressions++;
+			}
+		}
+	}
+	fclose (in);
+
+	fprintf(stderr, "%d of %d results compared with %s regressed by more than %.0f%%\n", numRegressions, numCompared, path, 100*tolerance);
+
+	return numRegressions;
+}
+
+// Comma separated list of numbers
+static int parse_list (const char* text, uint64_t* values) {
+
+	int numValues = 0;
+	char* end;
+
+	while (*text && numValues < bench_maxValues) {
+		values[numValues++] = strtoull (text, &end, 10);
+		if (end == text)
+			break;
+		text = *end == ',' ? end+1 : end;
+	}
+	return numValues;
+}
+
+static const char* rank_names[] = {"top", "bottom", "abs"};
+
+// Comma separated list of rankings, as correlation_rank_t values or-ed together; 0 if any is unknown
+static unsigned parse_rankings (const char* text) {
+
+	unsigned rankings = 0;
+
+	while (*text) {
+		size_t length = strcspn (text, ",");
+		unsigned rank = 0;
+		for (int r=0; r<correlation_topkMaxRanks; r++)
+			if (strlen (rank_names[r]) == length && !strncmp (text, rank_names[r], length))
+				rank = 1u << r;
+		if (!rank)
+			return 0;
+		rankings |= rank;
+		text += text[length] == ',' ? length+1 : length;
+	}
+	return rankings;
+}
+
+// The same list back, for the report
+static void rankings_name (unsigned rankings, char* name, size_t size) {
+
+	name[0] = 0;
+	for (int r=0; r<correlation_topkMaxRanks; r++)
+		if (rankings & (1u << r))
+			snprintf (name + strlen (name), size - strlen (name), "%s%s", name[0] ? "," : "", rank_names[r]);
+}
+
+static int selected (const char* only, const char* name) {
+
+	if (!only)
+		return 1;
+
+	size_t length = strlen (name);
+	for (const char* p = strstr (only, name); p; p = strstr (p+1, name))
+		if ((p == only || p[-1] == ',') && (p[length] == ',' || p[length] == 0))
+			return 1;
+	return 0;
+}
+
+static void usage (const char* program) {
+	fprintf(stderr, "Usage: %s [--quick] [--n N,...] [--window W,...] [--steps S,...] [--reps R] [--seed S] [--plant B]\n"
+			"          [--k K] [--rankings top,bottom,abs] [--loop-length L] [--only BENCH,...] [--out FILE] [--baseline FILE] [--tolerance T]\n"
+			"       %s --verify [--n N,...] [--window W,...] [--steps S,...] [--seed S] [--plant B] [--k K] [--error E] [--error-f32 E] [--out FILE]\n",
+		program, program);
+	fflush(stderr);
+	exit(-1);
+}
+
+// Every variant against the ORIG reference at every point of the sweep; exit status 1 if any fails
+static int verify_sweep (FILE* out, const correlation_random_t* model, const uint64_t* sizes, int numSizes, const uint64_t* windows, int numWindows,
+				const uint64_t* steps, int numSteps, uint64_t loopLength, int numTopScores, double errorTolerance, double errorTolerance_f32) {
+
+	int first = 1;
+	int numFailed = 0;
+
+	fprintf(out, "{\n  \"isa\": \"%s\", \"threads\": %d, \"seed\": %lu, \"planted\": %lu, \"k\": %d,\n  \"verify\": [\n",
+		correlation_kernel_isa_name (correlation_kernel_get_isa()), omp_get_max_threads(), model->seed, model->numBlocks, numTopScores);
+
+	for (int n=0; n<numSizes; n++)
+		for (int w=0; w<numWindows; w++)
+			for (int t=0; t<numSteps; t++)
+				numFailed += verify_point (out, &first, model, sizes[n], windows[w], steps[t], loopLength, numTopScores,
+									errorTolerance, errorTolerance_f32);
+
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose (out);
+
+	fprintf(stderr, "%d checks failed\n", numFailed);
+
+	return numFailed > 0;
+}
+
+int main (int argc, char** argv) {
+
+	uint64_t sizes[bench_maxValues] = {200, 500, 1000, 2000, 4000, 6000};
+	uint64_t windows[bench_maxValues] = {9, 100};
+	uint64_t steps[bench_maxValues] = {12, 128};
+	int numSizes = 6, numWindows = 2, numSteps = 2;
+	int sweepGiven = 0;
+	int numReps = 3;
+	uint64_t seed = 1;
+	uint64_t numPlanted = 0;
+	uint64_t loopLength = 100;
+	int numTopScores = 10;
+	unsigned rankings = CORRELATION_RANK_TOP;
+	double tolerance = 0.10;
+	int verify = 0;
+	double errorTolerance = 1e-9;
+	double errorTolerance_f32 = 1e-4;
+	const char* only = NULL;
+	const char* outPath = NULL;
+	const char* baselinePath = NULL;
+
+	for (int a=1; a<argc; a++) {
+		int more = a+1 < argc;
+		if (!strcmp (argv[a], "--quick")) {
+			sizes[0] = 200; sizes[1] = 1000; numSizes = 2;
+			numWindows = 1;
+			numSteps = 1;
+			numReps = 1;
+		}
+		else if (!strcmp (argv[a], "--n") && more)		numSizes = parse_list (argv[++a], sizes), sweepGiven = 1;
+		else if (!strcmp (argv[a], "--window") && more)		numWindows = parse_list (argv[++a], windows), sweepGiven = 1;
+		else if (!strcmp (argv[a], "--steps") && more)		numSteps = parse_list (argv[++a], steps), sweepGiven = 1;
+		else if (!strcmp (argv[a], "--reps") && more)		numReps = atoi (argv[++a]);
+		else if (!strcmp (argv[a], "--seed") && more)		seed = strtoull (argv[++a], NULL, 10);
+		else if (!strcmp (argv[a], "--plant") && more)		numPlanted = strtoull (argv[++a], NULL, 10);
+		else if (!strcmp (argv[a], "--loop-length") && more)	loopLength = strtoull (argv[++a], NULL, 10);
+		else if (!strcmp (argv[a], "--k") && more)		numTopScores = atoi (argv[++a]);
+		else if (!strcmp (argv[a], "--rankings") && more)	rankings = parse_rankings (argv[++a]);
+		else if (!strcmp (argv[a], "--only") && more)		only = argv[++a];
+		else if (!strcmp (argv[a], "--out") && more)		outPath = argv[++a];
+		else if (!strcmp (argv[a], "--baseline") && more)	baselinePath = argv[++a];
+		else if (!strcmp (argv[a], "--tolerance") && more)	tolerance = atof (argv[++a]);
+		else if (!strcmp (argv[a], "--verify"))			verify = 1;
+		else if (!strcmp (argv[a], "--error") && more)		errorTolerance = atof (argv[++a]);
+		else if (!strcmp (argv[a], "--error-f32") && more)	errorTolerance_f32 = atof (argv[++a]);
+		else
+			usage (argv[0]);
+	}
+
+	// The reference runs on one thread: smaller sizes, one that takes several block passes, and a long run to show drift
+	if (verify && !sweepGiven) {
+		sizes[0] = 37; sizes[1] = 200; sizes[2] = 1000; numSizes = 3;
+		steps[0] = 12; steps[1] = 1000; numSteps = 2;
+	}
+
+	if (numSizes == 0 || numWindows == 0 || numSteps == 0 || numReps < 1 || loopLength == 0 || numTopScores < 1 || rankings == 0)
+		usage (argv[0]);
+	for (int w=0; w<numWindows; w++)
+		if (windows[w] < 2) {
+			fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+			fflush(stderr);
+			exit(-1);
+		}
+
+	// Uniform noise, or B planted pairs of correlation 0.9 in normal noise
+	correlation_random_t model;
+	correlation_random_init (&model, seed);
+	if (numPlanted > 0)
+		correlation_random_plant (&model, numPlanted, 2, 0.9);
+
+	FILE* out = outPath ? fopen (outPath, "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Cannot create %s. Terminating!\n", outPath);
+		fflush(stderr);
+		exit(-1);
+	}
+
+	if (verify)
+		return verify_sweep (out, &model, sizes, numSizes, windows, numWindows, steps, numSteps, loopLength, numTopScores, errorTolerance, errorTolerance_f32);
+
+	static bench_result_t results[bench_maxResults];
+	int numResults = 0;
+
+	for (int n=0; n<numSizes; n++)
+		for (int w=0; w<numWindows; w++)
+			for (int t=0; t<numSteps; t++) {
+
+				bench_data_t data;
+				data_init (&data, &model, sizes[n], windows[w], steps[t], loopLength, numTopScores, rankings);
+
+				for (int b=0; b<bench_numBenches && numResults<bench_maxResults; b++) {
+					const bench_t* bench = &benches[b];
+
+					if (!selected (only, bench->name) || (!bench->usesWindow && w > 0) || (!bench->usesSteps && t < numSteps-1))
+						continue;
+					if (bench->run == run_full_cpu && !data.z)
+						continue;
+
+					results[numResults++] = run_bench (bench, &data, numReps);
+					fprintf(stderr, "%-20s N=%-6lu window=%-6lu steps=%-6lu %10.6f s\n",
+						bench->name, sizes[n], windows[w], steps[t], results[numResults-1].seconds);
+				}
+
+				data_free (&data);
+			}
+
+	char rankingsName[32];
+	rankings_name (rankings, rankingsName, sizeof(rankingsName));
+
+	fprintf(out, "{\n  \"isa\": \"%s\", \"threads\": %d, \"seed\": %lu, \"planted\": %lu, \"reps\": %d, \"loop_length\": %lu, \"k\": %d, \"rankings\": \"%s\",\n  \"results\": [\n",
+		correlation_kernel_isa_name (correlation_kernel_get_isa()), omp_get_max_threads(), seed, numPlanted, numReps, loopLength, numTopScores, rankingsName);
+	for (int r=0; r<numResults; r++)
+		print_result (out, &results[r], r == numResults-1);
+	fprintf(out, "  ]\n}\n");
+
+	if (outPath)
+		fclose (out);
+
+	if (baselinePath && compare_baseline (baselinePath, results, numResults, tolerance) > 0)
+		return 1;
+
+	return 0;
+}
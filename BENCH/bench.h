@@ -0,0 +1,49 @@
+/**
+ * File: bench.h
+ * Purpose: the ORIG and SPLIT entry points linked into the benchmarks, and the verify mode
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "correlation_random.h"
+
+// ORIG, built without main
+void correlation (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices);
+void correlation_f32 (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices);
+uint64_t correlation_checkpoints (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+					uint64_t checkpointInterval, int numTopScores, unsigned rankings, double* correlations, uint32_t* indices);
+void correlation_reference (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize, int numTopScores,
+				double* correlations, uint32_t* indices);
+int correlation_num_scores (int numTopScores, unsigned rankings);
+void correlation_free_buffers (void);
+
+// SPLIT, built without main
+void correlation_control_flow (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs);
+void correlation_data_flow (uint64_t numTimesteps, uint64_t numTimeSeries, uint64_t windowSize, int numTopScores, unsigned rankings,
+				double* precalculations, double* data_pairs, double* correlations, uint32_t* indices);
+int correlation_data_flow_num_scores (int numTopScores, unsigned rankings);
+void correlation_data_flow_free_buffers (void);
+
+
+/* Check every variant against the naive reference at one point of the sweep, one JSON line per variant and ranking; returns the number of failures */
+int verify_point (
+	FILE* out,				/* Report */
+	int* first,				/* No line written yet, cleared once one is */
+	const correlation_random_t* model,	/* Data */
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	uint64_t windowSize,			/* Window for correlation */
+	uint64_t numTimesteps,			/* Timesteps correlated */
+	uint64_t loopLength,			/* Loop length of the modelled DFE, for the candidates of the merge */
+	int numTopScores,			/* Top correlations per timestep and ranking */
+	double tolerance,			/* Largest difference of double precision scores */
+	double tolerance_f32			/* Largest difference of single precision scores */
+);
+
+#endif /* BENCH_H */
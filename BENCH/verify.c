@@ -0,0 +1,784 @@
+/**
+ * File: verify.c
+ * Purpose: differential check of every correlation variant against an independent naive reference
+ *
+ * The reference shares no code with the variants: every window is correlated from scratch with the
+ * two-pass formula r = sum (x-mx)(y-my) / sqrt(sum (x-mx)^2 sum (y-my)^2) over all pairs i<j, and
+ * the correlations of every ranking go through a full stable sort (best score first, ties by the
+ * position of the pair) before the first K are taken. Until the window fills it is padded with
+ * zeros at the front, as the sliding sums of the variants are. The reference costs O(N^2 W) per
+ * timestep, so it is computed on evenly spaced timesteps, the first and the last one always, as many
+ * as verify_referenceWork allows; the variants are compared on those timesteps. Once they are 7 or
+ * more apart, every other one moves forward to a checkpoint of the batched variants, which are
+ * compared on the timesteps that are checkpoints of theirs.
+ *
+ * Every variant correlates the same data twice, keeping the top ranking only and then the top,
+ * bottom and |r| rankings in one pass, and each ranking of each run is compared with the reference:
+ *	orig_reference		- the original ORIG algorithm (top ranking only, up to verify_maxReferencePairSteps)
+ *	orig_scalar		- scalar kernel
+ *	orig_sse2/avx2/avx512	- each vector kernel the CPU supports
+ *	orig_f32		- single precision, with its own tolerance
+ *	orig_batched		- time-major batches (correlation_checkpoints, every step)
+ *	orig_batched_4/7	- the same every 4th and 7th step, compared on the checkpoints only; 7 does not
+ *				  divide the default 12 timesteps, so the last checkpoint is a short one
+ *	split			- SPLIT control flow and data flow
+ *	dfe_host		- streams from the encoder of the DFE host code, correlated by the SPLIT data flow
+ *	full_cpu		- SYRK over the last window, last timestep only
+ *	orig_blocks		- the triangle cut into passes of at most verify_blockPassSize timeseries (more for
+ *				  large N), each pass correlated by ORIG and its candidates merged by correlation_blocks_push
+ *	dfe_merge		- correlation_merge_steps on DFE-shaped candidates, against the same full sort
+ *				  (skipped when K exceeds the candidates of a step)
+ *
+ * Scores are compared rank by rank; the largest difference is the error of the variant. A pair of
+ * the variant that is not in the reference top K of its step is a mismatch, unless its score ties
+ * the K-th reference score within the tolerance. The largest error of the first and of the last
+ * tenth of the compared timesteps shows drift over long runs.
+ *
+ * Ties are checked exactly. The data holds two copies of one timeseries and two negated copies of
+ * another, so every timestep has pairs with bit-identical scores near the head of every ranking;
+ * adjacent entries of a variant with bit-identical scores have to come in the order of their pair
+ * positions. The merge candidates have coarse scores, ties everywhere, and are compared at zero
+ * tolerance: every rank has to hold exactly the pair of the reference.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "correlation_topk.h"
+#include "correlation_kernel.h"
+#include "correlation_encoder.h"
+#include "correlation_merge.h"
+#include "correlation_syrk.h"
+#include "correlation_blocks.h"
+#include "correlation_random.h"
+
+#include "bench.h"
+
+#define verify_referenceWork (1e9)			/* Multiply-adds and compares of the reference per point */
+#define verify_maxReferencePairSteps (50000000)		/* Pairs times timesteps orig_reference runs for */
+#define verify_numRanks (3)				/* Top, bottom and |r|, the reference keeps all of them */
+#define verify_checkpointShort (4)			/* Checkpoint intervals of orig_batched_4 and orig_batched_7; 7 does */
+#define verify_checkpointLong (7)			/* not divide the 12 timesteps of the default sweep */
+#define verify_blockPassSize (16)			/* Timeseries per pass of orig_blocks, N=37 takes 10 passes */
+#define verify_maxBlocks (8)				/* Blocks of orig_blocks at most, larger N take larger passes */
+
+typedef struct {
+	uint64_t numTimeseries;		/* N */
+	uint64_t windowSize;		/* Window for correlation */
+	uint64_t numTimesteps;		/* Timesteps correlated */
+	int numTopScores;		/* Top correlations per timestep and ranking */
+	unsigned rankings;		/* Rankings of the run, correlation_rank_t or-ed together */
+	int numScores;			/* numTopScores of every ranking of the run */
+	double** series;		/* One row per timeseries, numTimesteps values each */
+	double* rows;			/* The same time-major */
+	double* correlations;		/* Top correlations of the variant, numScores per timestep */
+	uint32_t* indices;
+} verify_data_t;
+
+typedef struct {
+	const char* name;
+	int f32;				/* Single precision, compared with tolerance_f32 */
+	int lastOnly;				/* Only the last timestep is computed */
+	int topOnly;				/* Only the top ranking is kept */
+	uint64_t checkpointInterval;		/* Only every checkpointInterval-th timestep and the last one are computed, 0 for all */
+	int (*run) (verify_data_t* d);		/* Returns 0 if the variant cannot run here */
+} verify_t;
+
+typedef struct {
+	uint64_t numSteps;		/* Timesteps of the reference */
+	uint64_t* steps;		/* Timesteps, ascending; the last one is the last timestep */
+	double* correlations;		/* Top, bottom and |r| rankings of every timestep, numTopScores each */
+	uint32_t* indices;		/* Pairs (j,i), j>i */
+} verify_reference_t;
+
+typedef struct {
+	double score;			/* Ranking score */
+	uint64_t position;		/* Position of the pair, or of the candidate */
+} verify_entry_t;
+
+
+static void* verify_malloc (size_t size) {
+
+	void* p = malloc (size ? size : 1);
+	if (!p) {
+		fprintf(stderr, "Cannot allocate %zu bytes. Terminating!\n", size);
+		fflush(stderr);
+		exit(-1);
+	}
+	return p;
+}
+
+// Back to the widest instruction set and the threads of the variants
+static void restore_defaults (int numThreads) {
+	correlation_kernel_set_isa (correlation_kernel_detect_isa());
+	omp_set_num_threads (numThreads);
+}
+
+static int run_isa (verify_data_t* d, correlation_isa_t isa) {
+
+	if (correlation_kernel_set_isa (isa) != isa)
+		return 0;
+
+	correlation (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, d->numTopScores, d->rankings,
+			d->correlations, d->indices);
+	return 1;
+}
+
+static int run_orig_reference (verify_data_t* d) {
+
+	if ((d->numTimeseries*(d->numTimeseries-1))/2*d->numTimesteps > verify_maxReferencePairSteps)
+		return 0;
+
+	correlation_reference (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, d->numTopScores,
+				d->correlations, d->indices);
+	return 1;
+}
+
+static int run_orig_scalar (verify_data_t* d) {
+	return run_isa (d, CORRELATION_ISA_SCALAR);
+}
+
+static int run_orig_sse2 (verify_data_t* d) {
+	return run_isa (d, CORRELATION_ISA_SSE2);
+}
+
+static int run_orig_avx2 (verify_data_t* d) {
+	return run_isa (d, CORRELATION_ISA_AVX2);
+}
+
+static int run_orig_avx512 (verify_data_t* d) {
+	return run_isa (d, CORRELATION_ISA_AVX512);
+}
+
+static int run_orig_f32 (verify_data_t* d) {
+	correlation_f32 (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, d->numTopScores, d->rankings,
+			d->correlations, d->indices);
+	return 1;
+}
+
+// Checkpoint c is timestep (c+1)*checkpointInterval-1, or the last one; spread back to the rows of their timesteps
+static int run_batched (verify_data_t* d, uint64_t checkpointInterval) {
+
+	uint64_t maxCheckpoints = (d->numTimesteps + checkpointInterval-1)/checkpointInterval;
+	double* correlations = (double*) verify_malloc (maxCheckpoints*d->numScores*sizeof(double));
+	uint32_t* indices = (uint32_t*) verify_malloc (2*maxCheckpoints*d->numScores*sizeof(uint32_t));
+
+	uint64_t numCheckpoints = correlation_checkpoints (d->rows, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, checkpointInterval,
+								d->numTopScores, d->rankings, correlations, indices);
+
+	for (uint64_t c=0; c<numCheckpoints; c++) {
+		uint64_t s = (c+1)*checkpointInterval-1 < d->numTimesteps ? (c+1)*checkpointInterval-1 : d->numTimesteps-1;
+		memcpy (&d->correlations[s*d->numScores], &correlations[c*d->numScores], d->numScores*sizeof(double));
+		memcpy (&d->indices[2*s*d->numScores], &indices[2*c*d->numScores], 2*d->numScores*sizeof(uint32_t));
+	}
+
+	free (correlations);
+	free (indices);
+	return 1;
+}
+
+static int run_orig_batched (verify_data_t* d) {
+	return run_batched (d, 1);
+}
+
+static int run_orig_batched_4 (verify_data_t* d) {
+	return run_batched (d, verify_checkpointShort);
+}
+
+static int run_orig_batched_7 (verify_data_t* d) {
+	return run_batched (d, verify_checkpointLong);
+}
+
+static int run_split (verify_data_t* d) {
+
+	double* precalculations = (double*) verify_malloc (2*d->numTimesteps*d->numTimeseries*sizeof(double));
+	double* data_pairs = (double*) verify_malloc (2*d->numTimesteps*d->numTimeseries*sizeof(double));
+
+	correlation_control_flow (d->series, d->numTimesteps, d->numTimeseries, d->numTimesteps, d->windowSize, precalculations, data_pairs);
+	correlation_data_flow (d->numTimesteps, d->numTimeseries, d->windowSize, d->numTopScores, d->rankings,
+				precalculations, data_pairs, d->correlations, d->indices);
+
+	free (precalculations);
+	free (data_pairs);
+	return 1;
+}
+
+static int run_dfe_host (verify_data_t* d) {
+
+	double* precalculations = (double*) verify_malloc (2*d->numTimesteps*d->numTimeseries*sizeof(double));
+	double* data_pairs = (double*) verify_malloc (2*d->numTimesteps*d->numTimeseries*sizeof(double));
+
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, d->numTimeseries, d->windowSize);
+	correlation_encoder_push_block (&encoder, d->rows, d->numTimesteps, precalculations, data_pairs);
+	correlation_encoder_free (&encoder);
+
+	correlation_data_flow (d->numTimesteps, d->numTimeseries, d->windowSize, d->numTopScores, d->rankings,
+				precalculations, data_pairs, d->correlations, d->indices);
+
+	free (precalculations);
+	free (data_pairs);
+	return 1;
+}
+
+// All correlations of the last window, packed j<i at i*(i-1)/2 + j
+static int run_full_cpu (verify_data_t* d) {
+
+	uint64_t numTimeseries = d->numTimeseries;
+	uint64_t last = d->numTimesteps-1;
+
+	if (d->windowSize > d->numTimesteps)
+		return 0;
+
+	double** window = (double**) verify_malloc (numTimeseries*sizeof(double*));
+	double* z = (double*) verify_malloc (d->windowSize*correlation_syrk_columns (numTimeseries)*sizeof(double));
+	double* full = (double*) verify_malloc ((numTimeseries*(numTimeseries-1)/2)*sizeof(double));
+
+	for (uint64_t i=0; i<numTimeseries; i++)
+		window[i] = &d->series[i][d->numTimesteps - d->windowSize];
+
+	correlation_syrk_standardize (window, d->windowSize, numTimeseries, z);
+	correlation_syrk (z, d->windowSize, numTimeseries, full);
+
+	// Ties are broken by the position of the pair in the kernel order, as in every other variant
+	correlation_topk_t topk;
+	correlation_topk_init_ranks (&topk, d->numTopScores, d->rankings);
+	for (uint64_t i=1; i<numTimeseries; i++)
+		for (uint64_t j=0; j<i; j++)
+			correlation_topk_push (&topk, full[i*(i-1)/2 + j], correlation_kernel_index (numTimeseries, j, i), i, j);
+	correlation_topk_result (&topk, &d->correlations[last*d->numScores], &d->indices[2*last*d->numScores]);
+	correlation_topk_free (&topk);
+
+	free (full);
+	free (z);
+	free (window);
+	return 1;
+}
+
+/*
+ * Block decomposition: every pass is correlated on its own and the candidates of each ranking are merged
+ * into a selector of that ranking only, since a pair may be a candidate of several rankings of a pass.
+ */
+static int run_orig_blocks (verify_data_t* d) {
+
+	uint64_t numTimeseries = d->numTimeseries;
+	uint64_t numTimesteps = d->numTimesteps;
+	int numTopScores = d->numTopScores;
+	int numScores = d->numScores;
+	int numRanks = correlation_topk_num_ranks (d->rankings);
+
+	uint64_t maxPassSize = 2*((numTimeseries + verify_maxBlocks-1)/verify_maxBlocks);
+	if (maxPassSize < verify_blockPassSize)
+		maxPassSize = verify_blockPassSize;
+
+	correlation_blocks_t blocks;
+	correlation_blocks_init (&blocks, numTimeseries, maxPassSize);
+
+	uint32_t* series = (uint32_t*) verify_malloc (maxPassSize*sizeof(uint32_t));
+	double** pass_data = (double**) verify_malloc (maxPassSize*sizeof(double*));
+	double* correlations = (double*) verify_malloc (numTimesteps*numScores*sizeof(double));
+	uint32_t* indices = (uint32_t*) verify_malloc (2*numTimesteps*numScores*sizeof(uint32_t));
+
+	correlation_topk_t* topk = (correlation_topk_t*) verify_malloc (numTimesteps*numRanks*sizeof(correlation_topk_t));
+	int slot = 0;
+	for (int r=0; r<verify_numRanks; r++) {
+		if (!(d->rankings & (1u << r)))
+			continue;
+		for (uint64_t s=0; s<numTimesteps; s++)
+			correlation_topk_init_ranks (&topk[s*numRanks + slot], numTopScores, 1u << r);
+		slot++;
+	}
+
+	for (uint64_t p=0; p<blocks.numPasses; p++) {
+
+		uint64_t numPassTimeseries = correlation_blocks_pass (&blocks, p, series);
+		for (uint64_t i=0; i<numPassTimeseries; i++)
+			pass_data[i] = d->series[series[i]];
+
+		// A pass with fewer than K pairs leaves slots unwritten: point them outside the pass
+		for (uint64_t n=0; n<2*numTimesteps*numScores; n++)
+			indices[n] = UINT32_MAX;
+
+		correlation (pass_data, numTimesteps, numPassTimeseries, numTimesteps, d->windowSize, numTopScores, d->rankings, correlations, indices);
+
+		for (uint64_t s=0; s<numTimesteps; s++)
+			for (slot=0; slot<numRanks; slot++) {
+				uint64_t first = s*numScores + slot*numTopScores;
+				correlation_blocks_push (&blocks, p, series, numPassTimeseries, &correlations[first], &indices[2*first], numTopScores,
+								&topk[s*numRanks + slot]);
+			}
+	}
+
+	for (uint64_t s=0; s<numTimesteps; s++)
+		for (slot=0; slot<numRanks; slot++) {
+			uint64_t first = s*numScores + slot*numTopScores;
+			correlation_topk_result (&topk[s*numRanks + slot], &d->correlations[first], &d->indices[2*first]);
+			correlation_topk_free (&topk[s*numRanks + slot]);
+		}
+
+	free (topk);
+	free (indices);
+	free (correlations);
+	free (pass_data);
+	free (series);
+	return 1;
+}
+
+static const verify_t variants[] = {
+	{"orig_reference",	0, 0, 1, 0, run_orig_reference},
+	{"orig_scalar",		0, 0, 0, 0, run_orig_scalar},
+	{"orig_sse2",		0, 0, 0, 0, run_orig_sse2},
+	{"orig_avx2",		0, 0, 0, 0, run_orig_avx2},
+	{"orig_avx512",		0, 0, 0, 0, run_orig_avx512},
+	{"orig_f32",		1, 0, 0, 0, run_orig_f32},
+	{"orig_batched",	0, 0, 0, 0, run_orig_batched},
+	{"orig_batched_4",	0, 0, 0, verify_checkpointShort, run_orig_batched_4},
+	{"orig_batched_7",	0, 0, 0, verify_checkpointLong, run_orig_batched_7},
+	{"split",		0, 0, 0, 0, run_split},
+	{"dfe_host",		0, 0, 0, 0, run_dfe_host},
+	{"full_cpu",		0, 1, 0, 0, run_full_cpu},
+	{"orig_blocks",		0, 0, 0, 0, run_orig_blocks},
+};
+
+#define verify_numVariants ((int)(sizeof(variants)/sizeof(variants[0])))
+
+static const char* rank_names[verify_numRanks] = {"top", "bottom", "abs"};
+
+
+// Best first; ties by position, NaN last
+static int entry_order (const void* a, const void* b) {
+
+	const verify_entry_t* p = (const verify_entry_t*) a;
+	const verify_entry_t* q = (const verify_entry_t*) b;
+
+	if (p->score > q->score || (!isnan(p->score) && isnan(q->score)))
+		return -1;
+	if (p->score < q->score || (isnan(p->score) && !isnan(q->score)))
+		return 1;
+	return p->position < q->position ? -1 : p->position > q->position;
+}
+
+// Score of a correlation in ranking r (top, bottom, |r|)
+static double rank_score (int r, double correlation) {
+	return r == 0 ? correlation : r == 1 ? -correlation : fabs (correlation);
+}
+
+// Position of pair (i,j) in the order the pairs are enumerated, i<j
+static uint64_t pair_position (uint64_t numTimeseries, uint64_t i, uint64_t j) {
+	return i*numTimeseries - (i*(i+1))/2 + (j-i-1);
+}
+
+// Position of an output pair, in either order
+static uint64_t entry_position (uint64_t numTimeseries, const uint32_t* pair) {
+	return pair[0] < pair[1] ? pair_position (numTimeseries, pair[0], pair[1]) : pair_position (numTimeseries, pair[1], pair[0]);
+}
+
+// Correlations of all pairs of the window ending at timestep s, in pair position order
+static void naive_correlations (const verify_data_t* d, uint64_t s, double* centered, double* sums_sq, double* all) {
+
+	uint64_t numTimeseries = d->numTimeseries;
+	uint64_t windowSize = d->windowSize;
+
+	for (uint64_t i=0; i<numTimeseries; i++) {
+
+		double* x = &centered[i*windowSize];
+		double mean = 0;
+
+		for (uint64_t t=0; t<windowSize; t++) {
+			x[t] = s+1+t >= windowSize ? d->series[i][s+1+t-windowSize] : 0;
+			mean += x[t];
+		}
+		mean /= windowSize;
+
+		sums_sq[i] = 0;
+		for (uint64_t t=0; t<windowSize; t++) {
+			x[t] -= mean;
+			sums_sq[i] += x[t]*x[t];
+		}
+	}
+
+	uint64_t p = 0;
+	for (uint64_t i=0; i<numTimeseries; i++)
+		for (uint64_t j=i+1; j<numTimeseries; j++) {
+			const double* x = &centered[i*windowSize];
+			const double* y = &centered[j*windowSize];
+			double sum_xy = 0;
+			for (uint64_t t=0; t<windowSize; t++)
+				sum_xy += x[t]*y[t];
+			all[p++] = sum_xy / sqrt (sums_sq[i]*sums_sq[j]);
+		}
+}
+
+// Full stable sort of numScores scores, first numTopScores positions written to top
+static void naive_top (const double* scores, uint64_t numScores, int numTopScores, verify_entry_t* entries, uint64_t* top) {
+
+	for (uint64_t p=0; p<numScores; p++) {
+		entries[p].score = scores[p];
+		entries[p].position = p;
+	}
+	qsort (entries, numScores, sizeof(verify_entry_t), entry_order);
+
+	for (int k=0; k<numTopScores; k++)
+		top[k] = entries[k].position;
+}
+
+static void reference_init (verify_reference_t* ref, const verify_data_t* d) {
+
+	uint64_t numTimeseries = d->numTimeseries;
+	uint64_t numPairs = (numTimeseries*(numTimeseries-1))/2;
+	int numTopScores = d->numTopScores;
+
+	// As many evenly spaced timesteps as the work allows, the first and the last one included
+	double work = numPairs*(d->windowSize + verify_numRanks*log2 (numPairs+1));
+	uint64_t maxSteps = verify_referenceWork/work > 2 ? (uint64_t)(verify_referenceWork/work) : 2;
+	uint64_t stride = maxSteps >= d->numTimesteps ? 1 : (d->numTimesteps + maxSteps-2) / (maxSteps-1);
+
+	// Timesteps end the strides, so that short strides meet the checkpoints of the batched variants;
+	// long ones would miss them, every other timestep moves forward to the next checkpoint of each interval
+	ref->steps = (uint64_t*) verify_malloc ((d->numTimesteps/stride + 2)*sizeof(uint64_t));
+	ref->steps[0] = 0;
+	ref->numSteps = 1;
+	for (uint64_t s=stride > 1 ? stride-1 : 1; s<d->numTimesteps; s+=stride) {
+
+		uint64_t t = s;
+		if (stride >= verify_checkpointLong)
+			t = ref->numSteps % 2 ? s + (verify_checkpointShort-1 - s%verify_checkpointShort) : s + (verify_checkpointLong-1 - s%verify_checkpointLong);
+		if (t < d->numTimesteps)
+			ref->steps[ref->numSteps++] = t;
+	}
+	if (ref->steps[ref->numSteps-1] != d->numTimesteps-1)
+		ref->steps[ref->numSteps++] = d->numTimesteps-1;
+
+	ref->correlations = (double*) verify_malloc (ref->numSteps*verify_numRanks*numTopScores*sizeof(double));
+	ref->indices = (uint32_t*) verify_malloc (2*ref->numSteps*verify_numRanks*numTopScores*sizeof(uint32_t));
+
+	double* centered = (double*) verify_malloc (numTimeseries*d->windowSize*sizeof(double));
+	double* sums_sq = (double*) verify_malloc (numTimeseries*sizeof(double));
+	double* all = (double*) verify_malloc (numPairs*sizeof(double));
+	double* scores = (double*) verify_malloc (numPairs*sizeof(double));
+	verify_entry_t* entries = (verify_entry_t*) verify_malloc (numPairs*sizeof(verify_entry_t));
+	uint64_t* top = (uint64_t*) verify_malloc (numTopScores*sizeof(uint64_t));
+	uint32_t* pair_i = (uint32_t*) verify_malloc (numPairs*sizeof(uint32_t));
+	uint32_t* pair_j = (uint32_t*) verify_malloc (numPairs*sizeof(uint32_t));
+
+	uint64_t p = 0;
+	for (uint64_t i=0; i<numTimeseries; i++)
+		for (uint64_t j=i+1; j<numTimeseries; j++, p++) {
+			pair_i[p] = i;
+			pair_j[p] = j;
+		}
+
+	for (uint64_t n=0; n<ref->numSteps; n++) {
+
+		naive_correlations (d, ref->steps[n], centered, sums_sq, all);
+
+		for (int r=0; r<verify_numRanks; r++) {
+
+			for (p=0; p<numPairs; p++)
+				scores[p] = rank_score (r, all[p]);
+			naive_top (scores, numPairs, numTopScores, entries, top);
+
+			double* correlations = &ref->correlations[(n*verify_numRanks + r)*numTopScores];
+			uint32_t* indices = &ref->indices[2*(n*verify_numRanks + r)*numTopScores];
+			for (int k=0; k<numTopScores; k++) {
+				correlations[k] = all[top[k]];
+				indices[2*k] = pair_j[top[k]];
+				indices[2*k+1] = pair_i[top[k]];
+			}
+		}
+	}
+
+	free (centered);
+	free (sums_sq);
+	free (all);
+	free (scores);
+	free (entries);
+	free (top);
+	free (pair_i);
+	free (pair_j);
+}
+
+static void reference_free (verify_reference_t* ref) {
+	free (ref->steps);
+	free (ref->correlations);
+	free (ref->indices);
+}
+
+
+static int same_pair (const uint32_t* a, const uint32_t* b) {
+	return (a[0] == b[0] && a[1] == b[1]) || (a[0] == b[1] && a[1] == b[0]);
+}
+
+static double score_error (double a, double b) {
+	if (isnan (a) || isnan (b))
+		return isnan (a) && isnan (b) ? 0 : INFINITY;
+	return fabs (a - b);
+}
+
+typedef struct {
+	double error;			/* Largest score difference */
+	double errorFirst;		/* Over the first tenth of the compared timesteps */
+	double errorLast;		/* Over the last tenth */
+	uint64_t numMismatches;		/* Pairs outside the reference top K (ties within the tolerance excepted), or ties out of order */
+	uint64_t numTies;		/* Adjacent pairs with bit-identical scores, checked for their order */
+	uint64_t numCompared;		/* Pairs compared */
+	uint64_t numChecked;		/* Timesteps compared */
+} verify_result_t;
+
+/*
+ * One step of numTopScores entries, best first, against the reference; scores are compared as the
+ * ranking scores them, so |r| ties of opposite signs may swap. With a zero tolerance the
+ * scores are exact and every rank has to hold the pair of the reference. Otherwise exact ties are
+ * checked by the pair positions, numTimeseries being the number of timeseries of the pairs.
+ */
+static void compare_step (verify_result_t* result, double* error, const double* corr, const uint32_t* idx, const double* corr_ref, const uint32_t* idx_ref,
+				int numTopScores, int rank, uint64_t numTimeseries, double tolerance) {
+
+	for (int k=0; k<numTopScores; k++) {
+
+		double e = score_error (rank_score (rank, corr[k]), rank_score (rank, corr_ref[k]));
+		if (e > *error)
+			*error = e;
+
+		if (tolerance == 0) {
+			if (!same_pair (&idx[2*k], &idx_ref[2*k]))
+				result->numMismatches++;
+			continue;
+		}
+
+		int found = 0;
+		for (int r=0; r<numTopScores && !found; r++)
+			found = same_pair (&idx[2*k], &idx_ref[2*r]);
+		if (!found && !(score_error (rank_score (rank, corr[k]), rank_score (rank, corr_ref[numTopScores-1])) <= tolerance))
+			result->numMismatches++;
+
+		if (k > 0 && rank_score (rank, corr[k]) == rank_score (rank, corr[k-1])) {
+			if (entry_position (numTimeseries, &idx[2*k-2]) > entry_position (numTimeseries, &idx[2*k]))
+				result->numMismatches++;
+			result->numTies++;
+		}
+	}
+
+	result->numCompared += numTopScores;
+}
+
+static void track_error (verify_result_t* result, double error, uint64_t n, uint64_t first, uint64_t numSteps) {
+
+	uint64_t tenth = (numSteps-first) >= 10 ? (numSteps-first)/10 : 1;
+
+	if (error > result->error)
+		result->error = error;
+	if (n < first+tenth && error > result->errorFirst)
+		result->errorFirst = error;
+	if (n >= numSteps-tenth && error > result->errorLast)
+		result->errorLast = error;
+}
+
+// Ranking slot of a variant run (numScores per timestep) against ranking rank of the reference, on the timesteps the variant computed
+static verify_result_t compare (const verify_data_t* d, const verify_reference_t* ref, int slot, int rank, const verify_t* variant, double tolerance) {
+
+	verify_result_t result = {0, 0, 0, 0, 0, 0, 0};
+	int numTopScores = d->numTopScores;
+	uint64_t first = variant->lastOnly ? ref->numSteps-1 : 0;
+
+	for (uint64_t n=first; n<ref->numSteps; n++) {
+
+		uint64_t s = ref->steps[n];
+		double error = 0;
+
+		if (variant->checkpointInterval > 1 && (s+1) % variant->checkpointInterval != 0 && s != d->numTimesteps-1)
+			continue;
+		result.numChecked++;
+
+		compare_step (&result, &error, &d->correlations[s*d->numScores + slot*numTopScores], &d->indices[2*(s*d->numScores + slot*numTopScores)],
+				&ref->correlations[(n*verify_numRanks + rank)*numTopScores], &ref->indices[2*(n*verify_numRanks + rank)*numTopScores],
+				numTopScores, rank, d->numTimeseries, tolerance);
+		track_error (&result, error, n, first, ref->numSteps);
+	}
+
+	return result;
+}
+
+static int report (FILE* out, int* first, const char* name, const char* rankings, const char* ranking, uint64_t numTimeseries, uint64_t windowSize,
+			uint64_t numTimesteps, double tolerance, const verify_result_t* r) {
+
+	int pass = r->error <= tolerance && r->numMismatches == 0;
+
+	fprintf(out, "%s    {\"verify\": \"%s\", \"rankings\": \"%s\", \"ranking\": \"%s\", \"N\": %lu, \"window\": %lu, \"steps\": %lu, \"checked_steps\": %lu, "
+			"\"tolerance\": %.3g, \"max_abs_error\": %.3e, \"error_first\": %.3e, \"error_last\": %.3e, \"drift\": %.3e, "
+			"\"mismatches\": %lu, \"ties\": %lu, \"compared\": %lu, \"pass\": %s}",
+		*first ? "" : ",\n", name, rankings, ranking, numTimeseries, windowSize, numTimesteps, r->numChecked, tolerance, r->error,
+		r->errorFirst, r->errorLast, r->errorLast - r->errorFirst, r->numMismatches, r->numTies, r->numCompared, pass ? "true" : "false");
+	*first = 0;
+
+	if (!pass)
+		fprintf(stderr, "FAILED: %s (%s of %s) N=%lu window=%lu steps=%lu: max error %.3e, %lu of %lu pairs differ\n",
+			name, ranking, rankings, numTimeseries, windowSize, numTimesteps, r->error, r->numMismatches, r->numCompared);
+
+	return !pass;
+}
+
+// The host merge of the DFE candidates against a full stable sort of them
+static int verify_merge (FILE* out, int* first, const correlation_random_t* model, uint64_t numTimeseries, uint64_t windowSize, uint64_t numTimesteps,
+				uint64_t loopLength, int numTopScores) {
+
+	uint64_t numCandidates = loopLength*120;
+
+	// The merge needs K candidates per step
+	if ((uint64_t)numTopScores > numCandidates)
+		return 0;
+
+	double* candidates = (double*) verify_malloc (numTimesteps*numCandidates*sizeof(double));
+	uint32_t* candidate_indices = (uint32_t*) verify_malloc (2*numTimesteps*numCandidates*sizeof(uint32_t));
+	double* correlations = (double*) verify_malloc (numTimesteps*numTopScores*sizeof(double));
+	uint32_t* indices = (uint32_t*) verify_malloc (2*numTimesteps*numTopScores*sizeof(uint32_t));
+	double* correlations_ref = (double*) verify_malloc (numTopScores*sizeof(double));
+	uint32_t* indices_ref = (uint32_t*) verify_malloc (2*numTopScores*sizeof(uint32_t));
+	verify_entry_t* entries = (verify_entry_t*) verify_malloc (numCandidates*sizeof(verify_entry_t));
+	uint64_t* top = (uint64_t*) verify_malloc (numTopScores*sizeof(uint64_t));
+
+	// Coarse scores, so that there are ties
+	correlation_random_t noise;
+	correlation_random_init (&noise, ~model->seed);
+	for (uint64_t s=0; s<numTimesteps; s++)
+		for (uint64_t c=0; c<numCandidates; c++) {
+			uint64_t n = s*numCandidates + c;
+			candidates[n] = floor (2000*correlation_random_value (&noise, 3*c, s)) / 1000 - 1;
+			candidate_indices[2*n] = correlation_random_value (&noise, 3*c+1, s) * numTimeseries;
+			candidate_indices[2*n+1] = correlation_random_value (&noise, 3*c+2, s) * numTimeseries;
+		}
+
+	correlation_merge_steps (candidates, candidate_indices, numTimesteps, numCandidates, numTopScores, correlations, indices);
+
+	// Same candidates, same ties: the result has to be exactly the same
+	verify_result_t result = {0, 0, 0, 0, 0, 0, numTimesteps};
+	for (uint64_t s=0; s<numTimesteps; s++) {
+
+		naive_top (&candidates[s*numCandidates], numCandidates, numTopScores, entries, top);
+		for (int k=0; k<numTopScores; k++) {
+			correlations_ref[k] = candidates[s*numCandidates + top[k]];
+			indices_ref[2*k] = candidate_indices[2*(s*numCandidates + top[k])];
+			indices_ref[2*k+1] = candidate_indices[2*(s*numCandidates + top[k])+1];
+			result.numTies += k > 0 && correlations_ref[k] == correlations_ref[k-1];
+		}
+
+		double error = 0;
+		compare_step (&result, &error, &correlations[s*numTopScores], &indices[2*s*numTopScores], correlations_ref, indices_ref,
+				numTopScores, 0, numTimeseries, 0);
+		track_error (&result, error, s, 0, numTimesteps);
+	}
+
+	int failed = report (out, first, "dfe_merge", "top", "top", numTimeseries, windowSize, numTimesteps, 0, &result);
+
+	free (candidates);
+	free (candidate_indices);
+	free (correlations);
+	free (indices);
+	free (correlations_ref);
+	free (indices_ref);
+	free (entries);
+	free (top);
+
+	return failed;
+}
+
+// Two copies of timeseries 0 and two negated copies of timeseries 1: bit-identical scores in every ranking
+static void plant_ties (verify_data_t* d) {
+
+	uint64_t numTimeseries = d->numTimeseries;
+
+	if (numTimeseries < 6)
+		return;
+
+	for (uint64_t s=0; s<d->numTimesteps; s++) {
+		d->series[numTimeseries-1][s] = d->series[0][s];
+		d->series[numTimeseries-2][s] = d->series[0][s];
+		d->series[numTimeseries-3][s] = -d->series[1][s];
+		d->series[numTimeseries-4][s] = -d->series[1][s];
+	}
+}
+
+int verify_point (FILE* out, int* first, const correlation_random_t* model, uint64_t numTimeseries, uint64_t windowSize, uint64_t numTimesteps,
+			uint64_t loopLength, int numTopScores, double tolerance, double tolerance_f32) {
+
+	verify_data_t d;
+	int numThreads = omp_get_max_threads();
+	int numFailed = 0;
+
+	d.numTimeseries = numTimeseries;
+	d.windowSize = windowSize;
+	d.numTimesteps = numTimesteps;
+	d.numTopScores = numTopScores;
+
+	d.series = (double**) verify_malloc (numTimeseries*sizeof(double*));
+	for (uint64_t i=0; i<numTimeseries; i++)
+		d.series[i] = (double*) verify_malloc (numTimesteps*sizeof(double));
+	correlation_random_series (model, d.series, numTimeseries, 0, numTimesteps);
+	plant_ties (&d);
+
+	d.rows = (double*) verify_malloc (numTimesteps*numTimeseries*sizeof(double));
+	for (uint64_t s=0; s<numTimesteps; s++)
+		for (uint64_t i=0; i<numTimeseries; i++)
+			d.rows[s*numTimeseries + i] = d.series[i][s];
+
+	d.correlations = (double*) verify_malloc (numTimesteps*verify_numRanks*numTopScores*sizeof(double));
+	d.indices = (uint32_t*) verify_malloc (2*numTimesteps*verify_numRanks*numTopScores*sizeof(uint32_t));
+
+	verify_reference_t ref;
+	reference_init (&ref, &d);
+
+	// The top ranking alone takes the single sided paths, all three of them the ranked ones
+	const unsigned runs[] = {CORRELATION_RANK_TOP, CORRELATION_RANK_TOP | CORRELATION_RANK_BOTTOM | CORRELATION_RANK_ABS};
+	const char* run_names[] = {"top", "top,bottom,abs"};
+
+	for (int run=0; run<2; run++) {
+
+		d.rankings = runs[run];
+		d.numScores = numTopScores*correlation_topk_num_ranks (d.rankings);
+
+		for (int v=0; v<verify_numVariants; v++) {
+			const verify_t* variant = &variants[v];
+
+			if (variant->topOnly && d.rankings != CORRELATION_RANK_TOP)
+				continue;
+
+			if (!variant->run (&d)) {
+				restore_defaults (numThreads);
+				continue;
+			}
+			restore_defaults (numThreads);
+
+			double tol = variant->f32 ? tolerance_f32 : tolerance;
+
+			// Rankings of the run come in the order of correlation_rank_t, as in the reference
+			int slot = 0;
+			for (int r=0; r<verify_numRanks; r++) {
+				if (!(d.rankings & (1u << r)))
+					continue;
+				verify_result_t result = compare (&d, &ref, slot++, r, variant, tol);
+				numFailed += report (out, first, variant->name, run_names[run], rank_names[r], numTimeseries, windowSize, numTimesteps,
+							tol, &result);
+			}
+
+			correlation_free_buffers();
+			correlation_data_flow_free_buffers();
+		}
+	}
+
+	numFailed += verify_merge (out, first, model, numTimeseries, windowSize, numTimesteps, loopLength, numTopScores);
+
+	reference_free (&ref);
+	for (uint64_t i=0; i<numTimeseries; i++)
+		free (d.series[i]);
+	free (d.series);
+	free (d.rows);
+	free (d.correlations);
+	free (d.indices);
+
+	return numFailed;
+}
@@ -0,0 +1,125 @@
+/**
+ * File: correlation_arena.c
+ * Purpose: reusable memory for the large buffers of a correlation run
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "correlation_arena.h"
+
+
+// Anonymous mapping aligned to a huge page, with every page touched
+static void* map_region (size_t* size) {
+
+	*size = (*size + correlation_arenaPageSize - 1) & ~(size_t)(correlation_arenaPageSize - 1);
+
+	size_t mapSize = *size + correlation_arenaPageSize;
+	char* map = (char*) mmap (NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map %zu bytes for the arena. Terminating!\n", *size);
+		fflush(stderr);
+		exit(-1);
+	}
+
+	// Trim to a huge page boundary on both sides
+	char* region = (char*) (((uintptr_t)map + correlation_arenaPageSize - 1) & ~(uintptr_t)(correlation_arenaPageSize - 1));
+	if (region > map)
+		munmap (map, region - map);
+	if (region + *size < map + mapSize)
+		munmap (region + *size, (map + mapSize) - (region + *size));
+
+#ifdef MADV_HUGEPAGE
+	madvise (region, *size, MADV_HUGEPAGE);
+#endif
+
+	size_t page = sysconf (_SC_PAGESIZE);
+	for (size_t offset=0; offset<*size; offset+=page)
+		region[offset] = 0;
+
+	return region;
+}
+
+void correlation_arena_init (correlation_arena_t* arena, size_t size) {
+
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+	arena->needed = 0;
+	arena->numSpills = 0;
+
+	if (size > 0) {
+		arena->base = (char*) map_region (&size);
+		arena->size = size;
+	}
+}
+
+void correlation_arena_reset (correlation_arena_t* arena) {
+
+	for (int s=0; s<arena->numSpills; s++)
+		munmap (arena->spills[s], arena->spillSizes[s]);
+
+	// The last run did not fit: grow to what it needed, so that the next one does
+	if (arena->numSpills > 0) {
+		size_t size = arena->needed;
+		if (arena->base)
+			munmap (arena->base, arena->size);
+		arena->base = (char*) map_region (&size);
+		arena->size = size;
+	}
+
+	arena->numSpills = 0;
+	arena->used = 0;
+	arena->needed = 0;
+}
+
+void correlation_arena_free (correlation_arena_t* arena) {
+
+	// Unmap directly: growing here would map a region only to drop it
+	for (int s=0; s<arena->numSpills; s++)
+		munmap (arena->spills[s], arena->spillSizes[s]);
+
+	if (arena->base)
+		munmap (arena->base, arena->size);
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+	arena->needed = 0;
+	arena->numSpills = 0;
+}
+
+void* correlation_arena_alloc (correlation_arena_t* arena, size_t size, size_t alignment) {
+
+	if (alignment < correlation_arenaAlignment)
+		alignment = correlation_arenaAlignment;
+
+	size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+
+	// Where the slice would be in a region holding the whole run
+	arena->needed = ((arena->needed + alignment - 1) & ~(alignment - 1)) + size;
+
+	if (arena->base && offset + size <= arena->size) {
+		arena->used = offset + size;
+		return arena->base + offset;
+	}
+
+	// Out of room for this run; the next reset grows the region
+	if (arena->numSpills == correlation_arenaMaxSpills) {
+		fprintf(stderr, "Too many buffers for the arena. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	size_t spillSize = size;
+	void* spill = map_region (&spillSize);
+	arena->spills[arena->numSpills] = spill;
+	arena->spillSizes[arena->numSpills] = spillSize;
+	arena->numSpills++;
+
+	return spill;
+}
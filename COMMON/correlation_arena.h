@@ -0,0 +1,64 @@
+/**
+ * File: correlation_arena.h
+ * Purpose: reusable memory for the large buffers of a correlation run
+ *
+ * An arena hands out aligned slices of one large region. Every run starts with
+ * correlation_arena_reset and then slices the buffers it needs for its numTimeseries and
+ * numTimesteps, so repeated runs allocate nothing and touch no new pages. A run that needs more
+ * than the region gets extra regions for its slices; the next reset replaces everything by one
+ * region of the combined size.
+ *
+ * Regions are aligned to 2 MB and advised for transparent huge pages, and all their pages are
+ * touched when they are mapped, so page faults are paid once, when the arena grows, not in every
+ * run. Slices are not zeroed.
+ *
+ */
+
+#ifndef CORRELATION_ARENA_H
+#define CORRELATION_ARENA_H
+
+#include <stddef.h>
+
+#define correlation_arenaPageSize (2*1024*1024)
+
+// Alignment of every slice, a cache line; larger alignments can be asked for
+#define correlation_arenaAlignment (64)
+
+// Extra regions one run may spill into before the arena grows
+#define correlation_arenaMaxSpills (64)
+
+typedef struct {
+	char* base;				/* Region slices are taken from */
+	size_t size;				/* Size of the region */
+	size_t used;				/* Bytes sliced since the last reset */
+	size_t needed;				/* Bytes asked for since the last reset, spills included */
+	void* spills[correlation_arenaMaxSpills];	/* Extra regions of this run */
+	size_t spillSizes[correlation_arenaMaxSpills];	/* Their sizes */
+	int numSpills;				/* Number of extra regions */
+} correlation_arena_t;
+
+
+/* Map an arena of at least size bytes, 0 for an empty one that grows with the first run */
+void correlation_arena_init (
+	correlation_arena_t* arena,	/* Arena */
+	size_t size			/* Initial size in bytes */
+);
+
+/* Start a new run: all slices handed out before are given back */
+void correlation_arena_reset (
+	correlation_arena_t* arena	/* Arena */
+);
+
+/* Unmap all memory of the arena */
+void correlation_arena_free (
+	correlation_arena_t* arena	/* Arena */
+);
+
+/* Slice of size bytes, aligned to correlation_arenaAlignment or to alignment if larger */
+void* correlation_arena_alloc (
+	correlation_arena_t* arena,	/* Arena */
+	size_t size,			/* Size in bytes */
+	size_t alignment		/* Alignment in bytes, a power of 2, or 0 */
+);
+
+#endif /* CORRELATION_ARENA_H */
@@ -0,0 +1,113 @@
+/**
+ * File: correlation_blocks.c
+ * Purpose: block decomposition of the correlation triangle into passes of bounded size
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "correlation_blocks.h"
+
+
+void correlation_blocks_init (correlation_blocks_t* blocks, uint64_t numTimeseries, uint64_t maxPassSize) {
+
+	if (maxPassSize < 2) {
+		fprintf(stderr, "A correlation pass must hold at least 2 Time series. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	blocks->numTimeseries = numTimeseries;
+
+	// Everything fits in one pass
+	if (numTimeseries <= maxPassSize) {
+		blocks->numBlocks = 1;
+		blocks->blockSize = numTimeseries;
+		blocks->numPasses = 1;
+		return;
+	}
+
+	// Fewest blocks of at most maxPassSize/2, evened out; there are at least 3 of them
+	uint64_t maxBlockSize = maxPassSize/2;
+	blocks->numBlocks = (numTimeseries + maxBlockSize - 1)/maxBlockSize;
+	blocks->blockSize = (numTimeseries + blocks->numBlocks - 1)/blocks->numBlocks;
+	blocks->numBlocks = (numTimeseries + blocks->blockSize - 1)/blocks->blockSize;
+	blocks->numPasses = (blocks->numBlocks*(blocks->numBlocks-1))/2;
+}
+
+// Pass p correlates blocks a<b, in the order (0,1), (0,2), ..., (0,B-1), (1,2), ...
+static void pass_blocks (const correlation_blocks_t* blocks, uint64_t p, uint64_t* a, uint64_t* b) {
+
+	uint64_t first = 0;
+
+	*a = 0;
+	while (p >= first + blocks->numBlocks-1-*a) {
+		first += blocks->numBlocks-1-*a;
+		(*a)++;
+	}
+	*b = *a + 1 + (p - first);
+}
+
+static uint64_t block_series (const correlation_blocks_t* blocks, uint64_t block, uint32_t* series) {
+
+	uint64_t first = block*blocks->blockSize;
+	uint64_t last = first+blocks->blockSize < blocks->numTimeseries ? first+blocks->blockSize : blocks->numTimeseries;
+
+	for (uint64_t i=first; i<last; i++)
+		series[i-first] = i;
+
+	return last-first;
+}
+
+uint64_t correlation_blocks_pass (const correlation_blocks_t* blocks, uint64_t p, uint32_t* series) {
+
+	if (blocks->numPasses == 1)
+		return block_series (blocks, 0, series);
+
+	uint64_t a, b;
+	pass_blocks (blocks, p, &a, &b);
+
+	uint64_t n = block_series (blocks, a, series);
+	return n + block_series (blocks, b, &series[n]);
+}
+
+void correlation_blocks_push (const correlation_blocks_t* blocks, uint64_t p, const uint32_t* series, uint64_t numSeries,
+				const double* correlations, const uint32_t* indices, uint64_t numCorrelations, correlation_topk_t* topk) {
+
+	uint64_t N = blocks->numTimeseries;
+	uint64_t a = 0, b = 0;
+
+	if (blocks->numPasses > 1)
+		pass_blocks (blocks, p, &a, &b);
+
+	// Pairs inside block a belong to pass (a,a+1); inside block b only if b is the last block and a the one before
+	int own_a = blocks->numPasses == 1 || b == a+1;
+	int own_b = blocks->numPasses == 1 || (b == blocks->numBlocks-1 && a == b-1);
+
+	for (uint64_t k=0; k<numCorrelations; k++) {
+
+		// Padding candidates of unused pipes point outside the pass
+		if (indices[2*k] >= numSeries || indices[2*k+1] >= numSeries)
+			continue;
+
+		uint64_t i = series[indices[2*k+1]];
+		uint64_t j = series[indices[2*k]];
+
+		if (i > j) {
+			uint64_t t = i;
+			i = j;
+			j = t;
+		}
+
+		uint64_t block_i = i/blocks->blockSize;
+		uint64_t block_j = j/blocks->blockSize;
+
+		if (block_i == block_j && !(block_i == a ? own_a : own_b))
+			continue;
+
+		// Position in the global triangle breaks ties as a single pass would
+		correlation_topk_push (topk, correlations[k], i*N - (i*(i+1))/2 + (j-i-1), j, i);
+	}
+}
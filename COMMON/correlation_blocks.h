@@ -0,0 +1,58 @@
+/**
+ * File: correlation_blocks.h
+ * Purpose: block decomposition of the correlation triangle into passes of bounded size
+ *
+ * A correlation pass (one DFE run, or one CPU engine) correlates every pair of the timeseries it is
+ * given, up to maxPassSize of them. Larger sets are cut into numBlocks blocks of at most maxPassSize/2
+ * timeseries, and pass p correlates the union of one pair of blocks (a,b), a<b. Together the passes
+ * cover every pair of the triangle: pairs across blocks a and b belong to pass (a,b) only, pairs
+ * inside block a are recomputed by every pass that contains a and belong to the first of them.
+ *
+ * Candidates of a pass are merged into the global top correlations with correlation_blocks_push, which
+ * maps pass-local indices to global ones and drops pairs that belong to another pass. The top K of the
+ * merge are exact as long as every pass returns its own top K.
+ *
+ */
+
+#ifndef CORRELATION_BLOCKS_H
+#define CORRELATION_BLOCKS_H
+
+#include <stdint.h>
+
+#include "correlation_topk.h"
+
+typedef struct {
+	uint64_t numTimeseries;		/* Number of Timeseries */
+	uint64_t numBlocks;		/* Number of blocks */
+	uint64_t blockSize;		/* Timeseries per block; the last block may be smaller */
+	uint64_t numPasses;		/* Number of passes */
+} correlation_blocks_t;
+
+
+/* Plan the passes for numTimeseries timeseries, at most maxPassSize per pass */
+void correlation_blocks_init (
+	correlation_blocks_t* blocks,	/* Block decomposition */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	uint64_t maxPassSize		/* Maximum number of Timeseries per pass (minimum of 2) */
+);
+
+/* Global indices of the timeseries of pass p, ascending. Returns their number. */
+uint64_t correlation_blocks_pass (
+	const correlation_blocks_t* blocks,	/* Block decomposition */
+	uint64_t p,				/* Pass, 0 to numPasses-1 */
+	uint32_t* series			/* Output, at most 2*blockSize indices */
+);
+
+/* Offer the candidates of pass p, in pass-local indices, to the global top correlations */
+void correlation_blocks_push (
+	const correlation_blocks_t* blocks,	/* Block decomposition */
+	uint64_t p,				/* Pass the candidates come from */
+	const uint32_t* series,			/* Timeseries of pass p, from correlation_blocks_pass */
+	uint64_t numSeries,			/* Number of Timeseries of pass p */
+	const double* correlations,		/* Candidate correlations */
+	const uint32_t* indices,		/* Candidate pairs of pass-local indices (2 per candidate) */
+	uint64_t numCorrelations,		/* Number of candidates */
+	correlation_topk_t* topk		/* Global top correlations */
+);
+
+#endif /* CORRELATION_BLOCKS_H */
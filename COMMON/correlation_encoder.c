@@ -0,0 +1,385 @@
+/**
+ * File: correlation_encoder.c
+ * Purpose: incremental encoder of the DFE input streams, one timestep at a time
+ *
+ * A block of timesteps is encoded by all threads at once, every thread owning a slice of the
+ * timeseries for the whole block. Within a slice, timeseries are encoded a vector at a time and
+ * the streams are written with non-temporal stores, as they are only read again by the DFE. The two
+ * streams need not be aligned alike: a short scalar head aligns one of them to a cache line, and a
+ * stream that is still unaligned after it is written with ordinary unaligned vector stores.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "correlation_encoder.h"
+#include "correlation_kernel.h"
+
+
+void correlation_encoder_init (correlation_encoder_t* encoder, uint64_t numTimeseries, uint64_t windowSize) {
+
+	encoder->numTimeseries = numTimeseries;
+	encoder->windowSize = windowSize;
+	encoder->sums = (double*) calloc (numTimeseries, sizeof(double));
+	encoder->sums_sq = (double*) calloc (numTimeseries, sizeof(double));
+	encoder->rows = NULL;
+	encoder->rowsSteps = 0;
+	encoder->block = NULL;
+	encoder->blockSteps = 0;
+
+	correlation_window_init (&encoder->window, numTimeseries, windowSize);
+
+	// Pick the instruction set before any thread needs it
+	correlation_kernel_get_isa();
+}
+
+void correlation_encoder_reset (correlation_encoder_t* encoder) {
+
+	memset (encoder->sums, 0, encoder->numTimeseries*sizeof(double));
+	memset (encoder->sums_sq, 0, encoder->numTimeseries*sizeof(double));
+
+	correlation_window_reset (&encoder->window);
+}
+
+void correlation_encoder_free (correlation_encoder_t* encoder) {
+
+	free (encoder->sums);
+	free (encoder->sums_sq);
+	free (encoder->rows);
+	free (encoder->block);
+
+	correlation_window_free (&encoder->window);
+}
+
+
+// Timeseries [j0, j1) of numSteps timesteps, cross-sections new_rows[t] and old_rows[t]
+typedef struct {
+	uint64_t numTimeseries;
+	double windowSize;
+	const double* const* new_rows;
+	const double* const* old_rows;
+	uint64_t numSteps;
+	double* sums;
+	double* sums_sq;
+	double* precalculations;
+	double* data_pairs;
+} encoder_block_t;
+
+typedef void (*encode_slice_t) (const encoder_block_t* block, uint64_t j0, uint64_t j1);
+
+
+static void encode_slice_scalar (const encoder_block_t* block, uint64_t j0, uint64_t j1) {
+
+	for (uint64_t t=0; t<block->numSteps; t++) {
+
+		const double* new_values = block->new_rows[t];
+		const double* old_values = block->old_rows[t];
+		double* precalculations = &block->precalculations[2*t*block->numTimeseries];
+		double* data_pairs = &block->data_pairs[2*t*block->numTimeseries];
+
+		for (uint64_t j=j0; j<j1; j++) {
+
+			double old = old_values[j];
+			double new = new_values[j];
+
+			block->sums[j] += new - old;
+			block->sums_sq[j] += new*new - old*old;
+
+			//Precalculations REORDERED in DFE ORDER
+			precalculations [2*j] = block->sums[j];
+			precalculations [2*j + 1] = 1/sqrt(block->windowSize*block->sums_sq[j] - block->sums[j]*block->sums[j]);
+
+			//Data pairs REORDERED in DFE ORDER
+			data_pairs[2*j] = new;
+			data_pairs[2*j + 1] = old;
+		}
+	}
+}
+
+#ifdef __x86_64__
+
+// The pairs of timeseries j start on a cache line of the stream
+static inline int encode_aligned (const double* stream, uint64_t j) {
+	return (uintptr_t)&stream[2*j] % 64 == 0;
+}
+
+// First timeseries from j0 on whose pairs start on a cache line of either stream, preferring
+// precalculations; j0 if neither stream can be aligned. The vector loop starts there, storing the
+// aligned streams non-temporally and the others with unaligned stores.
+static inline uint64_t encode_head (const double* precalculations, const double* data_pairs, uint64_t j0, uint64_t j1) {
+
+	for (int k=0; k<2; k++) {
+		const double* stream = k == 0 ? precalculations : data_pairs;
+		for (uint64_t j=j0; j<j1 && j<j0+4; j++)
+			if (encode_aligned (stream, j))
+				return j;
+	}
+	return j0;
+}
+
+// SQRT_INVERSE is 1/sqrt and nothing is fused, as in the scalar encoder, so the streams are identical
+__attribute__((target("avx2")))
+static void encode_slice_avx2 (const encoder_block_t* block, uint64_t j0, uint64_t j1) {
+
+	__m256d windowSize = _mm256_set1_pd(block->windowSize);
+	__m256d one = _mm256_set1_pd(1.0);
+
+	for (uint64_t t=0; t<block->numSteps; t++) {
+
+		const double* new_values = block->new_rows[t];
+		const double* old_values = block->old_rows[t];
+		double* precalculations = &block->precalculations[2*t*block->numTimeseries];
+		double* data_pairs = &block->data_pairs[2*t*block->numTimeseries];
+		double* sums = block->sums;
+		double* sums_sq = block->sums_sq;
+		uint64_t j = j0;
+
+		// Scalar head up to the first timeseries whose pairs start on a cache line
+		uint64_t head = encode_head (precalculations, data_pairs, j0, j1);
+		int stream_precalculations = encode_aligned (precalculations, head);
+		int stream_data_pairs = encode_aligned (data_pairs, head);
+
+		encoder_block_t scalar = *block;
+		scalar.numSteps = 1;
+		scalar.new_rows = &block->new_rows[t];
+		scalar.old_rows = &block->old_rows[t];
+		scalar.precalculations = precalculations;
+		scalar.data_pairs = data_pairs;
+		encode_slice_scalar (&scalar, j, head);
+		j = head;
+
+		for (; j+4<=j1; j+=4) {
+
+			__m256d new = _mm256_loadu_pd(&new_values[j]);
+			__m256d old = _mm256_loadu_pd(&old_values[j]);
+			__m256d sum = _mm256_add_pd(_mm256_loadu_pd(&sums[j]), _mm256_sub_pd(new, old));
+			__m256d sum_sq = _mm256_add_pd(_mm256_loadu_pd(&sums_sq[j]), _mm256_sub_pd(_mm256_mul_pd(new, new), _mm256_mul_pd(old, old)));
+			_mm256_storeu_pd(&sums[j], sum);
+			_mm256_storeu_pd(&sums_sq[j], sum_sq);
+
+			__m256d variance = _mm256_sub_pd(_mm256_mul_pd(windowSize, sum_sq), _mm256_mul_pd(sum, sum));
+			__m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(variance));
+
+			// {a0,b0,a1,b1} and {a2,b2,a3,b3}
+			__m256d lo = _mm256_unpacklo_pd(sum, inv);
+			__m256d hi = _mm256_unpackhi_pd(sum, inv);
+			if (stream_precalculations) {
+				_mm256_stream_pd(&precalculations[2*j], _mm256_permute2f128_pd(lo, hi, 0x20));
+				_mm256_stream_pd(&precalculations[2*j+4], _mm256_permute2f128_pd(lo, hi, 0x31));
+			}
+			else {
+				_mm256_storeu_pd(&precalculations[2*j], _mm256_permute2f128_pd(lo, hi, 0x20));
+				_mm256_storeu_pd(&precalculations[2*j+4], _mm256_permute2f128_pd(lo, hi, 0x31));
+			}
+
+			lo = _mm256_unpacklo_pd(new, old);
+			hi = _mm256_unpackhi_pd(new, old);
+			if (stream_data_pairs) {
+				_mm256_stream_pd(&data_pairs[2*j], _mm256_permute2f128_pd(lo, hi, 0x20));
+				_mm256_stream_pd(&data_pairs[2*j+4], _mm256_permute2f128_pd(lo, hi, 0x31));
+			}
+			else {
+				_mm256_storeu_pd(&data_pairs[2*j], _mm256_permute2f128_pd(lo, hi, 0x20));
+				_mm256_storeu_pd(&data_pairs[2*j+4], _mm256_permute2f128_pd(lo, hi, 0x31));
+			}
+		}
+
+		encode_slice_scalar (&scalar, j, j1);
+	}
+
+	_mm_sfence();
+}
+
+/*
+ * SQRT_INVERSE from the 14 bit estimate of vrsqrt14pd and two Newton steps, y = y*(1.5 - 0.5*v*y*y),
+ * which brings it to within an ulp or so of 1/sqrt. A zero variance keeps the estimate, infinity.
+ * Sums are not fused, so SUM(x) and the data pairs are still identical to the scalar encoder.
+ */
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void encode_slice_avx512 (const encoder_block_t* block, uint64_t j0, uint64_t j1) {
+
+	__m512d windowSize = _mm512_set1_pd(block->windowSize);
+	__m512d half = _mm512_set1_pd(0.5);
+	__m512d three_halves = _mm512_set1_pd(1.5);
+	__m512i pairs_lo = _mm512_set_epi64(11, 3, 10, 2, 9, 1, 8, 0);
+	__m512i pairs_hi = _mm512_set_epi64(15, 7, 14, 6, 13, 5, 12, 4);
+
+	for (uint64_t t=0; t<block->numSteps; t++) {
+
+		const double* new_values = block->new_rows[t];
+		const double* old_values = block->old_rows[t];
+		double* precalculations = &block->precalculations[2*t*block->numTimeseries];
+		double* data_pairs = &block->data_pairs[2*t*block->numTimeseries];
+		double* sums = block->sums;
+		double* sums_sq = block->sums_sq;
+		uint64_t j = j0;
+
+		uint64_t head = encode_head (precalculations, data_pairs, j0, j1);
+		int stream_precalculations = encode_aligned (precalculations, head);
+		int stream_data_pairs = encode_aligned (data_pairs, head);
+
+		encoder_block_t scalar = *block;
+		scalar.numSteps = 1;
+		scalar.new_rows = &block->new_rows[t];
+		scalar.old_rows = &block->old_rows[t];
+		scalar.precalculations = precalculations;
+		scalar.data_pairs = data_pairs;
+		encode_slice_scalar (&scalar, j, head);
+		j = head;
+
+		for (; j+8<=j1; j+=8) {
+
+			__m512d new = _mm512_loadu_pd(&new_values[j]);
+			__m512d old = _mm512_loadu_pd(&old_values[j]);
+			__m512d sum = _mm512_add_pd(_mm512_loadu_pd(&sums[j]), _mm512_sub_pd(new, old));
+			__m512d sum_sq = _mm512_add_pd(_mm512_loadu_pd(&sums_sq[j]), _mm512_sub_pd(_mm512_mul_pd(new, new), _mm512_mul_pd(old, old)));
+			_mm512_storeu_pd(&sums[j], sum);
+			_mm512_storeu_pd(&sums_sq[j], sum_sq);
+
+			__m512d variance = _mm512_sub_pd(_mm512_mul_pd(windowSize, sum_sq), _mm512_mul_pd(sum, sum));
+			__m512d half_variance = _mm512_mul_pd(half, variance);
+			__m512d estimate = _mm512_rsqrt14_pd(variance);
+			__m512d inv = estimate;
+			inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(_mm512_mul_pd(half_variance, inv), inv, three_halves));
+			inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(_mm512_mul_pd(half_variance, inv), inv, three_halves));
+			inv = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(variance, _mm512_setzero_pd(), _CMP_EQ_OQ), inv, estimate);
+
+			if (stream_precalculations) {
+				_mm512_stream_pd(&precalculations[2*j], _mm512_permutex2var_pd(sum, pairs_lo, inv));
+				_mm512_stream_pd(&precalculations[2*j+8], _mm512_permutex2var_pd(sum, pairs_hi, inv));
+			}
+			else {
+				_mm512_storeu_pd(&precalculations[2*j], _mm512_permutex2var_pd(sum, pairs_lo, inv));
+				_mm512_storeu_pd(&precalculations[2*j+8], _mm512_permutex2var_pd(sum, pairs_hi, inv));
+			}
+
+			if (stream_data_pairs) {
+				_mm512_stream_pd(&data_pairs[2*j], _mm512_permutex2var_pd(new, pairs_lo, old));
+				_mm512_stream_pd(&data_pairs[2*j+8], _mm512_permutex2var_pd(new, pairs_hi, old));
+			}
+			else {
+				_mm512_storeu_pd(&data_pairs[2*j], _mm512_permutex2var_pd(new, pairs_lo, old));
+				_mm512_storeu_pd(&data_pairs[2*j+8], _mm512_permutex2var_pd(new, pairs_hi, old));
+			}
+		}
+
+		encode_slice_scalar (&scalar, j, j1);
+	}
+
+	_mm_sfence();
+}
+
+#endif /* __x86_64__ */
+
+static encode_slice_t encode_slice (correlation_isa_t isa) {
+	switch (isa) {
+#ifdef __x86_64__
+		case CORRELATION_ISA_AVX2:	return encode_slice_avx2;
+		case CORRELATION_ISA_AVX512:	return encode_slice_avx512;
+#endif
+		default:			return encode_slice_scalar;
+	}
+}
+
+// Encode the block, every thread taking a slice of whole vectors of timeseries
+static void encode (correlation_encoder_t* encoder, const double* const* new_rows, const double* const* old_rows, uint64_t numSteps,
+			double* precalculations, double* data_pairs) {
+
+	uint64_t numTimeseries = encoder->numTimeseries;
+	encoder_block_t block = {numTimeseries, (double)encoder->windowSize, new_rows, old_rows, numSteps,
+					encoder->sums, encoder->sums_sq, precalculations, data_pairs};
+	encode_slice_t slice = encode_slice (correlation_kernel_get_isa());
+
+	#pragma omp parallel if (numSteps*numTimeseries >= correlation_encoderParallelWork)
+	{
+		int thread = 0;
+		int numThreads = 1;
+#ifdef _OPENMP
+		thread = omp_get_thread_num();
+		numThreads = omp_get_num_threads();
+#endif
+		uint64_t perThread = (((numTimeseries + numThreads - 1)/numThreads) + 7) & ~(uint64_t)7;
+		uint64_t j0 = thread*perThread < numTimeseries ? thread*perThread : numTimeseries;
+		uint64_t j1 = j0+perThread < numTimeseries ? j0+perThread : numTimeseries;
+
+		if (j0 < j1)
+			slice (&block, j0, j1);
+	}
+}
+
+void correlation_encoder_push (correlation_encoder_t* encoder, const double* values, double* precalculations, double* data_pairs) {
+	correlation_encoder_push_block (encoder, values, 1, precalculations, data_pairs);
+}
+
+void correlation_encoder_push_series (correlation_encoder_t* encoder, double** data, uint64_t s, double* precalculations, double* data_pairs) {
+	correlation_encoder_push_series_block (encoder, data, s, 1, precalculations, data_pairs);
+}
+
+void correlation_encoder_push_block (correlation_encoder_t* encoder, const double* values, uint64_t numSteps, double* precalculations, double* data_pairs) {
+
+	uint64_t numTimeseries = encoder->numTimeseries;
+	int64_t windowSize = encoder->windowSize;
+	int64_t s0 = (int64_t)encoder->window.numSteps;
+
+	if (encoder->rowsSteps < numSteps) {
+		free (encoder->rows);
+		encoder->rows = (const double**) malloc (2*numSteps*sizeof(const double*));
+		encoder->rowsSteps = numSteps;
+	}
+
+	const double** new_rows = encoder->rows;
+	const double** old_rows = &encoder->rows[numSteps];
+
+	// x[s-n] is in the block itself or, for its first windowSize timesteps, still in the window
+	for (uint64_t t=0; t<numSteps; t++) {
+		new_rows[t] = &values[t*numTimeseries];
+		old_rows[t] = (int64_t)t >= windowSize ? &values[(t-windowSize)*numTimeseries] : correlation_window_at (&encoder->window, s0 + (int64_t)t - windowSize);
+	}
+
+	encode (encoder, new_rows, old_rows, numSteps, precalculations, data_pairs);
+
+	// Only the last windowSize+1 cross-sections are kept; the ones before are counted, not copied
+	uint64_t first = numSteps > (uint64_t)windowSize+1 ? numSteps-windowSize-1 : 0;
+	encoder->window.numSteps += first;
+	for (uint64_t t=first; t<numSteps; t++)
+		correlation_window_push (&encoder->window, new_rows[t]);
+}
+
+void correlation_encoder_push_series_block (correlation_encoder_t* encoder, double** data, uint64_t s, uint64_t numSteps, double* precalculations, double* data_pairs) {
+
+	uint64_t numTimeseries = encoder->numTimeseries;
+	uint64_t blockSteps = numSteps < correlation_encoderBlockSteps ? numSteps : correlation_encoderBlockSteps;
+
+	if (encoder->blockSteps < blockSteps) {
+		free (encoder->block);
+		encoder->block = (double*) malloc (blockSteps*numTimeseries*sizeof(double));
+		encoder->blockSteps = blockSteps;
+	}
+
+	double* block = encoder->block;
+
+	for (uint64_t first=0; first<numSteps; first+=blockSteps) {
+
+		uint64_t numBlockSteps = first+blockSteps < numSteps ? blockSteps : numSteps-first;
+
+		// Gather time-major, one timeseries at a time so that every row is read in order
+		#pragma omp parallel for schedule(static) if (numBlockSteps*numTimeseries >= correlation_encoderParallelWork)
+		for (uint64_t i=0; i<numTimeseries; i++)
+			for (uint64_t t=0; t<numBlockSteps; t++)
+				block[t*numTimeseries + i] = data[i][s+first+t];
+
+		correlation_encoder_push_block (encoder, block, numBlockSteps, &precalculations[2*first*numTimeseries], &data_pairs[2*first*numTimeseries]);
+	}
+}
@@ -0,0 +1,105 @@
+/**
+ * File: correlation_encoder.h
+ * Purpose: incremental encoder of the DFE input streams, one timestep at a time
+ *
+ * The encoder keeps SUM(x) and SUM(x^2) of every timeseries and the window of the last windowSize+1
+ * cross-sections, so successive calls continue where the previous one stopped. Timestep s is written
+ * in DFE order:
+ *	precalculations	- {SUM(x), SQRT_INVERSE(x)} for every timeseries
+ *	data_pairs	- {x[s], x[s-n]} for every timeseries; x[s-n]=0 while s<n
+ *
+ * Memory is O(numTimeseries*windowSize) whatever the number of timesteps, and a run can be cut into
+ * chunks of timesteps that are encoded (and streamed to the DFE) one after another. prepare_data_for_dfe
+ * and correlation_control_flow encode the whole history with it in one pass.
+ *
+ * A block of timesteps pushed at once is encoded by all threads, each taking a slice of the
+ * timeseries, with vector instructions and non-temporal stores. SQRT_INVERSE is exact except on
+ * AVX-512, where it comes from a reciprocal square root estimate refined by Newton steps and may
+ * differ from 1/sqrt in the last bit.
+ *
+ */
+
+#ifndef CORRELATION_ENCODER_H
+#define CORRELATION_ENCODER_H
+
+#include <stdint.h>
+
+#include "correlation_window.h"
+
+// Smallest block (timesteps x timeseries) encoded by more than one thread
+#ifndef correlation_encoderParallelWork
+#define correlation_encoderParallelWork (1<<15)
+#endif
+
+// Timesteps gathered at a time from one row per timeseries
+#ifndef correlation_encoderBlockSteps
+#define correlation_encoderBlockSteps (256)
+#endif
+
+typedef struct {
+	uint64_t numTimeseries;		/* Number of Timeseries */
+	uint64_t windowSize;		/* Window for correlation */
+	double* sums;			/* SUM(x) of every Timeseries */
+	double* sums_sq;		/* SUM(x^2) of every Timeseries */
+	correlation_window_t window;	/* Last windowSize+1 cross-sections */
+	const double** rows;		/* x[s] and x[s-n] of the timesteps of a block */
+	uint64_t rowsSteps;		/* Timesteps rows has room for */
+	double* block;			/* Time-major copy of up to correlation_encoderBlockSteps timesteps */
+	uint64_t blockSteps;		/* Timesteps block has room for */
+} correlation_encoder_t;
+
+
+/* Allocate an encoder positioned before the first timestep */
+void correlation_encoder_init (
+	correlation_encoder_t* encoder,	/* Encoder */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	uint64_t windowSize		/* Window for correlation */
+);
+
+/* Go back before the first timestep */
+void correlation_encoder_reset (
+	correlation_encoder_t* encoder	/* Encoder */
+);
+
+/* Release memory held by the encoder */
+void correlation_encoder_free (
+	correlation_encoder_t* encoder	/* Encoder */
+);
+
+/* Encode the next timestep from a contiguous cross-section */
+void correlation_encoder_push (
+	correlation_encoder_t* encoder,	/* Encoder */
+	const double* values,		/* x[s] of every Timeseries */
+	double* precalculations,	/* Output, 2*numTimeseries values of timestep s */
+	double* data_pairs		/* Output, 2*numTimeseries values of timestep s */
+);
+
+/* Encode the next timestep, gathered from one row per timeseries */
+void correlation_encoder_push_series (
+	correlation_encoder_t* encoder,	/* Encoder */
+	double** data,			/* Array of Timeseries */
+	uint64_t s,			/* Timestep to encode, must be the next one */
+	double* precalculations,	/* Output, 2*numTimeseries values of timestep s */
+	double* data_pairs		/* Output, 2*numTimeseries values of timestep s */
+);
+
+/* Encode the next numSteps timesteps from contiguous cross-sections */
+void correlation_encoder_push_block (
+	correlation_encoder_t* encoder,	/* Encoder */
+	const double* values,		/* x[s+t] of every Timeseries at values[t*numTimeseries] */
+	uint64_t numSteps,		/* Number of timesteps */
+	double* precalculations,	/* Output, 2*numTimeseries values per timestep */
+	double* data_pairs		/* Output, 2*numTimeseries values per timestep */
+);
+
+/* Encode the next numSteps timesteps, gathered from one row per timeseries */
+void correlation_encoder_push_series_block (
+	correlation_encoder_t* encoder,	/* Encoder */
+	double** data,			/* Array of Timeseries */
+	uint64_t s,			/* First timestep to encode, must be the next one */
+	uint64_t numSteps,		/* Number of timesteps */
+	double* precalculations,	/* Output, 2*numTimeseries values per timestep */
+	double* data_pairs		/* Output, 2*numTimeseries values per timestep */
+);
+
+#endif /* CORRELATION_ENCODER_H */
@@ -0,0 +1,288 @@
+/**
+ * File: correlation_engine.c
+ * Purpose: multi-threaded CPU correlation engine
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "correlation_engine.h"
+
+
+// Cut the triangle into tiles and deal them out so that every thread gets numCorrelations/numThreads pairs
+static void partition (correlation_engine_t* engine) {
+
+	uint64_t numTimeseries = engine->numTimeseries;
+	uint64_t numCorrelations = (numTimeseries*(numTimeseries-1))/2;
+	int numThreads = engine->numThreads;
+
+	uint64_t numRowBlocks = (numTimeseries + correlation_tileRows - 1)/correlation_tileRows;
+	uint64_t numColumnBlocks = (numTimeseries + correlation_tileColumns - 1)/correlation_tileColumns;
+
+	// Every thread boundary splits at most one tile in two
+	engine->tiles = (correlation_tile_t*) malloc ((numRowBlocks*numColumnBlocks + numThreads)*sizeof(correlation_tile_t));
+	engine->thread_tiles = (uint64_t*) malloc ((numThreads+1)*sizeof(uint64_t));
+
+	uint64_t numTiles = 0;
+	uint64_t pairs_done = 0;
+	int thread = 0;
+
+	engine->thread_tiles[0] = 0;
+
+	for (uint64_t i0=0; i0<numTimeseries; i0+=correlation_tileRows) {
+
+		uint64_t i1 = i0+correlation_tileRows < numTimeseries ? i0+correlation_tileRows : numTimeseries;
+
+		for (uint64_t j0=i0+1; j0<numTimeseries; j0+=correlation_tileColumns) {
+
+			uint64_t j1 = j0+correlation_tileColumns < numTimeseries ? j0+correlation_tileColumns : numTimeseries;
+			uint64_t row_start = i0;
+
+			for (uint64_t i=i0; i<i1; i++) {
+
+				uint64_t j_start = i+1 > j0 ? i+1 : j0;
+				pairs_done += j_start < j1 ? j1-j_start : 0;
+
+				// Close the current thread once its share of pairs is reached
+				if (thread < numThreads-1 && pairs_done >= (numCorrelations*(thread+1))/numThreads) {
+					correlation_tile_t tile = {row_start, i+1, j0, j1};
+					engine->tiles[numTiles++] = tile;
+					engine->thread_tiles[++thread] = numTiles;
+					row_start = i+1;
+				}
+			}
+
+			if (row_start < i1) {
+				correlation_tile_t tile = {row_start, i1, j0, j1};
+				engine->tiles[numTiles++] = tile;
+			}
+		}
+	}
+
+	// Threads left without pairs (tiny triangles) get empty ranges
+	while (thread < numThreads)
+		engine->thread_tiles[++thread] = numTiles;
+}
+
+// Everything but the SUM(x,y) triangle
+static void setup (correlation_engine_t* engine, uint64_t numTimeseries, double windowSize, int numTopScores, unsigned rankings, int numThreads,
+			correlation_arena_t* arena) {
+
+	if (numThreads <= 0) {
+#ifdef _OPENMP
+		numThreads = omp_get_max_threads();
+#else
+		numThreads = 1;
+#endif
+	}
+
+	engine->numTimeseries = numTimeseries;
+	engine->windowSize = windowSize;
+	engine->numThreads = numThreads;
+	engine->sums_xy = NULL;
+	engine->sums_xy_f32 = NULL;
+	engine->arena = arena;
+
+	partition (engine);
+
+	void* thread_topk = NULL;
+	if (posix_memalign (&thread_topk, correlation_engineCacheLine, numThreads*sizeof(correlation_engine_topk_t)) != 0) {
+		fprintf(stderr, "Cannot allocate the selectors of %d threads. Terminating!\n", numThreads);
+		fflush(stderr);
+		exit(-1);
+	}
+	engine->thread_topk = (correlation_engine_topk_t*) thread_topk;
+	for (int t=0; t<numThreads; t++)
+		correlation_topk_init_ranks (&engine->thread_topk[t].topk, numTopScores, rankings);
+	correlation_topk_init_ranks (&engine->topk, numTopScores, rankings);
+
+	// Pick the kernel instruction set before any thread needs it
+	correlation_kernel_get_isa();
+}
+
+void correlation_engine_init (correlation_engine_t* engine, uint64_t numTimeseries, double windowSize, int numTopScores, unsigned rankings, int numThreads,
+				correlation_arena_t* arena) {
+
+	uint64_t numCorrelations = (numTimeseries*(numTimeseries-1))/2;
+
+	setup (engine, numTimeseries, windowSize, numTopScores, rankings, numThreads, arena);
+
+	// Pages are first touched by the thread that owns them, in the first step; arena pages were touched when it grew
+	if (arena) {
+		engine->sums_xy = (double*) correlation_arena_alloc (arena, numCorrelations*sizeof(double), 0);
+		correlation_engine_reset (engine);
+	}
+	else
+		engine->sums_xy = (double*) calloc (numCorrelations, sizeof(double));
+}
+
+void correlation_engine_init_f32 (correlation_engine_t* engine, uint64_t numTimeseries, double windowSize, int numTopScores, unsigned rankings, int numThreads,
+					correlation_arena_t* arena) {
+
+	uint64_t numCorrelations = (numTimeseries*(numTimeseries-1))/2;
+
+	setup (engine, numTimeseries, windowSize, numTopScores, rankings, numThreads, arena);
+
+	if (arena) {
+		engine->sums_xy_f32 = (float*) correlation_arena_alloc (arena, numCorrelations*sizeof(float), 0);
+		correlation_engine_reset (engine);
+	}
+	else
+		engine->sums_xy_f32 = (float*) calloc (numCorrelations, sizeof(float));
+}
+
+void correlation_engine_reset (correlation_engine_t* engine) {
+
+	uint64_t numCorrelations = (engine->numTimeseries*(engine->numTimeseries-1))/2;
+
+	if (engine->sums_xy)
+		memset (engine->sums_xy, 0, numCorrelations*sizeof(double));
+	if (engine->sums_xy_f32)
+		memset (engine->sums_xy_f32, 0, numCorrelations*sizeof(float));
+}
+
+void correlation_engine_free (correlation_engine_t* engine) {
+
+	for (int t=0; t<engine->numThreads; t++)
+		correlation_topk_free (&engine->thread_topk[t].topk);
+	correlation_topk_free (&engine->topk);
+
+	free (engine->thread_topk);
+	free (engine->thread_tiles);
+	free (engine->tiles);
+
+	if (!engine->arena) {
+		free (engine->sums_xy);
+		free (engine->sums_xy_f32);
+	}
+}
+
+// Ties are broken by triangle position, so the merged result does not depend on the partition
+static void merge (correlation_engine_t* engine, double* correlations_top, uint32_t* indices_top) {
+
+	correlation_topk_reset (&engine->topk);
+	for (int t=0; t<engine->numThreads; t++)
+		correlation_topk_merge (&engine->topk, &engine->thread_topk[t].topk);
+
+	correlation_topk_result (&engine->topk, correlations_top, indices_top);
+}
+
+void correlation_engine_step (correlation_engine_t* engine, const double* new_values, const double* old_values, const double* sums, const double* inv,
+				double* correlations_top, uint32_t* indices_top) {
+
+	#pragma omp parallel num_threads(engine->numThreads)
+	{
+		int first = 0;
+		int stride = 1;
+#ifdef _OPENMP
+		first = omp_get_thread_num();
+		stride = omp_get_num_threads();
+#endif
+		// The runtime may grant fewer threads than asked for; every partition is still computed exactly once
+		for (int t=first; t<engine->numThreads; t+=stride) {
+
+			correlation_topk_reset (&engine->thread_topk[t].topk);
+
+			correlation_kernel_step_tiles (engine->numTimeseries, engine->windowSize, new_values, old_values, sums, inv, engine->sums_xy,
+							&engine->tiles[engine->thread_tiles[t]], engine->thread_tiles[t+1] - engine->thread_tiles[t],
+							&engine->thread_topk[t].topk);
+		}
+	}
+
+	merge (engine, correlations_top, indices_top);
+}
+
+void correlation_engine_step_f32 (correlation_engine_t* engine, const float* new_values, const float* old_values, const float* sums, const float* inv,
+					double* correlations_top, uint32_t* indices_top) {
+
+	#pragma omp parallel num_threads(engine->numThreads)
+	{
+		int first = 0;
+		int stride = 1;
+#ifdef _OPENMP
+		first = omp_get_thread_num();
+		stride = omp_get_num_threads();
+#endif
+		for (int t=first; t<engine->numThreads; t+=stride) {
+
+			correlation_topk_reset (&engine->thread_topk[t].topk);
+
+			correlation_kernel_step_tiles_f32 (engine->numTimeseries, engine->windowSize, new_values, old_values, sums, inv, engine->sums_xy_f32,
+								&engine->tiles[engine->thread_tiles[t]], engine->thread_tiles[t+1] - engine->thread_tiles[t],
+								&engine->thread_topk[t].topk);
+		}
+	}
+
+	merge (engine, correlations_top, indices_top);
+}
+
+void correlation_engine_update (correlation_engine_t* engine, const double* const* new_rows, const double* const* old_rows, uint64_t numSteps) {
+
+	#pragma omp parallel num_threads(engine->numThreads)
+	{
+		int first = 0;
+		int stride = 1;
+#ifdef _OPENMP
+		first = omp_get_thread_num();
+		stride = omp_get_num_threads();
+#endif
+		for (int t=first; t<engine->numThreads; t+=stride)
+			correlation_kernel_update_tiles (engine->numTimeseries, new_rows, old_rows, numSteps, engine->sums_xy,
+								&engine->tiles[engine->thread_tiles[t]], engine->thread_tiles[t+1] - engine->thread_tiles[t]);
+	}
+}
+
+void correlation_engine_resync_f32 (correlation_engine_t* engine, const double* const* rows, uint64_t numRows) {
+
+	#pragma omp parallel num_threads(engine->numThreads)
+	{
+		int first = 0;
+		int stride = 1;
+#ifdef _OPENMP
+		first = omp_get_thread_num();
+		stride = omp_get_num_threads();
+#endif
+		double sums_xy[correlation_tileColumns];
+
+		for (int t=first; t<engine->numThreads; t+=stride) {
+			for (uint64_t k=engine->thread_tiles[t]; k<engine->thread_tiles[t+1]; k++) {
+
+				const correlation_tile_t* tile = &engine->tiles[k];
+
+				for (uint64_t i=tile->i0; i<tile->i1; i++) {
+
+					uint64_t j_start = i+1 > tile->j0 ? i+1 : tile->j0;
+					if (j_start >= tile->j1)
+						continue;
+
+					// Exact SUM(x,y) in double over the window, rounded once
+					memset (sums_xy, 0, (tile->j1-j_start)*sizeof(double));
+					for (uint64_t r=0; r<numRows; ) {
+
+						// A cross-section repeated m times in a row is added once, with weight m
+						uint64_t m = 1;
+						while (r+m < numRows && rows[r+m] == rows[r])
+							m++;
+
+						const double* row = rows[r];
+						double x = m*row[i];
+						for (uint64_t j=j_start; j<tile->j1; j++)
+							sums_xy[j-j_start] += x*row[j];
+						r += m;
+					}
+
+					float* out = &engine->sums_xy_f32[correlation_kernel_index (engine->numTimeseries, i, j_start)];
+					for (uint64_t j=j_start; j<tile->j1; j++)
+						out[j-j_start] = (float)sums_xy[j-j_start];
+				}
+			}
+		}
+	}
+}
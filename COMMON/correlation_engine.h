@@ -0,0 +1,124 @@
+/**
+ * File: correlation_engine.h
+ * Purpose: multi-threaded CPU correlation engine
+ *
+ * The engine owns the packed SUM(x,y) triangle of numTimeseries series and advances it one timestep
+ * at a time. The triangle is cut once into tiles and the tiles are dealt out to numThreads threads
+ * so that every thread gets the same number of pairs (rows of the triangle have uneven lengths, so
+ * the cut is made by pair count, splitting tiles between rows where needed). Every thread keeps its
+ * own top-K selector over its pairs; the selectors are merged after each step. The selectors can
+ * keep several rankings (most positive, most negative, largest |r|), all filled in the same pass.
+ * Each selector starts on a cache line of its own, so threads pushing candidates do not share lines.
+ *
+ * A thread always updates the same part of the triangle, so its pages stay local to it after
+ * the first step has touched them.
+ *
+ * An engine opened with correlation_engine_init_f32 keeps the triangle in single precision, which
+ * halves its size, and is advanced with correlation_engine_step_f32 instead.
+ *
+ * Timesteps whose top correlations are not needed can be added in batches with
+ * correlation_engine_update, which reads and writes the triangle once per batch.
+ *
+ */
+
+#ifndef CORRELATION_ENGINE_H
+#define CORRELATION_ENGINE_H
+
+#include <stdint.h>
+
+#include "correlation_topk.h"
+#include "correlation_kernel.h"
+#include "correlation_arena.h"
+
+#define correlation_engineCacheLine (64)
+
+// Selector of one thread, padded to whole cache lines
+typedef struct {
+	correlation_topk_t topk;
+} __attribute__((aligned(correlation_engineCacheLine))) correlation_engine_topk_t;
+
+typedef struct {
+	uint64_t numTimeseries;			/* Number of Timeseries */
+	double windowSize;			/* Window for correlation */
+	int numThreads;				/* Number of threads */
+	double* sums_xy;			/* Packed triangle of SUM(x,y), NULL in single precision */
+	float* sums_xy_f32;			/* Packed triangle of SUM(x,y) in single precision, or NULL */
+	correlation_arena_t* arena;		/* Arena the triangle is sliced from, or NULL if allocated */
+	correlation_tile_t* tiles;		/* Tiles of the triangle, in thread order */
+	uint64_t* thread_tiles;			/* Thread t computes tiles [thread_tiles[t], thread_tiles[t+1]) */
+	correlation_engine_topk_t* thread_topk;	/* Selector of every thread, aligned to a cache line */
+	correlation_topk_t topk;		/* Merged selector of the last step */
+} correlation_engine_t;
+
+
+/* Allocate an engine with SUM(x,y) = 0. numThreads = 0 uses all available threads.
+ * With an arena, the triangle is sliced from it and stays valid until the arena is reset. */
+void correlation_engine_init (
+	correlation_engine_t* engine,	/* Engine */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	double windowSize,		/* Window for correlation */
+	int numTopScores,		/* Number of top correlations per step and ranking */
+	unsigned rankings,		/* correlation_rank_t values or-ed together */
+	int numThreads,			/* Number of threads, 0 for all available */
+	correlation_arena_t* arena	/* Arena for SUM(x,y), or NULL */
+);
+
+/* Same as correlation_engine_init, with SUM(x,y) kept in single precision */
+void correlation_engine_init_f32 (
+	correlation_engine_t* engine,	/* Engine */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	double windowSize,		/* Window for correlation */
+	int numTopScores,		/* Number of top correlations per step and ranking */
+	unsigned rankings,		/* correlation_rank_t values or-ed together */
+	int numThreads,			/* Number of threads, 0 for all available */
+	correlation_arena_t* arena	/* Arena for SUM(x,y), or NULL */
+);
+
+/* Set SUM(x,y) of all pairs back to 0 */
+void correlation_engine_reset (
+	correlation_engine_t* engine	/* Engine */
+);
+
+/* Release memory held by the engine */
+void correlation_engine_free (
+	correlation_engine_t* engine	/* Engine */
+);
+
+/* Advance SUM(x,y) by one timestep and write the top correlations of that step, best first, ranking after ranking */
+void correlation_engine_step (
+	correlation_engine_t* engine,	/* Engine */
+	const double* new_values,	/* x[s] of every Timeseries */
+	const double* old_values,	/* x[s-n] of every Timeseries, 0 while s<n */
+	const double* sums,		/* SUM(x) of every Timeseries */
+	const double* inv,		/* SQRT_INVERSE(x) of every Timeseries */
+	double* correlations_top,	/* Output top correlations, numTopScores per ranking */
+	uint32_t* indices_top		/* Output corresponding pairs of indices */
+);
+
+/* Single precision correlation_engine_step, for an engine opened with correlation_engine_init_f32 */
+void correlation_engine_step_f32 (
+	correlation_engine_t* engine,	/* Engine */
+	const float* new_values,	/* x[s] of every Timeseries */
+	const float* old_values,	/* x[s-n] of every Timeseries, 0 while s<n */
+	const float* sums,		/* SUM(x) of every Timeseries */
+	const float* inv,		/* SQRT_INVERSE(x) of every Timeseries */
+	double* correlations_top,	/* Output top correlations, numTopScores per ranking */
+	uint32_t* indices_top		/* Output corresponding pairs of indices */
+);
+
+/* Add numSteps timesteps to SUM(x,y) at once; correlations of those timesteps are not evaluated */
+void correlation_engine_update (
+	correlation_engine_t* engine,	/* Engine */
+	const double* const* new_rows,	/* x[s] of every Timeseries, for each of the timesteps */
+	const double* const* old_rows,	/* x[s-n] of every Timeseries, for each of the timesteps */
+	uint64_t numSteps		/* Number of timesteps */
+);
+
+/* Recompute the single precision SUM(x,y) exactly (in double) from the cross-sections of the window */
+void correlation_engine_resync_f32 (
+	correlation_engine_t* engine,	/* Engine */
+	const double* const* rows,	/* Cross-sections in the window, repeats allowed */
+	uint64_t numRows		/* Number of cross-sections */
+);
+
+#endif /* CORRELATION_ENGINE_H */
@@ -0,0 +1,180 @@
+/**
+ * File: correlation_file.c
+ * Purpose: memory-mapped binary timeseries files
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "correlation_file.h"
+
+static const char magic[8] = {'C', 'O', 'R', 'R', 'T', 'S', 0, 0};
+
+// On-disk header, see correlation_file.h
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t elementSize;
+	uint64_t numTimeseries;
+	uint64_t numTimesteps;
+	uint64_t dataOffset;
+	uint8_t reserved[24];
+} file_header_t;
+
+
+static void file_error (const char* path, const char* message) {
+	fprintf(stderr, "Timeseries file %s: %s. Terminating!\n", path, message);
+	fflush(stderr);
+	exit(-1);
+}
+
+void correlation_file_open (correlation_file_t* file, const char* path) {
+
+	int fd = open (path, O_RDONLY);
+	if (fd < 0)
+		file_error (path, "cannot be opened");
+
+	struct stat st;
+	if (fstat (fd, &st) != 0 || (uint64_t)st.st_size < correlation_fileHeaderSize)
+		file_error (path, "too short for a header");
+
+	void* map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED)
+		file_error (path, "cannot be mapped");
+
+	file_header_t header;
+	memcpy (&header, map, sizeof(header));
+
+	if (memcmp (header.magic, magic, sizeof(magic)) != 0 || header.version != correlation_fileVersion)
+		file_error (path, "not a timeseries file of this version");
+	if (header.elementSize != 8 && header.elementSize != 4)
+		file_error (path, "elements are neither float64 nor float32");
+	if (header.dataOffset % correlation_fileDataAlignment != 0 ||
+	    header.dataOffset + header.numTimesteps*header.numTimeseries*header.elementSize > (uint64_t)st.st_size)
+		file_error (path, "data does not fit in the file");
+
+	file->numTimeseries = header.numTimeseries;
+	file->numTimesteps = header.numTimesteps;
+	file->elementSize = header.elementSize;
+	file->map = map;
+	file->mapSize = st.st_size;
+	file->data = (const char*) map + header.dataOffset;
+
+	// The timesteps are consumed in order: read ahead aggressively
+	madvise (map, file->mapSize, MADV_SEQUENTIAL);
+}
+
+void correlation_file_close (correlation_file_t* file) {
+	munmap (file->map, file->mapSize);
+}
+
+void correlation_file_write (const char* path, const double* data, uint64_t numTimeseries, uint64_t numTimesteps, uint32_t elementSize) {
+
+	if (elementSize != 8 && elementSize != 4)
+		file_error (path, "elements are neither float64 nor float32");
+
+	FILE* out = fopen (path, "wb");
+	if (!out)
+		file_error (path, "cannot be created");
+
+	file_header_t header;
+	memset (&header, 0, sizeof(header));
+	memcpy (header.magic, magic, sizeof(magic));
+	header.version = correlation_fileVersion;
+	header.elementSize = elementSize;
+	header.numTimeseries = numTimeseries;
+	header.numTimesteps = numTimesteps;
+	header.dataOffset = correlation_fileDataAlignment;
+
+	char padding[correlation_fileDataAlignment];
+	memset (padding, 0, sizeof(padding));
+
+	int ok = fwrite (&header, sizeof(header), 1, out) == 1;
+	ok = ok && fwrite (padding, correlation_fileDataAlignment - sizeof(header), 1, out) == 1;
+
+	// Cross-sections are written one at a time, float32 files converted on the way
+	float* row = elementSize == 4 ? (float*) malloc (numTimeseries*sizeof(float)) : NULL;
+
+	for (uint64_t s=0; s<numTimesteps && ok; s++) {
+
+		const double* values = &data[s*numTimeseries];
+
+		if (row) {
+			for (uint64_t i=0; i<numTimeseries; i++)
+				row[i] = (float) values[i];
+			ok = fwrite (row, sizeof(float), numTimeseries, out) == numTimeseries;
+		}
+		else
+			ok = fwrite (values, sizeof(double), numTimeseries, out) == numTimeseries;
+	}
+
+	free (row);
+	if (fclose (out) != 0 || !ok)
+		file_error (path, "cannot be written");
+}
+
+const double* correlation_file_rows (const correlation_file_t* file) {
+	return file->elementSize == 8 ? (const double*) file->data : NULL;
+}
+
+const double* correlation_file_chunk (const correlation_file_t* file, uint64_t first, uint64_t numSteps, double* buffer) {
+
+	if (file->elementSize == 8)
+		return &((const double*) file->data)[first*file->numTimeseries];
+
+	const float* values = &((const float*) file->data)[first*file->numTimeseries];
+	for (uint64_t n=0; n<numSteps*file->numTimeseries; n++)
+		buffer[n] = values[n];
+
+	return buffer;
+}
+
+// Pages wholly or partly covering cross-sections [first, first+numSteps), or only the whole ones
+static void file_pages (const correlation_file_t* file, uint64_t first, uint64_t numSteps, int whole, char** start, size_t* size) {
+
+	uintptr_t page = sysconf (_SC_PAGESIZE);
+
+	if (first > file->numTimesteps)
+		first = file->numTimesteps;
+	if (numSteps > file->numTimesteps - first)
+		numSteps = file->numTimesteps - first;
+
+	uint64_t rowSize = file->numTimeseries*file->elementSize;
+	uintptr_t begin = (uintptr_t) file->data + first*rowSize;
+	uintptr_t end = begin + numSteps*rowSize;
+
+	begin = whole ? (begin + page - 1) & ~(page - 1) : begin & ~(page - 1);
+	end = whole ? end & ~(page - 1) : (end + page - 1) & ~(page - 1);
+
+	*start = (char*) begin;
+	*size = end > begin ? end - begin : 0;
+}
+
+void correlation_file_prefetch (const correlation_file_t* file, uint64_t first, uint64_t numSteps) {
+
+	char* start;
+	size_t size;
+
+	file_pages (file, first, numSteps, 0, &start, &size);
+	if (size)
+		madvise (start, size, MADV_WILLNEED);
+}
+
+void correlation_file_release (const correlation_file_t* file, uint64_t first, uint64_t numSteps) {
+
+	char* start;
+	size_t size;
+
+	// Pages shared with neighbouring timesteps are kept
+	file_pages (file, first, numSteps, 1, &start, &size);
+	if (size)
+		madvise (start, size, MADV_DONTNEED);
+}
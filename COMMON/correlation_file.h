@@ -0,0 +1,103 @@
+/**
+ * File: correlation_file.h
+ * Purpose: memory-mapped binary timeseries files
+ *
+ * A file holds numTimesteps cross-sections of numTimeseries timeseries, time-major, behind a
+ * 64 byte header. All fields are little-endian:
+ *
+ *	offset	size	field
+ *	0	8	magic		"CORRTS\0\0"
+ *	8	4	version		1
+ *	12	4	elementSize	8 for float64, 4 for float32
+ *	16	8	numTimeseries
+ *	24	8	numTimesteps
+ *	32	8	dataOffset	start of the data, a multiple of 4096
+ *	40	24	reserved	zeros
+ *
+ *	dataOffset + (s*numTimeseries + i)*elementSize	x[s] of timeseries i
+ *
+ * The data is mapped read-only and advised for sequential access, so the kernel reads ahead while
+ * the timesteps are consumed in order. Float64 files are used in place: correlation_file_rows
+ * points into the mapping, which is the time-major layout that correlation_rows,
+ * correlation_control_flow_rows, prepare_data_for_dfe_rows and correlate_rows take. Float32 files
+ * are converted to double a chunk at a time by correlation_file_chunk.
+ *
+ * correlation_file_prefetch and correlation_file_release bound the resident part of multi-GB
+ * files to the timesteps being worked on, typically correlation_fileChunkSteps at a time, as
+ * correlation_mapped (ORIG) and correlation_control_flow_file (SPLIT) do.
+ *
+ */
+
+#ifndef CORRELATION_FILE_H
+#define CORRELATION_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define correlation_fileVersion (1)
+#define correlation_fileHeaderSize (64)
+#define correlation_fileDataAlignment (4096)
+
+// Timesteps read ahead at a time
+#ifndef correlation_fileChunkSteps
+#define correlation_fileChunkSteps (1024)
+#endif
+
+typedef struct {
+	uint64_t numTimeseries;		/* Number of Timeseries */
+	uint64_t numTimesteps;		/* Number of cross-sections in the file */
+	uint32_t elementSize;		/* 8 for float64, 4 for float32 */
+	void* map;			/* Mapping of the whole file */
+	size_t mapSize;			/* Size of the mapping */
+	const void* data;		/* First cross-section */
+} correlation_file_t;
+
+
+/* Map a timeseries file; terminates on a missing or malformed file */
+void correlation_file_open (
+	correlation_file_t* file,	/* File */
+	const char* path		/* Path of the file */
+);
+
+/* Unmap the file */
+void correlation_file_close (
+	correlation_file_t* file	/* File */
+);
+
+/* Write numTimesteps time-major cross-sections as a timeseries file; terminates on failure */
+void correlation_file_write (
+	const char* path,		/* Path of the file */
+	const double* data,		/* data[s*numTimeseries + i] is x[s] of timeseries i */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	uint64_t numTimesteps,		/* Number of cross-sections */
+	uint32_t elementSize		/* 8 for float64, 4 for float32 */
+);
+
+/* Time-major cross-sections of a float64 file, in place; NULL for float32 files */
+const double* correlation_file_rows (
+	const correlation_file_t* file	/* File */
+);
+
+/* Cross-sections [first, first+numSteps) as doubles: in place for float64, converted into buffer for float32 */
+const double* correlation_file_chunk (
+	const correlation_file_t* file,	/* File */
+	uint64_t first,			/* First timestep */
+	uint64_t numSteps,		/* Number of timesteps */
+	double* buffer			/* numSteps*numTimeseries doubles, used for float32 files only */
+);
+
+/* Ask for cross-sections [first, first+numSteps) to be read ahead */
+void correlation_file_prefetch (
+	const correlation_file_t* file,	/* File */
+	uint64_t first,			/* First timestep */
+	uint64_t numSteps		/* Number of timesteps */
+);
+
+/* Drop cross-sections [first, first+numSteps) from memory; they are read again from the file if used */
+void correlation_file_release (
+	const correlation_file_t* file,	/* File */
+	uint64_t first,			/* First timestep */
+	uint64_t numSteps		/* Number of timesteps */
+);
+
+#endif /* CORRELATION_FILE_H */
@@ -0,0 +1,741 @@
+/**
+ * File: correlation_kernel.c
+ * Purpose: pair kernel updating SUM(x,y) for one timestep and selecting the top correlations
+ *
+ * Every tile row is handed to a row function: a scalar one and SSE2 / AVX2 / AVX-512 ones that
+ * update SUM(x,y) and evaluate the correlations a vector at a time. A vector of correlations is
+ * compared against the current K-th score and only passes to the selector if one of its lanes
+ * reaches it. The row function is picked once, from cpuid, on the first step.
+ *
+ * Every row function is built twice from one always-inlined body: for selectors of the top ranking
+ * only, which offer candidates with correlation_topk_push_top, and, as *_ranked, for selectors that
+ * also take correlations from below (bottom and |r| rankings), which adds a compare against
+ * topk->lower. A plain top-K step pays nothing for it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "correlation_kernel.h"
+
+
+// Inputs of one step, shared by all rows
+typedef struct {
+	uint64_t numTimeseries;
+	double windowSize;
+	const double* new_values;
+	const double* old_values;
+	const double* sums;
+	const double* inv;
+	double* sums_xy;
+	correlation_topk_t* topk;
+} kernel_step_t;
+
+// Pairs (i,j) for j_start <= j < j_end
+typedef void (*kernel_row_t) (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end);
+
+// Offer one correlation to the selector of the step
+__attribute__((always_inline))
+static inline void kernel_push (correlation_topk_t* topk, double score, uint64_t position, uint32_t index_0, uint32_t index_1, const int two_sided) {
+	if (two_sided)
+		correlation_topk_push (topk, score, position, index_0, index_1);
+	else
+		correlation_topk_push_top (topk, score, position, index_0, index_1);
+}
+
+
+__attribute__((always_inline))
+static inline void kernel_row_scalar_body (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	double new_x = step->new_values[i];
+	double old_x = step->old_values[i];
+	double sum_x = step->sums[i];
+	double inv_x = step->inv[i];
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	double* sums_xy = &step->sums_xy[index_correlation];
+
+	for (uint64_t j=j_start; j<j_end; j++) {
+
+		*sums_xy += new_x*step->new_values[j] - old_x*step->old_values[j];
+
+		double correlation_step = (step->windowSize*(*sums_xy) - sum_x*step->sums[j])*inv_x*step->inv[j];
+
+		kernel_push (step->topk, correlation_step, index_correlation, j, i, two_sided);
+
+		sums_xy++;
+		index_correlation++;
+	}
+}
+
+static void kernel_row_scalar (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_scalar_body (step, i, j_start, j_end, 0);
+}
+
+static void kernel_row_scalar_ranked (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_scalar_body (step, i, j_start, j_end, 1);
+}
+
+#ifdef __x86_64__
+
+__attribute__((target("sse2"), always_inline))
+static inline void kernel_row_sse2_body (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	__m128d new_x = _mm_set1_pd(step->new_values[i]);
+	__m128d old_x = _mm_set1_pd(step->old_values[i]);
+	__m128d sum_x = _mm_set1_pd(step->sums[i]);
+	__m128d inv_x = _mm_set1_pd(step->inv[i]);
+	__m128d windowSize = _mm_set1_pd(step->windowSize);
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	double* sums_xy = &step->sums_xy[index_correlation];
+	uint64_t j = j_start;
+
+	for (; j+2<=j_end; j+=2, sums_xy+=2, index_correlation+=2) {
+
+		__m128d xy = _mm_add_pd(_mm_loadu_pd(sums_xy), _mm_sub_pd(_mm_mul_pd(new_x, _mm_loadu_pd(&step->new_values[j])),
+										_mm_mul_pd(old_x, _mm_loadu_pd(&step->old_values[j]))));
+		_mm_storeu_pd(sums_xy, xy);
+
+		__m128d correlation_step = _mm_mul_pd(_mm_mul_pd(_mm_sub_pd(_mm_mul_pd(windowSize, xy), _mm_mul_pd(sum_x, _mm_loadu_pd(&step->sums[j]))),
+								inv_x), _mm_loadu_pd(&step->inv[j]));
+
+		int mask = _mm_movemask_pd(_mm_cmpge_pd(correlation_step, _mm_set1_pd(step->topk->threshold)));
+		if (two_sided)
+			mask |= _mm_movemask_pd(_mm_cmple_pd(correlation_step, _mm_set1_pd(step->topk->lower)));
+		if (mask) {
+			double lanes[2];
+			_mm_storeu_pd(lanes, correlation_step);
+			for (int l=0; l<2; l++)
+				if (mask & (1<<l))
+					kernel_push (step->topk, lanes[l], index_correlation+l, j+l, i, two_sided);
+		}
+	}
+
+	if (j < j_end)
+		kernel_row_scalar_body (step, i, j, j_end, two_sided);
+}
+
+__attribute__((target("sse2")))
+static void kernel_row_sse2 (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_sse2_body (step, i, j_start, j_end, 0);
+}
+
+__attribute__((target("sse2")))
+static void kernel_row_sse2_ranked (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_sse2_body (step, i, j_start, j_end, 1);
+}
+
+__attribute__((target("avx2,fma"), always_inline))
+static inline void kernel_row_avx2_body (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	__m256d new_x = _mm256_set1_pd(step->new_values[i]);
+	__m256d old_x = _mm256_set1_pd(step->old_values[i]);
+	__m256d sum_x = _mm256_set1_pd(step->sums[i]);
+	__m256d inv_x = _mm256_set1_pd(step->inv[i]);
+	__m256d windowSize = _mm256_set1_pd(step->windowSize);
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	double* sums_xy = &step->sums_xy[index_correlation];
+	uint64_t j = j_start;
+
+	for (; j+4<=j_end; j+=4, sums_xy+=4, index_correlation+=4) {
+
+		__m256d xy = _mm256_add_pd(_mm256_loadu_pd(sums_xy), _mm256_fmsub_pd(new_x, _mm256_loadu_pd(&step->new_values[j]),
+										_mm256_mul_pd(old_x, _mm256_loadu_pd(&step->old_values[j]))));
+		_mm256_storeu_pd(sums_xy, xy);
+
+		__m256d correlation_step = _mm256_mul_pd(_mm256_mul_pd(_mm256_fmsub_pd(windowSize, xy, _mm256_mul_pd(sum_x, _mm256_loadu_pd(&step->sums[j]))),
+								inv_x), _mm256_loadu_pd(&step->inv[j]));
+
+		int mask = _mm256_movemask_pd(_mm256_cmp_pd(correlation_step, _mm256_set1_pd(step->topk->threshold), _CMP_GE_OQ));
+		if (two_sided)
+			mask |= _mm256_movemask_pd(_mm256_cmp_pd(correlation_step, _mm256_set1_pd(step->topk->lower), _CMP_LE_OQ));
+		if (mask) {
+			double lanes[4];
+			_mm256_storeu_pd(lanes, correlation_step);
+			for (int l=0; l<4; l++)
+				if (mask & (1<<l))
+					kernel_push (step->topk, lanes[l], index_correlation+l, j+l, i, two_sided);
+		}
+	}
+
+	if (j < j_end)
+		kernel_row_scalar_body (step, i, j, j_end, two_sided);
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_row_avx2 (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_avx2_body (step, i, j_start, j_end, 0);
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_row_avx2_ranked (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_avx2_body (step, i, j_start, j_end, 1);
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline void kernel_row_avx512_body (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	__m512d new_x = _mm512_set1_pd(step->new_values[i]);
+	__m512d old_x = _mm512_set1_pd(step->old_values[i]);
+	__m512d sum_x = _mm512_set1_pd(step->sums[i]);
+	__m512d inv_x = _mm512_set1_pd(step->inv[i]);
+	__m512d windowSize = _mm512_set1_pd(step->windowSize);
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	double* sums_xy = &step->sums_xy[index_correlation];
+
+	for (uint64_t j=j_start; j<j_end; j+=8, sums_xy+=8, index_correlation+=8) {
+
+		// Tail of the row is handled with masked loads and stores
+		__mmask8 lanes_valid = j_end-j >= 8 ? 0xff : (__mmask8)((1u<<(j_end-j))-1);
+
+		__m512d xy = _mm512_add_pd(_mm512_maskz_loadu_pd(lanes_valid, sums_xy),
+						_mm512_fmsub_pd(new_x, _mm512_maskz_loadu_pd(lanes_valid, &step->new_values[j]),
+								_mm512_mul_pd(old_x, _mm512_maskz_loadu_pd(lanes_valid, &step->old_values[j]))));
+		_mm512_mask_storeu_pd(sums_xy, lanes_valid, xy);
+
+		__m512d correlation_step = _mm512_mul_pd(_mm512_mul_pd(_mm512_fmsub_pd(windowSize, xy,
+											_mm512_mul_pd(sum_x, _mm512_maskz_loadu_pd(lanes_valid, &step->sums[j]))),
+								inv_x), _mm512_maskz_loadu_pd(lanes_valid, &step->inv[j]));
+
+		__mmask8 mask = _mm512_mask_cmp_pd_mask(lanes_valid, correlation_step, _mm512_set1_pd(step->topk->threshold), _CMP_GE_OQ);
+		if (two_sided)
+			mask |= _mm512_mask_cmp_pd_mask(lanes_valid, correlation_step, _mm512_set1_pd(step->topk->lower), _CMP_LE_OQ);
+		if (mask) {
+			double lanes[8];
+			_mm512_storeu_pd(lanes, correlation_step);
+			for (int l=0; l<8; l++)
+				if (mask & (1<<l))
+					kernel_push (step->topk, lanes[l], index_correlation+l, j+l, i, two_sided);
+		}
+	}
+}
+
+__attribute__((target("avx512f")))
+static void kernel_row_avx512 (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_avx512_body (step, i, j_start, j_end, 0);
+}
+
+__attribute__((target("avx512f")))
+static void kernel_row_avx512_ranked (const kernel_step_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_avx512_body (step, i, j_start, j_end, 1);
+}
+
+#endif /* __x86_64__ */
+
+
+
+/*
+ * Batched rows: SUM(x,y) += SUM over t of (x_t*y_t - x_{t-n}*y_{t-n}) for numSteps timesteps at once.
+ * A run of SUM(x,y) is kept in registers while all timesteps are added, so the triangle is read and
+ * written once per batch rather than once per timestep. Every timestep is added with the same
+ * operations as in the row functions above, so results match stepping one timestep at a time.
+ */
+
+typedef struct {
+	uint64_t numTimeseries;
+	const double* const* new_rows;
+	const double* const* old_rows;
+	uint64_t numSteps;
+	double* sums_xy;
+} kernel_update_t;
+
+typedef void (*kernel_update_row_t) (const kernel_update_t* update, uint64_t i, uint64_t j_start, uint64_t j_end);
+
+
+static void kernel_update_row_scalar (const kernel_update_t* update, uint64_t i, uint64_t j_start, uint64_t j_end) {
+
+	double* sums_xy = &update->sums_xy[correlation_kernel_index (update->numTimeseries, i, j_start)];
+
+	for (uint64_t j=j_start; j<j_end; j++) {
+
+		double xy = sums_xy[j-j_start];
+
+		for (uint64_t t=0; t<update->numSteps; t++)
+			xy += update->new_rows[t][i]*update->new_rows[t][j] - update->old_rows[t][i]*update->old_rows[t][j];
+
+		sums_xy[j-j_start] = xy;
+	}
+}
+
+#ifdef __x86_64__
+
+__attribute__((target("sse2")))
+static void kernel_update_row_sse2 (const kernel_update_t* update, uint64_t i, uint64_t j_start, uint64_t j_end) {
+
+	double* sums_xy = &update->sums_xy[correlation_kernel_index (update->numTimeseries, i, j_start)];
+	uint64_t j = j_start;
+
+	for (; j+2<=j_end; j+=2, sums_xy+=2) {
+
+		__m128d xy = _mm_loadu_pd(sums_xy);
+
+		for (uint64_t t=0; t<update->numSteps; t++) {
+			const double* new_values = update->new_rows[t];
+			const double* old_values = update->old_rows[t];
+			xy = _mm_add_pd(xy, _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(new_values[i]), _mm_loadu_pd(&new_values[j])),
+							_mm_mul_pd(_mm_set1_pd(old_values[i]), _mm_loadu_pd(&old_values[j]))));
+		}
+
+		_mm_storeu_pd(sums_xy, xy);
+	}
+
+	if (j < j_end)
+		kernel_update_row_scalar (update, i, j, j_end);
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_update_row_avx2 (const kernel_update_t* update, uint64_t i, uint64_t j_start, uint64_t j_end) {
+
+	double* sums_xy = &update->sums_xy[correlation_kernel_index (update->numTimeseries, i, j_start)];
+	uint64_t j = j_start;
+
+	// 4 vectors at a time, then single vectors
+	for (; j+16<=j_end; j+=16, sums_xy+=16) {
+
+		__m256d xy0 = _mm256_loadu_pd(sums_xy);
+		__m256d xy1 = _mm256_loadu_pd(sums_xy+4);
+		__m256d xy2 = _mm256_loadu_pd(sums_xy+8);
+		__m256d xy3 = _mm256_loadu_pd(sums_xy+12);
+
+		for (uint64_t t=0; t<update->numSteps; t++) {
+			const double* new_values = &update->new_rows[t][j];
+			const double* old_values = &update->old_rows[t][j];
+			__m256d new_x = _mm256_set1_pd(update->new_rows[t][i]);
+			__m256d old_x = _mm256_set1_pd(update->old_rows[t][i]);
+			xy0 = _mm256_add_pd(xy0, _mm256_fmsub_pd(new_x, _mm256_loadu_pd(new_values), _mm256_mul_pd(old_x, _mm256_loadu_pd(old_values))));
+			xy1 = _mm256_add_pd(xy1, _mm256_fmsub_pd(new_x, _mm256_loadu_pd(new_values+4), _mm256_mul_pd(old_x, _mm256_loadu_pd(old_values+4))));
+			xy2 = _mm256_add_pd(xy2, _mm256_fmsub_pd(new_x, _mm256_loadu_pd(new_values+8), _mm256_mul_pd(old_x, _mm256_loadu_pd(old_values+8))));
+			xy3 = _mm256_add_pd(xy3, _mm256_fmsub_pd(new_x, _mm256_loadu_pd(new_values+12), _mm256_mul_pd(old_x, _mm256_loadu_pd(old_values+12))));
+		}
+
+		_mm256_storeu_pd(sums_xy, xy0);
+		_mm256_storeu_pd(sums_xy+4, xy1);
+		_mm256_storeu_pd(sums_xy+8, xy2);
+		_mm256_storeu_pd(sums_xy+12, xy3);
+	}
+
+	for (; j+4<=j_end; j+=4, sums_xy+=4) {
+
+		__m256d xy = _mm256_loadu_pd(sums_xy);
+
+		for (uint64_t t=0; t<update->numSteps; t++) {
+			const double* new_values = update->new_rows[t];
+			const double* old_values = update->old_rows[t];
+			xy = _mm256_add_pd(xy, _mm256_fmsub_pd(_mm256_set1_pd(new_values[i]), _mm256_loadu_pd(&new_values[j]),
+								_mm256_mul_pd(_mm256_set1_pd(old_values[i]), _mm256_loadu_pd(&old_values[j]))));
+		}
+
+		_mm256_storeu_pd(sums_xy, xy);
+	}
+
+	if (j < j_end)
+		kernel_update_row_scalar (update, i, j, j_end);
+}
+
+__attribute__((target("avx512f")))
+static void kernel_update_row_avx512 (const kernel_update_t* update, uint64_t i, uint64_t j_start, uint64_t j_end) {
+
+	double* sums_xy = &update->sums_xy[correlation_kernel_index (update->numTimeseries, i, j_start)];
+	uint64_t j = j_start;
+
+	// 4 vectors at a time, then single masked vectors
+	for (; j+32<=j_end; j+=32, sums_xy+=32) {
+
+		__m512d xy0 = _mm512_loadu_pd(sums_xy);
+		__m512d xy1 = _mm512_loadu_pd(sums_xy+8);
+		__m512d xy2 = _mm512_loadu_pd(sums_xy+16);
+		__m512d xy3 = _mm512_loadu_pd(sums_xy+24);
+
+		for (uint64_t t=0; t<update->numSteps; t++) {
+			const double* new_values = &update->new_rows[t][j];
+			const double* old_values = &update->old_rows[t][j];
+			__m512d new_x = _mm512_set1_pd(update->new_rows[t][i]);
+			__m512d old_x = _mm512_set1_pd(update->old_rows[t][i]);
+			xy0 = _mm512_add_pd(xy0, _mm512_fmsub_pd(new_x, _mm512_loadu_pd(new_values), _mm512_mul_pd(old_x, _mm512_loadu_pd(old_values))));
+			xy1 = _mm512_add_pd(xy1, _mm512_fmsub_pd(new_x, _mm512_loadu_pd(new_values+8), _mm512_mul_pd(old_x, _mm512_loadu_pd(old_values+8))));
+			xy2 = _mm512_add_pd(xy2, _mm512_fmsub_pd(new_x, _mm512_loadu_pd(new_values+16), _mm512_mul_pd(old_x, _mm512_loadu_pd(old_values+16))));
+			xy3 = _mm512_add_pd(xy3, _mm512_fmsub_pd(new_x, _mm512_loadu_pd(new_values+24), _mm512_mul_pd(old_x, _mm512_loadu_pd(old_values+24))));
+		}
+
+		_mm512_storeu_pd(sums_xy, xy0);
+		_mm512_storeu_pd(sums_xy+8, xy1);
+		_mm512_storeu_pd(sums_xy+16, xy2);
+		_mm512_storeu_pd(sums_xy+24, xy3);
+	}
+
+	for (; j<j_end; j+=8, sums_xy+=8) {
+
+		__mmask8 lanes_valid = j_end-j >= 8 ? 0xff : (__mmask8)((1u<<(j_end-j))-1);
+		__m512d xy = _mm512_maskz_loadu_pd(lanes_valid, sums_xy);
+
+		for (uint64_t t=0; t<update->numSteps; t++) {
+			const double* new_values = update->new_rows[t];
+			const double* old_values = update->old_rows[t];
+			xy = _mm512_add_pd(xy, _mm512_fmsub_pd(_mm512_set1_pd(new_values[i]), _mm512_maskz_loadu_pd(lanes_valid, &new_values[j]),
+								_mm512_mul_pd(_mm512_set1_pd(old_values[i]), _mm512_maskz_loadu_pd(lanes_valid, &old_values[j]))));
+		}
+
+		_mm512_mask_storeu_pd(sums_xy, lanes_valid, xy);
+	}
+}
+
+#endif /* __x86_64__ */
+
+
+/*
+ * Single precision rows: same updates on float inputs and a float SUM(x,y) triangle, twice the lanes
+ * per vector. Candidates reach the selector as doubles; rounding the threshold to float keeps every
+ * candidate that reaches it, since rounding is monotonic.
+ */
+
+typedef struct {
+	uint64_t numTimeseries;
+	float windowSize;
+	const float* new_values;
+	const float* old_values;
+	const float* sums;
+	const float* inv;
+	float* sums_xy;
+	correlation_topk_t* topk;
+} kernel_step_f32_t;
+
+typedef void (*kernel_row_f32_t) (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end);
+
+
+__attribute__((always_inline))
+static inline void kernel_row_f32_scalar_body (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	float new_x = step->new_values[i];
+	float old_x = step->old_values[i];
+	float sum_x = step->sums[i];
+	float inv_x = step->inv[i];
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	float* sums_xy = &step->sums_xy[index_correlation];
+
+	for (uint64_t j=j_start; j<j_end; j++) {
+
+		*sums_xy += new_x*step->new_values[j] - old_x*step->old_values[j];
+
+		float correlation_step = (step->windowSize*(*sums_xy) - sum_x*step->sums[j])*inv_x*step->inv[j];
+
+		kernel_push (step->topk, correlation_step, index_correlation, j, i, two_sided);
+
+		sums_xy++;
+		index_correlation++;
+	}
+}
+
+static void kernel_row_f32_scalar (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_scalar_body (step, i, j_start, j_end, 0);
+}
+
+static void kernel_row_f32_scalar_ranked (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_scalar_body (step, i, j_start, j_end, 1);
+}
+
+#ifdef __x86_64__
+
+__attribute__((target("sse2"), always_inline))
+static inline void kernel_row_f32_sse2_body (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	__m128 new_x = _mm_set1_ps(step->new_values[i]);
+	__m128 old_x = _mm_set1_ps(step->old_values[i]);
+	__m128 sum_x = _mm_set1_ps(step->sums[i]);
+	__m128 inv_x = _mm_set1_ps(step->inv[i]);
+	__m128 windowSize = _mm_set1_ps(step->windowSize);
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	float* sums_xy = &step->sums_xy[index_correlation];
+	uint64_t j = j_start;
+
+	for (; j+4<=j_end; j+=4, sums_xy+=4, index_correlation+=4) {
+
+		__m128 xy = _mm_add_ps(_mm_loadu_ps(sums_xy), _mm_sub_ps(_mm_mul_ps(new_x, _mm_loadu_ps(&step->new_values[j])),
+										_mm_mul_ps(old_x, _mm_loadu_ps(&step->old_values[j]))));
+		_mm_storeu_ps(sums_xy, xy);
+
+		__m128 correlation_step = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(windowSize, xy), _mm_mul_ps(sum_x, _mm_loadu_ps(&step->sums[j]))),
+								inv_x), _mm_loadu_ps(&step->inv[j]));
+
+		int mask = _mm_movemask_ps(_mm_cmpge_ps(correlation_step, _mm_set1_ps((float)step->topk->threshold)));
+		if (two_sided)
+			mask |= _mm_movemask_ps(_mm_cmple_ps(correlation_step, _mm_set1_ps((float)step->topk->lower)));
+		if (mask) {
+			float lanes[4];
+			_mm_storeu_ps(lanes, correlation_step);
+			for (int l=0; l<4; l++)
+				if (mask & (1<<l))
+					kernel_push (step->topk, lanes[l], index_correlation+l, j+l, i, two_sided);
+		}
+	}
+
+	if (j < j_end)
+		kernel_row_f32_scalar_body (step, i, j, j_end, two_sided);
+}
+
+__attribute__((target("sse2")))
+static void kernel_row_f32_sse2 (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_sse2_body (step, i, j_start, j_end, 0);
+}
+
+__attribute__((target("sse2")))
+static void kernel_row_f32_sse2_ranked (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_sse2_body (step, i, j_start, j_end, 1);
+}
+
+__attribute__((target("avx2,fma"), always_inline))
+static inline void kernel_row_f32_avx2_body (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	__m256 new_x = _mm256_set1_ps(step->new_values[i]);
+	__m256 old_x = _mm256_set1_ps(step->old_values[i]);
+	__m256 sum_x = _mm256_set1_ps(step->sums[i]);
+	__m256 inv_x = _mm256_set1_ps(step->inv[i]);
+	__m256 windowSize = _mm256_set1_ps(step->windowSize);
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	float* sums_xy = &step->sums_xy[index_correlation];
+	uint64_t j = j_start;
+
+	for (; j+8<=j_end; j+=8, sums_xy+=8, index_correlation+=8) {
+
+		__m256 xy = _mm256_add_ps(_mm256_loadu_ps(sums_xy), _mm256_fmsub_ps(new_x, _mm256_loadu_ps(&step->new_values[j]),
+										_mm256_mul_ps(old_x, _mm256_loadu_ps(&step->old_values[j]))));
+		_mm256_storeu_ps(sums_xy, xy);
+
+		__m256 correlation_step = _mm256_mul_ps(_mm256_mul_ps(_mm256_fmsub_ps(windowSize, xy, _mm256_mul_ps(sum_x, _mm256_loadu_ps(&step->sums[j]))),
+								inv_x), _mm256_loadu_ps(&step->inv[j]));
+
+		int mask = _mm256_movemask_ps(_mm256_cmp_ps(correlation_step, _mm256_set1_ps((float)step->topk->threshold), _CMP_GE_OQ));
+		if (two_sided)
+			mask |= _mm256_movemask_ps(_mm256_cmp_ps(correlation_step, _mm256_set1_ps((float)step->topk->lower), _CMP_LE_OQ));
+		if (mask) {
+			float lanes[8];
+			_mm256_storeu_ps(lanes, correlation_step);
+			for (int l=0; l<8; l++)
+				if (mask & (1<<l))
+					kernel_push (step->topk, lanes[l], index_correlation+l, j+l, i, two_sided);
+		}
+	}
+
+	if (j < j_end)
+		kernel_row_f32_scalar_body (step, i, j, j_end, two_sided);
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_row_f32_avx2 (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_avx2_body (step, i, j_start, j_end, 0);
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_row_f32_avx2_ranked (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_avx2_body (step, i, j_start, j_end, 1);
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline void kernel_row_f32_avx512_body (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end, const int two_sided) {
+
+	__m512 new_x = _mm512_set1_ps(step->new_values[i]);
+	__m512 old_x = _mm512_set1_ps(step->old_values[i]);
+	__m512 sum_x = _mm512_set1_ps(step->sums[i]);
+	__m512 inv_x = _mm512_set1_ps(step->inv[i]);
+	__m512 windowSize = _mm512_set1_ps(step->windowSize);
+
+	uint64_t index_correlation = correlation_kernel_index (step->numTimeseries, i, j_start);
+	float* sums_xy = &step->sums_xy[index_correlation];
+
+	for (uint64_t j=j_start; j<j_end; j+=16, sums_xy+=16, index_correlation+=16) {
+
+		// Tail of the row is handled with masked loads and stores
+		__mmask16 lanes_valid = j_end-j >= 16 ? 0xffff : (__mmask16)((1u<<(j_end-j))-1);
+
+		__m512 xy = _mm512_add_ps(_mm512_maskz_loadu_ps(lanes_valid, sums_xy),
+						_mm512_fmsub_ps(new_x, _mm512_maskz_loadu_ps(lanes_valid, &step->new_values[j]),
+								_mm512_mul_ps(old_x, _mm512_maskz_loadu_ps(lanes_valid, &step->old_values[j]))));
+		_mm512_mask_storeu_ps(sums_xy, lanes_valid, xy);
+
+		__m512 correlation_step = _mm512_mul_ps(_mm512_mul_ps(_mm512_fmsub_ps(windowSize, xy,
+											_mm512_mul_ps(sum_x, _mm512_maskz_loadu_ps(lanes_valid, &step->sums[j]))),
+								inv_x), _mm512_maskz_loadu_ps(lanes_valid, &step->inv[j]));
+
+		__mmask16 mask = _mm512_mask_cmp_ps_mask(lanes_valid, correlation_step, _mm512_set1_ps((float)step->topk->threshold), _CMP_GE_OQ);
+		if (two_sided)
+			mask |= _mm512_mask_cmp_ps_mask(lanes_valid, correlation_step, _mm512_set1_ps((float)step->topk->lower), _CMP_LE_OQ);
+		if (mask) {
+			float lanes[16];
+			_mm512_storeu_ps(lanes, correlation_step);
+			for (int l=0; l<16; l++)
+				if (mask & (1<<l))
+					kernel_push (step->topk, lanes[l], index_correlation+l, j+l, i, two_sided);
+		}
+	}
+}
+
+__attribute__((target("avx512f")))
+static void kernel_row_f32_avx512 (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_avx512_body (step, i, j_start, j_end, 0);
+}
+
+__attribute__((target("avx512f")))
+static void kernel_row_f32_avx512_ranked (const kernel_step_f32_t* step, uint64_t i, uint64_t j_start, uint64_t j_end) {
+	kernel_row_f32_avx512_body (step, i, j_start, j_end, 1);
+}
+
+#endif /* __x86_64__ */
+
+
+static int isa_selected = -1;
+
+correlation_isa_t correlation_kernel_detect_isa (void) {
+#ifdef __x86_64__
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return CORRELATION_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return CORRELATION_ISA_AVX2;
+	return CORRELATION_ISA_SSE2;
+#else
+	return CORRELATION_ISA_SCALAR;
+#endif
+}
+
+correlation_isa_t correlation_kernel_get_isa (void) {
+	if (isa_selected < 0)
+		isa_selected = correlation_kernel_detect_isa();
+	return (correlation_isa_t) isa_selected;
+}
+
+correlation_isa_t correlation_kernel_set_isa (correlation_isa_t isa) {
+	correlation_isa_t supported = correlation_kernel_detect_isa();
+	isa_selected = isa < supported ? isa : supported;
+	return (correlation_isa_t) isa_selected;
+}
+
+const char* correlation_kernel_isa_name (correlation_isa_t isa) {
+	switch (isa) {
+		case CORRELATION_ISA_SSE2:	return "sse2";
+		case CORRELATION_ISA_AVX2:	return "avx2";
+		case CORRELATION_ISA_AVX512:	return "avx512";
+		default:			return "scalar";
+	}
+}
+
+static kernel_row_t kernel_row (correlation_isa_t isa, int two_sided) {
+	switch (isa) {
+#ifdef __x86_64__
+		case CORRELATION_ISA_SSE2:	return two_sided ? kernel_row_sse2_ranked : kernel_row_sse2;
+		case CORRELATION_ISA_AVX2:	return two_sided ? kernel_row_avx2_ranked : kernel_row_avx2;
+		case CORRELATION_ISA_AVX512:	return two_sided ? kernel_row_avx512_ranked : kernel_row_avx512;
+#endif
+		default:			return two_sided ? kernel_row_scalar_ranked : kernel_row_scalar;
+	}
+}
+
+
+static kernel_update_row_t kernel_update_row (correlation_isa_t isa) {
+	switch (isa) {
+#ifdef __x86_64__
+		case CORRELATION_ISA_SSE2:	return kernel_update_row_sse2;
+		case CORRELATION_ISA_AVX2:	return kernel_update_row_avx2;
+		case CORRELATION_ISA_AVX512:	return kernel_update_row_avx512;
+#endif
+		default:			return kernel_update_row_scalar;
+	}
+}
+
+static kernel_row_f32_t kernel_row_f32 (correlation_isa_t isa, int two_sided) {
+	switch (isa) {
+#ifdef __x86_64__
+		case CORRELATION_ISA_SSE2:	return two_sided ? kernel_row_f32_sse2_ranked : kernel_row_f32_sse2;
+		case CORRELATION_ISA_AVX2:	return two_sided ? kernel_row_f32_avx2_ranked : kernel_row_f32_avx2;
+		case CORRELATION_ISA_AVX512:	return two_sided ? kernel_row_f32_avx512_ranked : kernel_row_f32_avx512;
+#endif
+		default:			return two_sided ? kernel_row_f32_scalar_ranked : kernel_row_f32_scalar;
+	}
+}
+
+static void kernel_tile (const kernel_step_t* step, kernel_row_t row, const correlation_tile_t* tile) {
+
+	for (uint64_t i=tile->i0; i<tile->i1; i++) {
+
+		uint64_t j_start = i+1 > tile->j0 ? i+1 : tile->j0;
+		if (j_start < tile->j1)
+			row (step, i, j_start, tile->j1);
+	}
+}
+
+void correlation_kernel_step (uint64_t numTimeseries, double windowSize, const double* new_values, const double* old_values,
+				const double* sums, const double* inv, double* sums_xy, correlation_topk_t* topk) {
+
+	kernel_step_t step = {numTimeseries, windowSize, new_values, old_values, sums, inv, sums_xy, topk};
+	kernel_row_t row = kernel_row (correlation_kernel_get_isa(), correlation_topk_two_sided (topk));
+
+	for (uint64_t i0=0; i0<numTimeseries; i0+=correlation_tileRows) {
+
+		uint64_t i1 = i0+correlation_tileRows < numTimeseries ? i0+correlation_tileRows : numTimeseries;
+
+		for (uint64_t j0=i0+1; j0<numTimeseries; j0+=correlation_tileColumns) {
+
+			correlation_tile_t tile = {i0, i1, j0, j0+correlation_tileColumns < numTimeseries ? j0+correlation_tileColumns : numTimeseries};
+			kernel_tile (&step, row, &tile);
+		}
+	}
+}
+
+void correlation_kernel_step_tiles (uint64_t numTimeseries, double windowSize, const double* new_values, const double* old_values,
+					const double* sums, const double* inv, double* sums_xy,
+					const correlation_tile_t* tiles, uint64_t numTiles, correlation_topk_t* topk) {
+
+	kernel_step_t step = {numTimeseries, windowSize, new_values, old_values, sums, inv, sums_xy, topk};
+	kernel_row_t row = kernel_row (correlation_kernel_get_isa(), correlation_topk_two_sided (topk));
+
+	for (uint64_t t=0; t<numTiles; t++)
+		kernel_tile (&step, row, &tiles[t]);
+}
+
+void correlation_kernel_update_tiles (uint64_t numTimeseries, const double* const* new_rows, const double* const* old_rows, uint64_t numSteps,
+					double* sums_xy, const correlation_tile_t* tiles, uint64_t numTiles) {
+
+	kernel_update_t update = {numTimeseries, new_rows, old_rows, numSteps, sums_xy};
+	kernel_update_row_t row = kernel_update_row (correlation_kernel_get_isa());
+
+	for (uint64_t t=0; t<numTiles; t++) {
+
+		const correlation_tile_t* tile = &tiles[t];
+
+		for (uint64_t i=tile->i0; i<tile->i1; i++) {
+
+			uint64_t j_start = i+1 > tile->j0 ? i+1 : tile->j0;
+			if (j_start < tile->j1)
+				row (&update, i, j_start, tile->j1);
+		}
+	}
+}
+
+void correlation_kernel_step_tiles_f32 (uint64_t numTimeseries, float windowSize, const float* new_values, const float* old_values,
+					const float* sums, const float* inv, float* sums_xy,
+					const correlation_tile_t* tiles, uint64_t numTiles, correlation_topk_t* topk) {
+
+	kernel_step_f32_t step = {numTimeseries, windowSize, new_values, old_values, sums, inv, sums_xy, topk};
+	kernel_row_f32_t row = kernel_row_f32 (correlation_kernel_get_isa(), correlation_topk_two_sided (topk));
+
+	for (uint64_t t=0; t<numTiles; t++) {
+
+		const correlation_tile_t* tile = &tiles[t];
+
+		for (uint64_t i=tile->i0; i<tile->i1; i++) {
+
+			uint64_t j_start = i+1 > tile->j0 ? i+1 : tile->j0;
+			if (j_start < tile->j1)
+				row (&step, i, j_start, tile->j1);
+		}
+	}
+}
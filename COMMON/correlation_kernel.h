@@ -0,0 +1,137 @@
+/**
+ * File: correlation_kernel.h
+ * Purpose: pair kernel updating SUM(x,y) for one timestep and selecting the top correlations
+ *
+ * Correlation formula:
+ *	scalar r(x,y) = (n*SUM(x,y) 	- SUM(x)*SUM(y))*SQRT_INVERSE(x)*SQRT_INVERSE(y)
+ *
+ * SUM(x,y) of all pairs is kept in a packed upper triangle: pair (i,j), i<j, is stored at
+ * index_correlation = i*numTimeseries - i*(i+1)/2 + (j-i-1), i.e. row by row as in ORIG and SPLIT.
+ *
+ * The triangle is walked in tiles of correlation_tileRows x correlation_tileColumns pairs, so the
+ * per-series inputs of one tile stay in L1 while its rows of SUM(x,y) are streamed.
+ *
+ * Tile rows are computed with the widest instruction set the CPU supports (detected once via cpuid),
+ * unless a narrower one is requested with correlation_kernel_set_isa. FMA is used from AVX2 upwards, so
+ * results may differ from the scalar kernel in the last bit.
+ *
+ * correlation_kernel_update_tiles adds a batch of timesteps (a rank-2T update) to SUM(x,y) while every
+ * run of the triangle is held in registers, for steps whose correlations are not needed.
+ *
+ * correlation_kernel_step_tiles_f32 is the single precision variant: half the memory traffic over the
+ * triangle and twice the lanes per vector, at float accuracy (see correlation_session_f32.h).
+ *
+ */
+
+#ifndef CORRELATION_KERNEL_H
+#define CORRELATION_KERNEL_H
+
+#include <stdint.h>
+
+#include "correlation_topk.h"
+
+typedef enum {
+	CORRELATION_ISA_SCALAR = 0,
+	CORRELATION_ISA_SSE2,
+	CORRELATION_ISA_AVX2,
+	CORRELATION_ISA_AVX512
+} correlation_isa_t;
+
+// Rows i0 <= i < i1 and columns j0 <= j < j1 of the triangle; only pairs with j > i belong to the tile
+typedef struct {
+	uint64_t i0, i1;
+	uint64_t j0, j1;
+} correlation_tile_t;
+
+#ifndef correlation_tileRows
+#define correlation_tileRows (32)
+#endif
+
+#ifndef correlation_tileColumns
+#define correlation_tileColumns (512)
+#endif
+
+
+/* Index of pair (i,j), i<j, in the packed triangle */
+static inline uint64_t correlation_kernel_index (uint64_t numTimeseries, uint64_t i, uint64_t j) {
+	return i*numTimeseries - (i*(i+1))/2 + (j-i-1);
+}
+
+/* Number of pairs in a tile */
+static inline uint64_t correlation_kernel_tile_pairs (const correlation_tile_t* tile) {
+	uint64_t numPairs = 0;
+	for (uint64_t i=tile->i0; i<tile->i1; i++) {
+		uint64_t j_start = i+1 > tile->j0 ? i+1 : tile->j0;
+		numPairs += j_start < tile->j1 ? tile->j1-j_start : 0;
+	}
+	return numPairs;
+}
+
+/* Widest instruction set supported by the CPU */
+correlation_isa_t correlation_kernel_detect_isa (void);
+
+/* Instruction set used by correlation_kernel_step */
+correlation_isa_t correlation_kernel_get_isa (void);
+
+/* Request an instruction set, limited to what the CPU supports. Returns the one that will be used. */
+correlation_isa_t correlation_kernel_set_isa (
+	correlation_isa_t isa		/* Requested instruction set */
+);
+
+/* Name of an instruction set */
+const char* correlation_kernel_isa_name (
+	correlation_isa_t isa		/* Instruction set */
+);
+
+/* Update SUM(x,y) of all pairs with one timestep and push every correlation into topk */
+void correlation_kernel_step (
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	double windowSize,		/* Window for correlation */
+	const double* new_values,	/* x[s] of every Timeseries */
+	const double* old_values,	/* x[s-n] of every Timeseries, 0 while s<n */
+	const double* sums,		/* SUM(x) of every Timeseries */
+	const double* inv,		/* SQRT_INVERSE(x) of every Timeseries */
+	double* sums_xy,		/* Packed triangle of SUM(x,y) */
+	correlation_topk_t* topk	/* Selector receiving all correlations */
+);
+
+/* Same as correlation_kernel_step, restricted to a list of tiles */
+void correlation_kernel_step_tiles (
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	double windowSize,			/* Window for correlation */
+	const double* new_values,		/* x[s] of every Timeseries */
+	const double* old_values,		/* x[s-n] of every Timeseries, 0 while s<n */
+	const double* sums,			/* SUM(x) of every Timeseries */
+	const double* inv,			/* SQRT_INVERSE(x) of every Timeseries */
+	double* sums_xy,			/* Packed triangle of SUM(x,y) */
+	const correlation_tile_t* tiles,	/* Tiles to compute */
+	uint64_t numTiles,			/* Number of tiles */
+	correlation_topk_t* topk		/* Selector receiving the correlations of the tiles */
+);
+
+/* Add numSteps timesteps to SUM(x,y) of the tiles at once, without evaluating correlations */
+void correlation_kernel_update_tiles (
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	const double* const* new_rows,		/* x[s] of every Timeseries, for each of the timesteps */
+	const double* const* old_rows,		/* x[s-n] of every Timeseries, for each of the timesteps */
+	uint64_t numSteps,			/* Number of timesteps */
+	double* sums_xy,			/* Packed triangle of SUM(x,y) */
+	const correlation_tile_t* tiles,	/* Tiles to update */
+	uint64_t numTiles			/* Number of tiles */
+);
+
+/* Single precision correlation_kernel_step_tiles, on float inputs and a float SUM(x,y) triangle */
+void correlation_kernel_step_tiles_f32 (
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	float windowSize,			/* Window for correlation */
+	const float* new_values,		/* x[s] of every Timeseries */
+	const float* old_values,		/* x[s-n] of every Timeseries, 0 while s<n */
+	const float* sums,			/* SUM(x) of every Timeseries */
+	const float* inv,			/* SQRT_INVERSE(x) of every Timeseries */
+	float* sums_xy,				/* Packed triangle of SUM(x,y) */
+	const correlation_tile_t* tiles,	/* Tiles to compute */
+	uint64_t numTiles,			/* Number of tiles */
+	correlation_topk_t* topk		/* Selector receiving the correlations of the tiles */
+);
+
+#endif /* CORRELATION_KERNEL_H */
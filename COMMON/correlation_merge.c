@@ -0,0 +1,191 @@
+/**
+ * File: correlation_merge.c
+ * Purpose: top-K selection from the per-pipe candidates the DFE writes for every timestep
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "correlation_merge.h"
+#include "correlation_kernel.h"
+
+// Best score of a group; NaN never wins
+typedef double (*group_max_t) (const double* correlations, uint64_t numCorrelations);
+
+// Offer candidates reaching the bound, or the K-th kept score once that is higher
+typedef void (*filter_t) (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, double bound);
+
+
+static double group_max_scalar (const double* correlations, uint64_t numCorrelations) {
+
+	double best = -INFINITY;
+	for (uint64_t i=0; i<numCorrelations; i++)
+		if (correlations[i] > best)
+			best = correlations[i];
+	return best;
+}
+
+// Without wide vectors the bound saves little over the SSE2 reject of the selector
+static void filter_scalar (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, double bound) {
+	(void) bound;
+	correlation_topk_push_array (topk, correlations, indices, numCorrelations, 0);
+}
+
+#ifdef __x86_64__
+
+__attribute__((target("avx2")))
+static double group_max_avx2 (const double* correlations, uint64_t numCorrelations) {
+
+	__m256d best_0 = _mm256_set1_pd(-INFINITY);
+	__m256d best_1 = best_0;
+	uint64_t i = 0;
+
+	// max_pd returns its second operand if either is NaN
+	for (; i+8 <= numCorrelations; i+=8) {
+		best_0 = _mm256_max_pd(_mm256_loadu_pd(&correlations[i]), best_0);
+		best_1 = _mm256_max_pd(_mm256_loadu_pd(&correlations[i+4]), best_1);
+	}
+	__m256d best_v = _mm256_max_pd(best_0, best_1);
+	__m128d best_2 = _mm_max_pd(_mm256_castpd256_pd128(best_v), _mm256_extractf128_pd(best_v, 1));
+	double best = _mm_cvtsd_f64(_mm_max_sd(best_2, _mm_unpackhi_pd(best_2, best_2)));
+
+	double rest = group_max_scalar (&correlations[i], numCorrelations-i);
+	return rest > best ? rest : best;
+}
+
+__attribute__((target("avx2")))
+static void filter_avx2 (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, double bound) {
+
+	uint64_t i = 0;
+
+	for (; i+8 <= numCorrelations; i+=8) {
+		__m256d floor = _mm256_set1_pd(topk->threshold > bound ? topk->threshold : bound);
+		int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(&correlations[i]), floor, _CMP_GE_OQ))
+			| _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(&correlations[i+4]), floor, _CMP_GE_OQ)) << 4;
+		while (mask) {
+			uint64_t k = i + __builtin_ctz(mask);
+			correlation_topk_push_top (topk, correlations[k], k, indices[2*k], indices[2*k+1]);
+			mask &= mask-1;
+		}
+	}
+
+	for (; i<numCorrelations; i++)
+		if (correlations[i] >= bound)
+			correlation_topk_push_top (topk, correlations[i], i, indices[2*i], indices[2*i+1]);
+}
+
+__attribute__((target("avx512f")))
+static double group_max_avx512 (const double* correlations, uint64_t numCorrelations) {
+
+	__m512d best_0 = _mm512_set1_pd(-INFINITY);
+	__m512d best_1 = best_0;
+	uint64_t i = 0;
+
+	for (; i+16 <= numCorrelations; i+=16) {
+		best_0 = _mm512_max_pd(_mm512_loadu_pd(&correlations[i]), best_0);
+		best_1 = _mm512_max_pd(_mm512_loadu_pd(&correlations[i+8]), best_1);
+	}
+	double best = _mm512_reduce_max_pd(_mm512_max_pd(best_0, best_1));
+
+	double rest = group_max_scalar (&correlations[i], numCorrelations-i);
+	return rest > best ? rest : best;
+}
+
+__attribute__((target("avx512f")))
+static void filter_avx512 (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, double bound) {
+
+	uint64_t i = 0;
+
+	for (; i+16 <= numCorrelations; i+=16) {
+		__m512d floor = _mm512_set1_pd(topk->threshold > bound ? topk->threshold : bound);
+		unsigned mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(&correlations[i]), floor, _CMP_GE_OQ)
+			| (unsigned)_mm512_cmp_pd_mask(_mm512_loadu_pd(&correlations[i+8]), floor, _CMP_GE_OQ) << 8;
+		while (mask) {
+			uint64_t k = i + __builtin_ctz(mask);
+			correlation_topk_push_top (topk, correlations[k], k, indices[2*k], indices[2*k+1]);
+			mask &= mask-1;
+		}
+	}
+
+	for (; i<numCorrelations; i++)
+		if (correlations[i] >= bound)
+			correlation_topk_push_top (topk, correlations[i], i, indices[2*i], indices[2*i+1]);
+}
+
+#endif /* __x86_64__ */
+
+static void merge_functions (group_max_t* group_max, filter_t* filter) {
+	switch (correlation_kernel_get_isa()) {
+#ifdef __x86_64__
+		case CORRELATION_ISA_AVX2:	*group_max = group_max_avx2; *filter = filter_avx2; break;
+		case CORRELATION_ISA_AVX512:	*group_max = group_max_avx512; *filter = filter_avx512; break;
+#endif
+		default:			*group_max = group_max_scalar; *filter = filter_scalar; break;
+	}
+}
+
+static void merge (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, group_max_t group_max, filter_t filter) {
+
+	uint64_t numGroups = topk->numTopScores;
+	double bound = -INFINITY;
+
+	// The bound holds for the top ranking only; the DFE has no candidates for the others anyway
+	if (correlation_topk_two_sided (topk)) {
+		correlation_topk_push_array (topk, correlations, indices, numCorrelations, 0);
+		return;
+	}
+
+	// Winners of K disjoint groups at the head of the step: the K-th best score is at least the worst of them
+	if (numCorrelations >= numGroups*correlation_mergeGroupSize) {
+		bound = INFINITY;
+		for (uint64_t g=0; g<numGroups; g++) {
+			double best = group_max (&correlations[g*correlation_mergeGroupSize], correlation_mergeGroupSize);
+			if (best < bound)
+				bound = best;
+		}
+	}
+
+	filter (topk, correlations, indices, numCorrelations, bound);
+}
+
+void correlation_merge (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations) {
+
+	group_max_t group_max;
+	filter_t filter;
+
+	merge_functions (&group_max, &filter);
+	merge (topk, correlations, indices, numCorrelations, group_max, filter);
+}
+
+void correlation_merge_steps (const double* correlations, const uint32_t* indices, uint64_t numSteps, uint64_t numCorrelations, int numTopScores,
+				double* correlations_top, uint32_t* indices_top) {
+
+	group_max_t group_max;
+	filter_t filter;
+
+	merge_functions (&group_max, &filter);
+
+	#pragma omp parallel if (numSteps > 1)
+	{
+		correlation_topk_t topk;
+		correlation_topk_init (&topk, numTopScores);
+
+		#pragma omp for schedule(static)
+		for (uint64_t s=0; s<numSteps; s++) {
+			correlation_topk_reset (&topk);
+			merge (&topk, &correlations[s*numCorrelations], &indices[2*s*numCorrelations], numCorrelations, group_max, filter);
+
+			// Fewer than numTopScores candidates leave the rest of the output as it was, like topCorrelations
+			correlation_topk_result (&topk, &correlations_top[s*numTopScores], &indices_top[2*s*numTopScores]);
+		}
+
+		correlation_topk_free (&topk);
+	}
+}
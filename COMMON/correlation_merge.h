@@ -0,0 +1,49 @@
+/**
+ * File: correlation_merge.h
+ * Purpose: top-K selection from the per-pipe candidates the DFE writes for every timestep
+ *
+ * Every timestep of a DFE run writes loopLength * numTopScores * numPipes candidates, the top scores
+ * of every pipe for every loop iteration. Only numTopScores of them are kept, so the merge is a
+ * filter. A tournament of vector max operations finds the best candidate of each of numTopScores
+ * groups at the head of the step; the worst of these winners is a lower bound for the K-th score,
+ * as there are K candidates at least that good. One vector pass then offers a selector only the
+ * candidates reaching the bound, or the K-th score kept so far once that is higher, so the pass
+ * runs at the speed of memory and nearly all candidates are rejected a whole vector at a time.
+ *
+ * The result is the one of topCorrelations on the same candidates, ties included. Timesteps are
+ * merged in parallel, one selector per thread. The widest instruction set of correlation_kernel is
+ * used.
+ *
+ */
+
+#ifndef CORRELATION_MERGE_H
+#define CORRELATION_MERGE_H
+
+#include <stdint.h>
+
+#include "correlation_topk.h"
+
+// Candidates per group of the tournament, two AVX-512 vectors
+#define correlation_mergeGroupSize (16)
+
+
+/* Offer the candidates of one timestep to a selector, skipping those that cannot reach its top K */
+void correlation_merge (
+	correlation_topk_t* topk,	/* Selector */
+	const double* correlations,	/* Candidate correlations */
+	const uint32_t* indices,	/* Pairs of indices, 2 per candidate */
+	uint64_t numCorrelations	/* Number of candidates */
+);
+
+/* Top numTopScores correlations of each of numSteps timesteps of numCorrelations candidates each */
+void correlation_merge_steps (
+	const double* correlations,	/* Candidate correlations, timestep after timestep */
+	const uint32_t* indices,	/* Pairs of indices, 2 per candidate */
+	uint64_t numSteps,		/* Number of timesteps */
+	uint64_t numCorrelations,	/* Number of candidates per timestep */
+	int numTopScores,		/* Number of top correlations per timestep */
+	double* correlations_top,	/* Output top correlations (numTopScores per timestep) */
+	uint32_t* indices_top		/* Output corresponding pairs of indices (2*numTopScores per timestep) */
+);
+
+#endif /* CORRELATION_MERGE_H */
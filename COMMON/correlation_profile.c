@@ -0,0 +1,174 @@
+/**
+ * File: correlation_profile.c
+ * Purpose: time and hardware counters of the phases of a correlation run
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+#include "correlation_profile.h"
+
+// Hardware counters, in the order of counter_configs
+#define profile_numCounters (3)
+
+typedef struct {
+	double seconds;
+	uint64_t ticks;
+	uint64_t counts[profile_numCounters];
+} sample_t;
+
+static int enabled = 0;
+static int counter_fds[profile_numCounters] = {-1, -1, -1};
+static correlation_profile_t totals;
+static sample_t starts[CORRELATION_NUM_PHASES];
+
+#ifdef __linux__
+static const uint64_t counter_configs[profile_numCounters] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES
+};
+#endif
+
+
+static void close_counters (void) {
+	for (int c=0; c<profile_numCounters; c++) {
+		if (counter_fds[c] >= 0)
+			close (counter_fds[c]);
+		counter_fds[c] = -1;
+	}
+	totals.counters = 0;
+}
+
+// All counters or none: IPC needs both cycles and instructions
+static int open_counters (void) {
+#ifdef __linux__
+	for (int c=0; c<profile_numCounters; c++) {
+		struct perf_event_attr attr;
+		memset (&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = counter_configs[c];
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		counter_fds[c] = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (counter_fds[c] < 0) {
+			close_counters();
+			return 0;
+		}
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void sample (sample_t* s) {
+
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	s->seconds = ts.tv_sec + 1e-9 * ts.tv_nsec;
+
+#ifdef __x86_64__
+	s->ticks = __rdtsc();
+#else
+	s->ticks = 0;
+#endif
+
+	for (int c=0; c<profile_numCounters; c++) {
+		s->counts[c] = 0;
+		if (counter_fds[c] >= 0 && read (counter_fds[c], &s->counts[c], sizeof(uint64_t)) != sizeof(uint64_t))
+			s->counts[c] = 0;
+	}
+}
+
+int correlation_profile_enable (int counters) {
+
+	if (enabled)
+		correlation_profile_disable();
+
+	totals.counters = counters && open_counters();
+	enabled = 1;
+
+	return totals.counters;
+}
+
+void correlation_profile_disable (void) {
+	close_counters();
+	enabled = 0;
+}
+
+void correlation_profile_reset (void) {
+	memset (totals.phases, 0, sizeof(totals.phases));
+}
+
+void correlation_profile_begin (correlation_phase_t phase) {
+	if (enabled)
+		sample (&starts[phase]);
+}
+
+void correlation_profile_end (correlation_phase_t phase) {
+
+	if (!enabled)
+		return;
+
+	sample_t end;
+	sample (&end);
+
+	correlation_phase_profile_t* p = &totals.phases[phase];
+	p->calls++;
+	p->seconds += end.seconds - starts[phase].seconds;
+	p->ticks += end.ticks - starts[phase].ticks;
+	p->cycles += end.counts[0] - starts[phase].counts[0];
+	p->instructions += end.counts[1] - starts[phase].counts[1];
+	p->llcMisses += end.counts[2] - starts[phase].counts[2];
+}
+
+void correlation_profile_get (correlation_profile_t* profile) {
+	*profile = totals;
+}
+
+const char* correlation_profile_phase_name (correlation_phase_t phase) {
+	switch (phase) {
+		case CORRELATION_PHASE_REORDER:		return "reorder";
+		case CORRELATION_PHASE_LMEM_LOAD:	return "lmem_load";
+		case CORRELATION_PHASE_DFE_RUN:		return "dfe_run";
+		case CORRELATION_PHASE_SORT:		return "sort";
+		case CORRELATION_PHASE_UNPACK:		return "unpack";
+		default:				return "unknown";
+	}
+}
+
+void correlation_profile_dump (FILE* out) {
+
+	fprintf(out, "{\"counters\": %s, \"phases\": {", totals.counters ? "true" : "false");
+
+	for (int phase=0; phase<CORRELATION_NUM_PHASES; phase++) {
+		const correlation_phase_profile_t* p = &totals.phases[phase];
+
+		fprintf(out, "%s\n  \"%s\": {\"calls\": %lu, \"seconds\": %.9f, \"ticks\": %lu",
+			phase ? "," : "", correlation_profile_phase_name (phase), p->calls, p->seconds, p->ticks);
+		if (totals.counters)
+			fprintf(out, ", \"cycles\": %lu, \"instructions\": %lu, \"ipc\": %.3f, \"llc_misses\": %lu",
+				p->cycles, p->instructions, p->cycles ? (double) p->instructions / p->cycles : 0.0, p->llcMisses);
+		fprintf(out, "}");
+	}
+
+	fprintf(out, "\n}}\n");
+}
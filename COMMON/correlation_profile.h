@@ -0,0 +1,89 @@
+/**
+ * File: correlation_profile.h
+ * Purpose: time and hardware counters of the phases of a correlation run
+ *
+ * The host code of a run is cut into named phases: encoding the DFE streams, loading LMem, the DFE
+ * run, selecting the top correlations and unpacking the output. Every phase entered between
+ * correlation_profile_begin and correlation_profile_end adds to its totals:
+ *	calls		- times the phase was entered
+ *	seconds		- wall time, from clock_gettime(CLOCK_MONOTONIC)
+ *	ticks		- time stamp counter ticks (rdtsc), 0 off x86
+ *	cycles, instructions, llcMisses - user space hardware counters from perf_event_open, 0 without them
+ *
+ * Until correlation_profile_enable, begin and end only test a flag. The counters follow the calling
+ * thread and the threads it creates afterwards, so they include the OpenMP threads only when
+ * profiling is enabled before the first parallel region. They are left out when the kernel does not
+ * allow them (perf_event_paranoid) or when they are not asked for.
+ *
+ * Phases are entered and left by the thread driving the run, not inside parallel regions. Different
+ * phases may nest or overlap, a phase may not be entered again before it is left.
+ *
+ */
+
+#ifndef CORRELATION_PROFILE_H
+#define CORRELATION_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum {
+	CORRELATION_PHASE_REORDER = 0,	/* Encoding the DFE input streams */
+	CORRELATION_PHASE_LMEM_LOAD,	/* Initializing SUM(x,y) in LMem */
+	CORRELATION_PHASE_DFE_RUN,	/* Running, or waiting for, the DFE */
+	CORRELATION_PHASE_SORT,		/* Top correlations from the DFE candidates */
+	CORRELATION_PHASE_UNPACK,	/* Correlations from DFE order into the output */
+	CORRELATION_NUM_PHASES
+} correlation_phase_t;
+
+typedef struct {
+	uint64_t calls;			/* Times the phase was entered */
+	double seconds;			/* Wall time */
+	uint64_t ticks;			/* Time stamp counter ticks */
+	uint64_t cycles;		/* Core cycles */
+	uint64_t instructions;		/* Instructions retired */
+	uint64_t llcMisses;		/* Last level cache misses */
+} correlation_phase_profile_t;
+
+typedef struct {
+	int counters;						/* Hardware counters were collected */
+	correlation_phase_profile_t phases[CORRELATION_NUM_PHASES];	/* Totals of every phase */
+} correlation_profile_t;
+
+
+/* Start collecting, with the hardware counters if asked for and available; returns whether they are */
+int correlation_profile_enable (
+	int counters			/* Collect hardware counters as well as time */
+);
+
+/* Stop collecting and close the counters; the totals are kept */
+void correlation_profile_disable (void);
+
+/* Zero the totals of all phases */
+void correlation_profile_reset (void);
+
+/* Enter a phase */
+void correlation_profile_begin (
+	correlation_phase_t phase	/* Phase */
+);
+
+/* Leave a phase, adding to its totals */
+void correlation_profile_end (
+	correlation_phase_t phase	/* Phase */
+);
+
+/* Totals of all phases so far */
+void correlation_profile_get (
+	correlation_profile_t* profile	/* Output totals */
+);
+
+/* Name of a phase, as in the JSON dump */
+const char* correlation_profile_phase_name (
+	correlation_phase_t phase	/* Phase */
+);
+
+/* Totals of all phases as a JSON object, with instructions per cycle where counters were collected */
+void correlation_profile_dump (
+	FILE* out			/* Output stream */
+);
+
+#endif /* CORRELATION_PROFILE_H */
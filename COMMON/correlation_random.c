@@ -0,0 +1,143 @@
+/**
+ * File: correlation_random.c
+ * Purpose: reproducible synthetic timeseries, with planted correlations to check results against
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "correlation_random.h"
+
+// Philox4x32 multipliers and Weyl key increments
+#define philox_M0 (0xD2511F53u)
+#define philox_M1 (0xCD9E8D57u)
+#define philox_W0 (0x9E3779B9u)
+#define philox_W1 (0xBB67AE85u)
+
+// Counter words: timestep (2), timeseries or block, stream
+#define random_streamNoise (0)
+#define random_streamFactor (1)
+
+
+static void philox (uint32_t counter[4], uint64_t seed) {
+
+	uint32_t k0 = (uint32_t) seed;
+	uint32_t k1 = (uint32_t) (seed >> 32);
+
+	for (int round=0; round<10; round++) {
+		uint64_t p0 = (uint64_t) philox_M0 * counter[0];
+		uint64_t p1 = (uint64_t) philox_M1 * counter[2];
+
+		uint32_t c0 = (uint32_t) (p1 >> 32) ^ counter[1] ^ k0;
+		uint32_t c2 = (uint32_t) (p0 >> 32) ^ counter[3] ^ k1;
+		counter[1] = (uint32_t) p1;
+		counter[3] = (uint32_t) p0;
+		counter[0] = c0;
+		counter[2] = c2;
+
+		k0 += philox_W0;
+		k1 += philox_W1;
+	}
+}
+
+// 53 random bits per value: uniform in [0, 1)
+static double uniform (uint32_t hi, uint32_t lo) {
+	return (double) ((((uint64_t) hi << 32) | lo) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void block (uint64_t seed, uint64_t timestep, uint64_t index, uint32_t stream, uint32_t out[4]) {
+	out[0] = (uint32_t) timestep;
+	out[1] = (uint32_t) (timestep >> 32);
+	out[2] = (uint32_t) index;
+	out[3] = stream;
+	philox (out, seed);
+}
+
+// Box-Muller on the two uniforms of one block, the first in (0, 1] so that its log is finite
+static double normal (uint64_t seed, uint64_t timestep, uint64_t index, uint32_t stream) {
+
+	uint32_t bits[4];
+	block (seed, timestep, index, stream, bits);
+
+	double u = 1.0 - uniform (bits[0], bits[1]);
+	double v = uniform (bits[2], bits[3]);
+	return sqrt (-2.0 * log (u)) * cos (2.0 * M_PI * v);
+}
+
+void correlation_random_init (correlation_random_t* model, uint64_t seed) {
+	model->seed = seed;
+	model->numBlocks = 0;
+	model->blockSize = 0;
+	model->correlation = 0;
+}
+
+void correlation_random_plant (correlation_random_t* model, uint64_t numBlocks, uint64_t blockSize, double correlation) {
+
+	if (blockSize < 2 || correlation < 0 || correlation >= 1) {
+		fprintf(stderr, "Planted blocks need at least 2 timeseries and a correlation in [0, 1). Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	model->numBlocks = numBlocks;
+	model->blockSize = blockSize;
+	model->correlation = correlation;
+}
+
+double correlation_random_value (const correlation_random_t* model, uint64_t series, uint64_t timestep) {
+
+	if (model->numBlocks == 0) {
+		uint32_t bits[4];
+		block (model->seed, timestep, series, random_streamNoise, bits);
+		return uniform (bits[0], bits[1]);
+	}
+
+	double noise = normal (model->seed, timestep, series, random_streamNoise);
+	if (series >= model->numBlocks*model->blockSize)
+		return noise;
+
+	double factor = normal (model->seed, timestep, series % model->numBlocks, random_streamFactor);
+	return sqrt (model->correlation) * factor + sqrt (1 - model->correlation) * noise;
+}
+
+void correlation_random_series (const correlation_random_t* model, double** data, uint64_t numTimeseries, uint64_t first, uint64_t numSteps) {
+
+	#pragma omp parallel for schedule(static)
+	for (uint64_t i=0; i<numTimeseries; i++)
+		for (uint64_t s=0; s<numSteps; s++)
+			data[i][s] = correlation_random_value (model, i, first+s);
+}
+
+void correlation_random_rows (const correlation_random_t* model, double* data, uint64_t numTimeseries, uint64_t first, uint64_t numSteps) {
+
+	#pragma omp parallel for schedule(static)
+	for (uint64_t s=0; s<numSteps; s++)
+		for (uint64_t i=0; i<numTimeseries; i++)
+			data[s*numTimeseries + i] = correlation_random_value (model, i, first+s);
+}
+
+double correlation_random_planted (const correlation_random_t* model, uint64_t i, uint64_t j) {
+
+	uint64_t numPlanted = model->numBlocks*model->blockSize;
+
+	if (i < numPlanted && j < numPlanted && i % model->numBlocks == j % model->numBlocks)
+		return model->correlation;
+	return 0;
+}
+
+uint64_t correlation_random_num_planted (const correlation_random_t* model, uint64_t numTimeseries) {
+
+	uint64_t numPairs = 0;
+
+	for (uint64_t b=0; b<model->numBlocks && b<numTimeseries; b++) {
+		uint64_t numMembers = (numTimeseries - b + model->numBlocks - 1) / model->numBlocks;
+		if (numMembers > model->blockSize)
+			numMembers = model->blockSize;
+		numPairs += numMembers*(numMembers-1)/2;
+	}
+
+	return numPairs;
+}
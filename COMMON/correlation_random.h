@@ -0,0 +1,86 @@
+/**
+ * File: correlation_random.h
+ * Purpose: reproducible synthetic timeseries, with planted correlations to check results against
+ *
+ * Values come from Philox4x32-10, a counter-based generator: element s of timeseries i is a pure
+ * function of (seed, i, s), so any part of the data can be generated by any thread, in any order and
+ * in any chunks, and is the same on every run and platform with the same seed.
+ *
+ * Without planted blocks every element is uniform in [0, 1), like the rand() data the programs used
+ * to generate. With numBlocks blocks of blockSize timeseries planted, all elements follow a factor
+ * model with standard normal noise e and factors f:
+ *	x_i[s] = sqrt(r)*f_b[s] + sqrt(1-r)*e_i[s]	for timeseries i of block b
+ *	x_i[s] = e_i[s]					for the others
+ * so two timeseries of the same block have correlation r and all other pairs 0. Block b holds
+ * timeseries b, b+numBlocks, b+2*numBlocks, ..., so planted pairs are spread over the whole
+ * triangle. Over a window of n timesteps sample correlations scatter by about 1/sqrt(n) around the
+ * planted ones; with r well above that the top correlations are the planted pairs.
+ *
+ */
+
+#ifndef CORRELATION_RANDOM_H
+#define CORRELATION_RANDOM_H
+
+#include <stdint.h>
+
+typedef struct {
+	uint64_t seed;			/* Key of the generator */
+	uint64_t numBlocks;		/* Blocks of correlated timeseries, 0 for uniform noise */
+	uint64_t blockSize;		/* Timeseries per block */
+	double correlation;		/* Correlation of the pairs within a block, 0 <= r < 1 */
+} correlation_random_t;
+
+
+/* Uniform noise in [0, 1) for the given seed */
+void correlation_random_init (
+	correlation_random_t* model,	/* Model */
+	uint64_t seed			/* Seed */
+);
+
+/* Plant numBlocks blocks of blockSize timeseries correlated by correlation */
+void correlation_random_plant (
+	correlation_random_t* model,	/* Model */
+	uint64_t numBlocks,		/* Number of blocks */
+	uint64_t blockSize,		/* Timeseries per block, at least 2 */
+	double correlation		/* Correlation within a block */
+);
+
+/* Element timestep of timeseries series */
+double correlation_random_value (
+	const correlation_random_t* model,	/* Model */
+	uint64_t series,			/* Timeseries */
+	uint64_t timestep			/* Timestep */
+);
+
+/* Timesteps [first, first+numSteps) of every timeseries, one row per timeseries (data[i][s]) */
+void correlation_random_series (
+	const correlation_random_t* model,	/* Model */
+	double** data,				/* Output, numSteps values per Timeseries */
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	uint64_t first,				/* First timestep */
+	uint64_t numSteps			/* Number of timesteps */
+);
+
+/* Timesteps [first, first+numSteps) of every timeseries, time-major (data[s*numTimeseries + i]) */
+void correlation_random_rows (
+	const correlation_random_t* model,	/* Model */
+	double* data,				/* Output, numSteps*numTimeseries values */
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	uint64_t first,				/* First timestep */
+	uint64_t numSteps			/* Number of timesteps */
+);
+
+/* Planted correlation of timeseries i and j, i != j */
+double correlation_random_planted (
+	const correlation_random_t* model,	/* Model */
+	uint64_t i,				/* First Timeseries */
+	uint64_t j				/* Second Timeseries */
+);
+
+/* Number of pairs with a planted correlation among numTimeseries */
+uint64_t correlation_random_num_planted (
+	const correlation_random_t* model,	/* Model */
+	uint64_t numTimeseries			/* Number of Timeseries */
+);
+
+#endif /* CORRELATION_RANDOM_H */
@@ -0,0 +1,145 @@
+/**
+ * File: correlation_session.c
+ * Purpose: streaming correlation, one cross-section of all timeseries at a time
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "correlation_session.h"
+
+
+void correlation_session_init (correlation_session_t* session, uint64_t numTimeseries, uint64_t windowSize, int numTopScores, unsigned rankings, int numThreads,
+				correlation_arena_t* arena) {
+
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	session->numTimeseries = numTimeseries;
+	session->windowSize = windowSize;
+	session->numTopScores = numTopScores;
+	session->numScores = numTopScores*correlation_topk_num_ranks (rankings);
+
+	session->sums = (double*) calloc (numTimeseries, sizeof(double));
+	session->sums_sq = (double*) calloc (numTimeseries, sizeof(double));
+	session->inv = (double*) malloc (numTimeseries*sizeof(double));
+
+	correlation_window_init (&session->window, numTimeseries, windowSize);
+	correlation_engine_init (&session->engine, numTimeseries, windowSize, numTopScores, rankings, numThreads, arena);
+}
+
+void correlation_session_reset (correlation_session_t* session) {
+
+	memset (session->sums, 0, session->numTimeseries*sizeof(double));
+	memset (session->sums_sq, 0, session->numTimeseries*sizeof(double));
+
+	correlation_window_reset (&session->window);
+	correlation_engine_reset (&session->engine);
+}
+
+void correlation_session_free (correlation_session_t* session) {
+
+	free (session->sums);
+	free (session->sums_sq);
+	free (session->inv);
+
+	correlation_window_free (&session->window);
+	correlation_engine_free (&session->engine);
+}
+
+// The newest cross-section is in the window; advance sums and SUM(x,y) by one step
+static void step (correlation_session_t* session, double* correlations_top, uint32_t* indices_top) {
+
+	const double* new_values = correlation_window_new (&session->window);
+	const double* old_values = correlation_window_old (&session->window);
+	double windowSize = session->windowSize;
+
+	for (uint64_t i=0; i<session->numTimeseries; i++) {
+
+		double old = old_values[i];
+		double new = new_values[i];
+
+		session->sums[i] += new - old;
+		session->sums_sq[i] += new*new - old*old;
+
+		session->inv[i] = 1/sqrt(windowSize*session->sums_sq[i]-session->sums[i]*session->sums[i]);
+	}
+
+	correlation_engine_step (&session->engine, new_values, old_values, session->sums, session->inv, correlations_top, indices_top);
+}
+
+void correlation_session_push (correlation_session_t* session, const double* values, double* correlations_top, uint32_t* indices_top) {
+	correlation_window_push (&session->window, values);
+	step (session, correlations_top, indices_top);
+}
+
+void correlation_session_push_series (correlation_session_t* session, double** data, uint64_t s, double* correlations_top, uint32_t* indices_top) {
+	correlation_window_push_series (&session->window, data, s);
+	step (session, correlations_top, indices_top);
+}
+
+// Add numSteps cross-sections to the sums without evaluating correlations, numSteps <= windowSize
+static void update (correlation_session_t* session, const double* values, uint64_t numSteps) {
+
+	uint64_t numTimeseries = session->numTimeseries;
+	int64_t s0 = (int64_t)session->window.numSteps;
+	const double* new_rows[correlation_batchSteps] = {NULL};
+	const double* old_rows[correlation_batchSteps] = {NULL};
+
+	// x[s-n] of every timestep of the batch precedes the batch, so it is still in the window
+	for (uint64_t k=0; k<numSteps; k++) {
+		new_rows[k] = &values[k*numTimeseries];
+		old_rows[k] = correlation_window_at (&session->window, s0 + (int64_t)k - (int64_t)session->windowSize);
+	}
+
+	correlation_engine_update (&session->engine, new_rows, old_rows, numSteps);
+
+	for (uint64_t k=0; k<numSteps; k++) {
+		for (uint64_t i=0; i<numTimeseries; i++) {
+
+			double old = old_rows[k][i];
+			double new = new_rows[k][i];
+
+			session->sums[i] += new - old;
+			session->sums_sq[i] += new*new - old*old;
+		}
+		correlation_window_push (&session->window, new_rows[k]);
+	}
+}
+
+uint64_t correlation_session_push_batch (correlation_session_t* session, const double* values, uint64_t numSteps, uint64_t checkpointInterval,
+						double* correlations_top, uint32_t* indices_top) {
+
+	uint64_t numTimeseries = session->numTimeseries;
+	uint64_t maxBatch = session->windowSize < correlation_batchSteps ? session->windowSize : correlation_batchSteps;
+	uint64_t numCheckpoints = 0;
+	uint64_t k = 0;
+
+	while (k < numSteps) {
+
+		uint64_t checkpoint = checkpointInterval ? ((k/checkpointInterval)+1)*checkpointInterval - 1 : numSteps-1;
+		if (checkpoint >= numSteps)
+			checkpoint = numSteps-1;
+
+		// Batches up to the checkpoint, which is then stepped as usual
+		while (k < checkpoint) {
+			uint64_t numBatch = checkpoint-k < maxBatch ? checkpoint-k : maxBatch;
+			update (session, &values[k*numTimeseries], numBatch);
+			k += numBatch;
+		}
+
+		correlation_session_push (session, &values[k*numTimeseries], &correlations_top[numCheckpoints*session->numScores],
+						&indices_top[2*numCheckpoints*session->numScores]);
+		numCheckpoints++;
+		k++;
+	}
+
+	return numCheckpoints;
+}
@@ -0,0 +1,98 @@
+/**
+ * File: correlation_session.h
+ * Purpose: streaming correlation, one cross-section of all timeseries at a time
+ *
+ * A session keeps the running SUM(x), SUM(x^2) and SUM(x,y) of the current window together with the
+ * last windowSize+1 cross-sections. Pushing the cross-section x[s] advances everything by one
+ * timestep in O(numTimeseries^2) and returns the top correlations of that step, numTopScores for
+ * each of the rankings asked for (correlation_rank_t), ranking after ranking. All memory is
+ * allocated once, in correlation_session_init, and is bounded by the window, not the history.
+ *
+ * When only some timesteps need their top correlations (historical backfills), a block of
+ * cross-sections is pushed with correlation_session_push_batch. The timesteps between checkpoints
+ * are added to SUM(x,y) in batches of up to correlation_batchSteps, so the triangle is streamed
+ * through memory once per batch instead of once per timestep.
+ *
+ */
+
+#ifndef CORRELATION_SESSION_H
+#define CORRELATION_SESSION_H
+
+#include <stdint.h>
+
+#include "correlation_engine.h"
+#include "correlation_window.h"
+
+#ifndef correlation_batchSteps
+#define correlation_batchSteps (64)
+#endif
+
+typedef struct {
+	uint64_t numTimeseries;			/* Number of Timeseries */
+	uint64_t windowSize;			/* Window for correlation */
+	int numTopScores;			/* Number of top correlations per step and ranking */
+	int numScores;				/* Correlations written per step, numTopScores for every ranking */
+	double* sums;				/* SUM(x) of every Timeseries */
+	double* sums_sq;			/* SUM(x^2) of every Timeseries */
+	double* inv;				/* SQRT_INVERSE(x) of every Timeseries */
+	correlation_window_t window;		/* Last windowSize+1 cross-sections */
+	correlation_engine_t engine;		/* SUM(x,y) of all pairs */
+} correlation_session_t;
+
+
+/* Open a session with an empty window. numThreads = 0 uses all available threads. */
+void correlation_session_init (
+	correlation_session_t* session,	/* Session */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	uint64_t windowSize,		/* Window for correlation (minimum size of 2) */
+	int numTopScores,		/* Number of top correlations per step and ranking */
+	unsigned rankings,		/* correlation_rank_t values or-ed together */
+	int numThreads,			/* Number of threads, 0 for all available */
+	correlation_arena_t* arena	/* Arena for SUM(x,y), or NULL */
+);
+
+/* Empty the window and all running sums */
+void correlation_session_reset (
+	correlation_session_t* session	/* Session */
+);
+
+/* Release memory held by the session */
+void correlation_session_free (
+	correlation_session_t* session	/* Session */
+);
+
+/* Push the next cross-section and get the top correlations of the window ending with it, best first */
+void correlation_session_push (
+	correlation_session_t* session,	/* Session */
+	const double* values,		/* Next element of every Timeseries, contiguous */
+	double* correlations_top,	/* Output top correlations (numScores) */
+	uint32_t* indices_top		/* Output corresponding pairs of indices (2*numScores) */
+);
+
+/* Same as correlation_session_push, with the cross-section gathered from one row per timeseries */
+void correlation_session_push_series (
+	correlation_session_t* session,	/* Session */
+	double** data,			/* Array of Timeseries */
+	uint64_t s,			/* Timestep to push */
+	double* correlations_top,	/* Output top correlations (numScores) */
+	uint32_t* indices_top		/* Output corresponding pairs of indices (2*numScores) */
+);
+
+/* Push numSteps cross-sections and get the top correlations at checkpoints only, returns the number of checkpoints.
+ * Timestep k of the block is a checkpoint when (k+1) is a multiple of checkpointInterval, and the last timestep
+ * always is. checkpointInterval = 0 gives the last timestep only. */
+uint64_t correlation_session_push_batch (
+	correlation_session_t* session,	/* Session */
+	const double* values,		/* numSteps cross-sections, values[k*numTimeseries + i] */
+	uint64_t numSteps,		/* Number of cross-sections */
+	uint64_t checkpointInterval,	/* Timesteps between checkpoints, 0 for the last timestep only */
+	double* correlations_top,	/* Output top correlations (numScores per checkpoint) */
+	uint32_t* indices_top		/* Output corresponding pairs of indices (2*numScores per checkpoint) */
+);
+
+/* Number of cross-sections pushed since the session was opened or reset */
+static inline uint64_t correlation_session_steps (const correlation_session_t* session) {
+	return session->window.numSteps;
+}
+
+#endif /* CORRELATION_SESSION_H */
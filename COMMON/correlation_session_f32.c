@@ -0,0 +1,171 @@
+/**
+ * File: correlation_session_f32.c
+ * Purpose: streaming correlation in single precision
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "correlation_session_f32.h"
+
+
+void correlation_session_f32_init (correlation_session_f32_t* session, uint64_t numTimeseries, uint64_t windowSize, int numTopScores, unsigned rankings, int numThreads,
+					uint64_t resyncInterval, correlation_arena_t* arena) {
+
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	session->numTimeseries = numTimeseries;
+	session->windowSize = windowSize;
+	session->numTopScores = numTopScores;
+	session->numScores = numTopScores*correlation_topk_num_ranks (rankings);
+	session->resyncInterval = resyncInterval;
+
+	session->sums = (float*) calloc (numTimeseries, sizeof(float));
+	session->sums_c = (float*) calloc (numTimeseries, sizeof(float));
+	session->sums_sq = (float*) calloc (numTimeseries, sizeof(float));
+	session->sums_sq_c = (float*) calloc (numTimeseries, sizeof(float));
+	session->inv = (float*) malloc (numTimeseries*sizeof(float));
+	session->new_values = (float*) malloc (numTimeseries*sizeof(float));
+	session->old_values = (float*) malloc (numTimeseries*sizeof(float));
+	session->shift = (double*) malloc (numTimeseries*sizeof(double));
+	session->padding = (double*) malloc (numTimeseries*sizeof(double));
+	session->values = (double*) malloc (numTimeseries*sizeof(double));
+	session->series_values = (double*) malloc (numTimeseries*sizeof(double));
+	session->rows = (const double**) malloc (windowSize*sizeof(double*));
+
+	correlation_window_init (&session->window, numTimeseries, windowSize);
+	correlation_engine_init_f32 (&session->engine, numTimeseries, windowSize, numTopScores, rankings, numThreads, arena);
+}
+
+void correlation_session_f32_reset (correlation_session_f32_t* session) {
+
+	memset (session->sums, 0, session->numTimeseries*sizeof(float));
+	memset (session->sums_c, 0, session->numTimeseries*sizeof(float));
+	memset (session->sums_sq, 0, session->numTimeseries*sizeof(float));
+	memset (session->sums_sq_c, 0, session->numTimeseries*sizeof(float));
+
+	correlation_window_reset (&session->window);
+	correlation_engine_reset (&session->engine);
+}
+
+void correlation_session_f32_free (correlation_session_f32_t* session) {
+
+	free (session->sums);
+	free (session->sums_c);
+	free (session->sums_sq);
+	free (session->sums_sq_c);
+	free (session->inv);
+	free (session->new_values);
+	free (session->old_values);
+	free (session->shift);
+	free (session->padding);
+	free (session->values);
+	free (session->series_values);
+	free (session->rows);
+
+	correlation_window_free (&session->window);
+	correlation_engine_free (&session->engine);
+}
+
+// sum += value, carrying the lost low-order bits in c
+static inline void kahan_add (float* sum, float* c, float value) {
+	float y = value - *c;
+	float t = *sum + y;
+	*c = (t - *sum) - y;
+	*sum = t;
+}
+
+// Recompute all running sums from the last windowSize cross-sections, padding included while s<n
+static void resync (correlation_session_f32_t* session) {
+
+	correlation_window_t* window = &session->window;
+	uint64_t numRows = session->windowSize;
+	uint64_t numPadding = window->numSteps < numRows ? numRows - window->numSteps : 0;
+
+	for (uint64_t r=0; r<numRows; r++) {
+		uint64_t s = window->numSteps + r - numRows;
+		session->rows[r] = r < numPadding ? session->padding : &window->rows[(s % (window->windowSize+1))*window->numTimeseries];
+	}
+
+	for (uint64_t i=0; i<session->numTimeseries; i++) {
+
+		double sum = 0, sum_sq = 0;
+		for (uint64_t r=0; r<numRows; r++) {
+			sum += session->rows[r][i];
+			sum_sq += session->rows[r][i]*session->rows[r][i];
+		}
+
+		session->sums[i] = sum;
+		session->sums_c[i] = 0;
+		session->sums_sq[i] = sum_sq;
+		session->sums_sq_c[i] = 0;
+	}
+
+	correlation_engine_resync_f32 (&session->engine, session->rows, numRows);
+}
+
+// The newest cross-section is in the window; advance sums and SUM(x,y) by one step
+static void step (correlation_session_f32_t* session, double* correlations_top, uint32_t* indices_top) {
+
+	const double* new_values = correlation_window_new (&session->window);
+	const double* old_values = session->window.numSteps <= session->windowSize ? session->padding : correlation_window_old (&session->window);
+	double windowSize = session->windowSize;
+
+	for (uint64_t i=0; i<session->numTimeseries; i++) {
+
+		double old = old_values[i];
+		double new = new_values[i];
+
+		session->new_values[i] = new;
+		session->old_values[i] = old;
+
+		kahan_add (&session->sums[i], &session->sums_c[i], new - old);
+		kahan_add (&session->sums_sq[i], &session->sums_sq_c[i], new*new - old*old);
+
+		double sum = session->sums[i];
+		session->inv[i] = 1/sqrt(windowSize*session->sums_sq[i]-sum*sum);
+	}
+
+	correlation_engine_step_f32 (&session->engine, session->new_values, session->old_values, session->sums, session->inv,
+					correlations_top, indices_top);
+
+	// Also once the padding has left the window: its large terms have cancelled out in float by then
+	if (session->window.numSteps == session->windowSize || (session->resyncInterval && session->window.numSteps % session->resyncInterval == 0))
+		resync (session);
+}
+
+void correlation_session_f32_push (correlation_session_f32_t* session, const double* values, double* correlations_top, uint32_t* indices_top) {
+
+	// The first cross-section fixes the shift; the empty window before it holds padding only
+	if (session->window.numSteps == 0) {
+		for (uint64_t i=0; i<session->numTimeseries; i++) {
+			session->shift[i] = values[i];
+			session->padding[i] = -values[i];
+		}
+		resync (session);
+	}
+
+	for (uint64_t i=0; i<session->numTimeseries; i++)
+		session->values[i] = values[i] - session->shift[i];
+
+	correlation_window_push (&session->window, session->values);
+	step (session, correlations_top, indices_top);
+}
+
+void correlation_session_f32_push_series (correlation_session_f32_t* session, double** data, uint64_t s, double* correlations_top, uint32_t* indices_top) {
+
+	double* values = session->series_values;
+
+	for (uint64_t i=0; i<session->numTimeseries; i++)
+		values[i] = data[i][s];
+
+	correlation_session_f32_push (session, values, correlations_top, indices_top);
+}
@@ -0,0 +1,98 @@
+/**
+ * File: correlation_session_f32.h
+ * Purpose: streaming correlation in single precision
+ *
+ * Same interface as correlation_session, with SUM(x), SUM(x^2), SUM(x,y) and the correlations kept
+ * and evaluated in float: the SUM(x,y) triangle takes half the memory and bandwidth (72 MB instead of
+ * 144 MB at 6000 timeseries) and the kernel processes twice as many pairs per vector.
+ *
+ * Accuracy is kept in check in three ways:
+ *	- values are shifted by the first cross-section before they enter the window; correlations do
+ *	  not change, but n*SUM(x,y) and SUM(x)*SUM(y) no longer cancel in float for data far from 0.
+ *	  The zeros before the first step are shifted alike (to -shift), so the first windowSize steps
+ *	  keep their meaning, though not their accuracy, for such data.
+ *	- SUM(x) and SUM(x^2) are updated with Kahan compensation, so their running error does not
+ *	  grow with the number of steps
+ *	- every resyncInterval steps SUM(x), SUM(x^2) and SUM(x,y) are recomputed exactly (in double)
+ *	  from the cross-sections of the window, which bounds the drift of SUM(x,y)
+ *
+ * The window itself stays in double. Once the window is full, correlations typically differ from the
+ * double session by 1e-6 to 1e-5; ORIG measures and reports the difference.
+ *
+ */
+
+#ifndef CORRELATION_SESSION_F32_H
+#define CORRELATION_SESSION_F32_H
+
+#include <stdint.h>
+
+#include "correlation_engine.h"
+#include "correlation_window.h"
+
+#ifndef correlation_resyncInterval
+#define correlation_resyncInterval (1024)
+#endif
+
+typedef struct {
+	uint64_t numTimeseries;			/* Number of Timeseries */
+	uint64_t windowSize;			/* Window for correlation */
+	int numTopScores;			/* Number of top correlations per step and ranking */
+	int numScores;				/* Correlations written per step, numTopScores for every ranking */
+	uint64_t resyncInterval;		/* Steps between exact resyncs, 0 for never */
+	float* sums;				/* SUM(x) of every Timeseries */
+	float* sums_c;				/* Kahan compensation of sums */
+	float* sums_sq;				/* SUM(x^2) of every Timeseries */
+	float* sums_sq_c;			/* Kahan compensation of sums_sq */
+	float* inv;				/* SQRT_INVERSE(x) of every Timeseries */
+	float* new_values;			/* x[s] in single precision */
+	float* old_values;			/* x[s-n] in single precision */
+	double* shift;				/* First cross-section, subtracted from all values */
+	double* padding;			/* x[s-n]-shift while s<n, i.e. -shift */
+	double* values;				/* Shifted cross-section being pushed */
+	double* series_values;			/* Cross-section gathered by correlation_session_f32_push_series */
+	const double** rows;			/* Cross-sections of the window, for resyncs */
+	correlation_window_t window;		/* Last windowSize+1 cross-sections */
+	correlation_engine_t engine;		/* SUM(x,y) of all pairs, single precision */
+} correlation_session_f32_t;
+
+
+/* Open a session with an empty window. numThreads = 0 uses all available threads. */
+void correlation_session_f32_init (
+	correlation_session_f32_t* session,	/* Session */
+	uint64_t numTimeseries,			/* Number of Timeseries */
+	uint64_t windowSize,			/* Window for correlation (minimum size of 2) */
+	int numTopScores,			/* Number of top correlations per step and ranking */
+	unsigned rankings,			/* correlation_rank_t values or-ed together */
+	int numThreads,				/* Number of threads, 0 for all available */
+	uint64_t resyncInterval,		/* Steps between exact resyncs, 0 for never */
+	correlation_arena_t* arena		/* Arena for SUM(x,y), or NULL */
+);
+
+/* Empty the window and all running sums */
+void correlation_session_f32_reset (
+	correlation_session_f32_t* session	/* Session */
+);
+
+/* Release memory held by the session */
+void correlation_session_f32_free (
+	correlation_session_f32_t* session	/* Session */
+);
+
+/* Push the next cross-section and get the top correlations of the window ending with it, best first */
+void correlation_session_f32_push (
+	correlation_session_f32_t* session,	/* Session */
+	const double* values,			/* Next element of every Timeseries, contiguous */
+	double* correlations_top,		/* Output top correlations (numScores) */
+	uint32_t* indices_top			/* Output corresponding pairs of indices (2*numScores) */
+);
+
+/* Same as correlation_session_f32_push, with the cross-section gathered from one row per timeseries */
+void correlation_session_f32_push_series (
+	correlation_session_f32_t* session,	/* Session */
+	double** data,				/* Array of Timeseries */
+	uint64_t s,				/* Timestep to push */
+	double* correlations_top,		/* Output top correlations (numScores) */
+	uint32_t* indices_top			/* Output corresponding pairs of indices (2*numScores) */
+);
+
+#endif /* CORRELATION_SESSION_F32_H */
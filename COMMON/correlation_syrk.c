@@ -0,0 +1,254 @@
+/**
+ * File: correlation_syrk.c
+ * Purpose: full-window correlation matrix as one symmetric rank-k update (SYRK)
+ *
+ * The micro-kernel multiplies 8 consecutive values of a panel row (broadcast) by the 16 values of
+ * another panel row (vectors) and accumulates the 8 x 16 block in registers over up to
+ * correlation_syrkDepth rows.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#include "correlation_syrk.h"
+#include "correlation_kernel.h"
+
+#define MR (8)
+#define NR (16)
+
+// acc[r*NR + c] = SUM over k of a[k*NR + r]*b[k*NR + c]; a and b point into panels of Z
+typedef void (*syrk_micro_t) (const double* a, const double* b, uint64_t numK, double* acc);
+
+
+static void syrk_micro_scalar (const double* a, const double* b, uint64_t numK, double* acc) {
+
+	memset (acc, 0, MR*NR*sizeof(double));
+
+	for (uint64_t k=0; k<numK; k++, a+=NR, b+=NR)
+		for (int r=0; r<MR; r++)
+			for (int c=0; c<NR; c++)
+				acc[r*NR + c] += a[r]*b[c];
+}
+
+#ifdef __x86_64__
+
+// Accumulators are named rather than kept in arrays, so that they stay in registers
+
+__attribute__((target("sse2")))
+static void syrk_micro_sse2 (const double* a, const double* b, uint64_t numK, double* acc) {
+
+	// 4 x 4 at a time, to stay within 16 registers
+	for (int r0=0; r0<MR; r0+=4)
+	for (int c0=0; c0<NR; c0+=4) {
+
+		__m128d c00 = _mm_setzero_pd(), c01 = _mm_setzero_pd();
+		__m128d c10 = _mm_setzero_pd(), c11 = _mm_setzero_pd();
+		__m128d c20 = _mm_setzero_pd(), c21 = _mm_setzero_pd();
+		__m128d c30 = _mm_setzero_pd(), c31 = _mm_setzero_pd();
+
+		const double* a_k = a + r0;
+		const double* b_k = b + c0;
+
+		for (uint64_t k=0; k<numK; k++, a_k+=NR, b_k+=NR) {
+			__m128d b0 = _mm_loadu_pd(b_k);
+			__m128d b1 = _mm_loadu_pd(b_k+2);
+			__m128d a0 = _mm_set1_pd(a_k[0]);
+			__m128d a1 = _mm_set1_pd(a_k[1]);
+			__m128d a2 = _mm_set1_pd(a_k[2]);
+			__m128d a3 = _mm_set1_pd(a_k[3]);
+			c00 = _mm_add_pd(c00, _mm_mul_pd(a0, b0));	c01 = _mm_add_pd(c01, _mm_mul_pd(a0, b1));
+			c10 = _mm_add_pd(c10, _mm_mul_pd(a1, b0));	c11 = _mm_add_pd(c11, _mm_mul_pd(a1, b1));
+			c20 = _mm_add_pd(c20, _mm_mul_pd(a2, b0));	c21 = _mm_add_pd(c21, _mm_mul_pd(a2, b1));
+			c30 = _mm_add_pd(c30, _mm_mul_pd(a3, b0));	c31 = _mm_add_pd(c31, _mm_mul_pd(a3, b1));
+		}
+
+		_mm_storeu_pd(&acc[(r0+0)*NR + c0], c00);	_mm_storeu_pd(&acc[(r0+0)*NR + c0 + 2], c01);
+		_mm_storeu_pd(&acc[(r0+1)*NR + c0], c10);	_mm_storeu_pd(&acc[(r0+1)*NR + c0 + 2], c11);
+		_mm_storeu_pd(&acc[(r0+2)*NR + c0], c20);	_mm_storeu_pd(&acc[(r0+2)*NR + c0 + 2], c21);
+		_mm_storeu_pd(&acc[(r0+3)*NR + c0], c30);	_mm_storeu_pd(&acc[(r0+3)*NR + c0 + 2], c31);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void syrk_micro_avx2 (const double* a, const double* b, uint64_t numK, double* acc) {
+
+	// 4 x 8 at a time, to stay within 16 registers
+	for (int r0=0; r0<MR; r0+=4)
+	for (int c0=0; c0<NR; c0+=8) {
+
+		__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+		__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+		__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+		__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+
+		const double* a_k = a + r0;
+		const double* b_k = b + c0;
+
+		for (uint64_t k=0; k<numK; k++, a_k+=NR, b_k+=NR) {
+			__m256d b0 = _mm256_loadu_pd(b_k);
+			__m256d b1 = _mm256_loadu_pd(b_k+4);
+			__m256d a0 = _mm256_broadcast_sd(&a_k[0]);
+			__m256d a1 = _mm256_broadcast_sd(&a_k[1]);
+			__m256d a2 = _mm256_broadcast_sd(&a_k[2]);
+			__m256d a3 = _mm256_broadcast_sd(&a_k[3]);
+			c00 = _mm256_fmadd_pd(a0, b0, c00);	c01 = _mm256_fmadd_pd(a0, b1, c01);
+			c10 = _mm256_fmadd_pd(a1, b0, c10);	c11 = _mm256_fmadd_pd(a1, b1, c11);
+			c20 = _mm256_fmadd_pd(a2, b0, c20);	c21 = _mm256_fmadd_pd(a2, b1, c21);
+			c30 = _mm256_fmadd_pd(a3, b0, c30);	c31 = _mm256_fmadd_pd(a3, b1, c31);
+		}
+
+		_mm256_storeu_pd(&acc[(r0+0)*NR + c0], c00);	_mm256_storeu_pd(&acc[(r0+0)*NR + c0 + 4], c01);
+		_mm256_storeu_pd(&acc[(r0+1)*NR + c0], c10);	_mm256_storeu_pd(&acc[(r0+1)*NR + c0 + 4], c11);
+		_mm256_storeu_pd(&acc[(r0+2)*NR + c0], c20);	_mm256_storeu_pd(&acc[(r0+2)*NR + c0 + 4], c21);
+		_mm256_storeu_pd(&acc[(r0+3)*NR + c0], c30);	_mm256_storeu_pd(&acc[(r0+3)*NR + c0 + 4], c31);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void syrk_micro_avx512 (const double* a, const double* b, uint64_t numK, double* acc) {
+
+	__m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+	__m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+	__m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+	__m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+	__m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+	__m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+	__m512d c60 = _mm512_setzero_pd(), c61 = _mm512_setzero_pd();
+	__m512d c70 = _mm512_setzero_pd(), c71 = _mm512_setzero_pd();
+
+	for (uint64_t k=0; k<numK; k++, a+=NR, b+=NR) {
+		__m512d b0 = _mm512_loadu_pd(b);
+		__m512d b1 = _mm512_loadu_pd(b+8);
+		__m512d a_r;
+		a_r = _mm512_set1_pd(a[0]);	c00 = _mm512_fmadd_pd(a_r, b0, c00);	c01 = _mm512_fmadd_pd(a_r, b1, c01);
+		a_r = _mm512_set1_pd(a[1]);	c10 = _mm512_fmadd_pd(a_r, b0, c10);	c11 = _mm512_fmadd_pd(a_r, b1, c11);
+		a_r = _mm512_set1_pd(a[2]);	c20 = _mm512_fmadd_pd(a_r, b0, c20);	c21 = _mm512_fmadd_pd(a_r, b1, c21);
+		a_r = _mm512_set1_pd(a[3]);	c30 = _mm512_fmadd_pd(a_r, b0, c30);	c31 = _mm512_fmadd_pd(a_r, b1, c31);
+		a_r = _mm512_set1_pd(a[4]);	c40 = _mm512_fmadd_pd(a_r, b0, c40);	c41 = _mm512_fmadd_pd(a_r, b1, c41);
+		a_r = _mm512_set1_pd(a[5]);	c50 = _mm512_fmadd_pd(a_r, b0, c50);	c51 = _mm512_fmadd_pd(a_r, b1, c51);
+		a_r = _mm512_set1_pd(a[6]);	c60 = _mm512_fmadd_pd(a_r, b0, c60);	c61 = _mm512_fmadd_pd(a_r, b1, c61);
+		a_r = _mm512_set1_pd(a[7]);	c70 = _mm512_fmadd_pd(a_r, b0, c70);	c71 = _mm512_fmadd_pd(a_r, b1, c71);
+	}
+
+	_mm512_storeu_pd(&acc[0*NR], c00);	_mm512_storeu_pd(&acc[0*NR + 8], c01);
+	_mm512_storeu_pd(&acc[1*NR], c10);	_mm512_storeu_pd(&acc[1*NR + 8], c11);
+	_mm512_storeu_pd(&acc[2*NR], c20);	_mm512_storeu_pd(&acc[2*NR + 8], c21);
+	_mm512_storeu_pd(&acc[3*NR], c30);	_mm512_storeu_pd(&acc[3*NR + 8], c31);
+	_mm512_storeu_pd(&acc[4*NR], c40);	_mm512_storeu_pd(&acc[4*NR + 8], c41);
+	_mm512_storeu_pd(&acc[5*NR], c50);	_mm512_storeu_pd(&acc[5*NR + 8], c51);
+	_mm512_storeu_pd(&acc[6*NR], c60);	_mm512_storeu_pd(&acc[6*NR + 8], c61);
+	_mm512_storeu_pd(&acc[7*NR], c70);	_mm512_storeu_pd(&acc[7*NR + 8], c71);
+}
+
+#endif /* __x86_64__ */
+
+static syrk_micro_t syrk_micro (correlation_isa_t isa) {
+	switch (isa) {
+#ifdef __x86_64__
+		case CORRELATION_ISA_SSE2:	return syrk_micro_sse2;
+		case CORRELATION_ISA_AVX2:	return syrk_micro_avx2;
+		case CORRELATION_ISA_AVX512:	return syrk_micro_avx512;
+#endif
+		default:			return syrk_micro_scalar;
+	}
+}
+
+
+// Column i of Z from data_rows[s*numTimeseries + i] or data_series[i][s]; padding columns are zero
+static void standardize (const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries, double* z) {
+
+	uint64_t numColumns = correlation_syrk_columns (numTimeseries);
+
+	#pragma omp parallel for schedule(static)
+	for (uint64_t i=0; i<numColumns; i++) {
+
+		double* z_i = &z[(i/NR)*sizeTimeseries*NR + i%NR];
+
+		if (i >= numTimeseries) {
+			for (uint64_t s=0; s<sizeTimeseries; s++)
+				z_i[s*NR] = 0;
+			continue;
+		}
+
+		// Two passes: the mean first, then the centered norm
+		double sum = 0;
+		for (uint64_t s=0; s<sizeTimeseries; s++)
+			sum += data_rows ? data_rows[s*numTimeseries + i] : data_series[i][s];
+		double mean = sum/sizeTimeseries;
+
+		double sum_sq = 0;
+		for (uint64_t s=0; s<sizeTimeseries; s++) {
+			double centered = (data_rows ? data_rows[s*numTimeseries + i] : data_series[i][s]) - mean;
+			z_i[s*NR] = centered;
+			sum_sq += centered*centered;
+		}
+
+		double inv = 1/sqrt(sum_sq);
+		for (uint64_t s=0; s<sizeTimeseries; s++)
+			z_i[s*NR] *= inv;
+	}
+}
+
+void correlation_syrk_standardize_rows (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* z) {
+	standardize (data, NULL, sizeTimeseries, numTimeseries, z);
+}
+
+void correlation_syrk_standardize (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, double* z) {
+	standardize (NULL, data, sizeTimeseries, numTimeseries, z);
+}
+
+void correlation_syrk (const double* z, uint64_t sizeTimeseries, uint64_t numTimeseries, double* correlations) {
+
+	uint64_t numRowBlocks = (numTimeseries + correlation_syrkRows - 1)/correlation_syrkRows;
+	syrk_micro_t micro = syrk_micro (correlation_kernel_get_isa());
+
+	// Largest row blocks first, so that the last ones to be picked up are short
+	#pragma omp parallel for schedule(dynamic,1)
+	for (uint64_t block=0; block<numRowBlocks; block++) {
+
+		uint64_t i0 = (numRowBlocks-1-block)*correlation_syrkRows;
+		uint64_t i1 = i0+correlation_syrkRows < numTimeseries ? i0+correlation_syrkRows : numTimeseries;
+		double acc[MR*NR];
+
+		// Rows i0 <= i < i1 of the triangle are contiguous and owned by this thread
+		memset (&correlations[(i0*(i0-1))/2], 0, ((i1*(i1-1))/2 - (i0*(i0-1))/2)*sizeof(double));
+
+		for (uint64_t k0=0; k0<sizeTimeseries; k0+=correlation_syrkDepth) {
+
+			uint64_t numK = k0+correlation_syrkDepth < sizeTimeseries ? correlation_syrkDepth : sizeTimeseries-k0;
+
+			// Rows k0 <= k < k0+numK of one panel stay in L1 while all row groups of the block use them
+			for (uint64_t j0=0; j0+1<i1; j0+=NR) {
+
+				const double* b = &z[((j0/NR)*sizeTimeseries + k0)*NR];
+
+				for (uint64_t ir=i0; ir<i1; ir+=MR) {
+
+					// Some pair j<i in the MR x NR block
+					if (j0+1 >= ir+MR)
+						continue;
+
+					micro (&z[((ir/NR)*sizeTimeseries + k0)*NR + ir%NR], b, numK, acc);
+
+					for (int r=0; r<MR && ir+r<i1; r++) {
+
+						uint64_t i = ir+r;
+						uint64_t j1 = j0+NR < i ? j0+NR : i;
+						double* row = &correlations[(i*(i-1))/2];
+
+						for (uint64_t j=j0; j<j1; j++)
+							row[j] += acc[r*NR + (j-j0)];
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,63 @@
+/**
+ * File: correlation_syrk.h
+ * Purpose: full-window correlation matrix as one symmetric rank-k update (SYRK)
+ *
+ * When the window covers the whole series, the correlation of x and y is the dot product of the
+ * standardized series: r(x,y) = SUM(z_x*z_y), with z = (x - mean(x))/sqrt(SUM((x - mean(x))^2)).
+ * The series are standardized once into Z, stored in panels of 16 series: panel p holds z[s] of series
+ * 16p to 16p+15 for s = 0..sizeTimeseries-1, 16 values per timestep, with zeros past the last series.
+ * Any run of timesteps of a panel is then contiguous, so the micro-kernel reads both of its operands
+ * straight from Z without packing. The lower triangle of Z^T*Z is computed in cache blocks: rows of
+ * correlation_syrkRows series, correlation_syrkDepth timesteps at a time, with a register micro-kernel
+ * of 8 x 16 correlations picked from the kernel instruction set. Row blocks are shared out to OpenMP
+ * threads.
+ *
+ * Correlations are written packed, pair (i,j), j<i, at index i*(i-1)/2 + j: the layout of calc_index
+ * in FullCorrelations, in which every row of the triangle is contiguous.
+ *
+ */
+
+#ifndef CORRELATION_SYRK_H
+#define CORRELATION_SYRK_H
+
+#include <stdint.h>
+
+#ifndef correlation_syrkRows
+#define correlation_syrkRows (128)
+#endif
+
+#ifndef correlation_syrkDepth
+#define correlation_syrkDepth (512)
+#endif
+
+
+/* Number of series in Z, numTimeseries rounded up to whole panels; Z holds sizeTimeseries times as many values */
+static inline uint64_t correlation_syrk_columns (uint64_t numTimeseries) {
+	return (numTimeseries + 15) & ~(uint64_t)15;
+}
+
+/* Standardize time-major data (data[s*numTimeseries + i]) into Z */
+void correlation_syrk_standardize_rows (
+	const double* data,		/* Input data, data[s*numTimeseries + i] is element s of Timeseries i */
+	uint64_t sizeTimeseries,	/* Size of each Timeseries */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	double* z			/* Output, sizeTimeseries*correlation_syrk_columns(numTimeseries) values */
+);
+
+/* Standardize one row per timeseries (data[i][s]) into Z */
+void correlation_syrk_standardize (
+	double** data,			/* Array of Timeseries */
+	uint64_t sizeTimeseries,	/* Size of each Timeseries */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	double* z			/* Output, sizeTimeseries*correlation_syrk_columns(numTimeseries) values */
+);
+
+/* Correlations of all pairs from Z, packed as above */
+void correlation_syrk (
+	const double* z,		/* Standardized series, from correlation_syrk_standardize(_rows) */
+	uint64_t sizeTimeseries,	/* Size of each Timeseries */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	double* correlations		/* Output, numTimeseries*(numTimeseries-1)/2 correlations */
+);
+
+#endif /* CORRELATION_SYRK_H */
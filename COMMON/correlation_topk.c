@@ -0,0 +1,301 @@
+/**
+ * File: correlation_topk.c
+ * Purpose: bounded top-K selection of correlation scores
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "correlation_topk.h"
+
+
+// a is a worse candidate than b
+static inline int worse (const correlation_topk_entry_t* a, const correlation_topk_entry_t* b) {
+	return a->score < b->score || (a->score == b->score && a->position > b->position);
+}
+
+static void sift_up (correlation_topk_entry_t* heap, int k) {
+
+	correlation_topk_entry_t entry = heap[k];
+
+	while (k > 0) {
+		int parent = (k-1)/2;
+		if (!worse(&entry, &heap[parent]))
+			break;
+		heap[k] = heap[parent];
+		k = parent;
+	}
+	heap[k] = entry;
+}
+
+static void sift_down (correlation_topk_entry_t* heap, int count, int k) {
+
+	correlation_topk_entry_t entry = heap[k];
+
+	for (;;) {
+		int child = 2*k+1;
+		if (child >= count)
+			break;
+		if (child+1 < count && worse(&heap[child+1], &heap[child]))
+			child++;
+		if (!worse(&heap[child], &entry))
+			break;
+		heap[k] = heap[child];
+		k = child;
+	}
+	heap[k] = entry;
+}
+
+// Score of a correlation in a ranking
+static inline double rank_score (correlation_rank_t rank, double correlation) {
+	switch (rank) {
+		case CORRELATION_RANK_BOTTOM:	return -correlation;
+		case CORRELATION_RANK_ABS:	return fabs(correlation);
+		default:			return correlation;
+	}
+}
+
+// Bounds on the correlations any ranking can still take
+static void update_bounds (correlation_topk_t* topk) {
+
+	double threshold = INFINITY;
+	double lower = -INFINITY;
+
+	for (int r=0; r<topk->numRanks; r++) {
+		double score = topk->ranks[r].threshold;
+		switch (topk->ranks[r].rank) {
+			case CORRELATION_RANK_TOP:
+				threshold = score < threshold ? score : threshold;
+				break;
+			case CORRELATION_RANK_BOTTOM:
+				lower = -score > lower ? -score : lower;
+				break;
+			case CORRELATION_RANK_ABS:
+				threshold = score < threshold ? score : threshold;
+				lower = -score > lower ? -score : lower;
+				break;
+		}
+	}
+
+	topk->threshold = threshold;
+	topk->lower = lower;
+}
+
+// Offer an entry to one ranking
+static inline void heap_insert (correlation_topk_heap_t* heap, int numTopScores, const correlation_topk_entry_t* entry) {
+
+	if (heap->count < numTopScores) {
+		heap->heap[heap->count] = *entry;
+		sift_up (heap->heap, heap->count);
+		heap->count++;
+	}
+	else {
+		if (!worse(&heap->heap[0], entry))
+			return;
+		heap->heap[0] = *entry;
+		sift_down (heap->heap, heap->count, 0);
+	}
+
+	if (heap->count == numTopScores)
+		heap->threshold = heap->heap[0].score;
+}
+
+void correlation_topk_init (correlation_topk_t* topk, int numTopScores) {
+	correlation_topk_init_ranks (topk, numTopScores, CORRELATION_RANK_TOP);
+}
+
+void correlation_topk_init_ranks (correlation_topk_t* topk, int numTopScores, unsigned rankings) {
+
+	if (numTopScores < 1) {
+		fprintf(stderr, "Number of top scores must be at least 1. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	if (correlation_topk_num_ranks (rankings) == 0) {
+		fprintf(stderr, "At least one ranking must be selected. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	topk->numTopScores = numTopScores;
+	topk->numRanks = 0;
+	topk->topOnly = (rankings & (CORRELATION_RANK_TOP | CORRELATION_RANK_BOTTOM | CORRELATION_RANK_ABS)) == CORRELATION_RANK_TOP;
+
+	for (unsigned rank=CORRELATION_RANK_TOP; rank<=CORRELATION_RANK_ABS; rank<<=1) {
+		if (rankings & rank) {
+			correlation_topk_heap_t* heap = &topk->ranks[topk->numRanks++];
+			heap->rank = (correlation_rank_t) rank;
+			heap->heap = (correlation_topk_entry_t*) malloc (numTopScores*sizeof(correlation_topk_entry_t));
+		}
+	}
+
+	topk->sorted = (correlation_topk_entry_t*) malloc (numTopScores*sizeof(correlation_topk_entry_t));
+
+	correlation_topk_reset (topk);
+}
+
+void correlation_topk_reset (correlation_topk_t* topk) {
+
+	for (int r=0; r<topk->numRanks; r++) {
+		topk->ranks[r].count = 0;
+		topk->ranks[r].threshold = -INFINITY;
+	}
+	update_bounds (topk);
+}
+
+void correlation_topk_free (correlation_topk_t* topk) {
+
+	for (int r=0; r<topk->numRanks; r++) {
+		free (topk->ranks[r].heap);
+		topk->ranks[r].heap = NULL;
+	}
+	free (topk->sorted);
+	topk->sorted = NULL;
+}
+
+void correlation_topk_insert (correlation_topk_t* topk, double score, uint64_t position, uint32_t index_0, uint32_t index_1) {
+
+	if (isnan(score))
+		return;
+
+	if (topk->topOnly) {
+		correlation_topk_insert_top (topk, score, position, index_0, index_1);
+		return;
+	}
+
+	for (int r=0; r<topk->numRanks; r++) {
+
+		correlation_topk_heap_t* heap = &topk->ranks[r];
+		correlation_topk_entry_t entry = {rank_score (heap->rank, score), score, position, {index_0, index_1}};
+
+		if (entry.score >= heap->threshold)
+			heap_insert (heap, topk->numTopScores, &entry);
+	}
+
+	update_bounds (topk);
+}
+
+void correlation_topk_insert_top (correlation_topk_t* topk, double score, uint64_t position, uint32_t index_0, uint32_t index_1) {
+
+	correlation_topk_heap_t* heap = &topk->ranks[0];
+	correlation_topk_entry_t entry = {score, score, position, {index_0, index_1}};
+
+	heap_insert (heap, topk->numTopScores, &entry);
+	topk->threshold = heap->threshold;
+}
+
+// Top ranking only: one compare per candidate
+static void push_array_top (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, uint64_t position) {
+
+	uint64_t i = 0;
+
+#ifdef __SSE2__
+	for (; i+4 <= numCorrelations; i+=4) {
+		__m128d threshold = _mm_set1_pd(topk->threshold);
+		__m128d pass = _mm_or_pd(_mm_cmpge_pd(_mm_loadu_pd(&correlations[i]), threshold),
+					_mm_cmpge_pd(_mm_loadu_pd(&correlations[i+2]), threshold));
+		if (_mm_movemask_pd(pass) == 0)
+			continue;
+		for (uint64_t k=i; k<i+4; k++)
+			correlation_topk_push_top (topk, correlations[k], position+k, indices[2*k], indices[2*k+1]);
+	}
+#endif
+
+	for (; i<numCorrelations; i++)
+		correlation_topk_push_top (topk, correlations[i], position+i, indices[2*i], indices[2*i+1]);
+}
+
+void correlation_topk_push_array (correlation_topk_t* topk, const double* correlations, const uint32_t* indices, uint64_t numCorrelations, uint64_t position) {
+
+	if (topk->topOnly) {
+		push_array_top (topk, correlations, indices, numCorrelations, position);
+		return;
+	}
+
+	uint64_t i = 0;
+
+#ifdef __SSE2__
+	// Fast reject: skip 4 candidates at once while none of them can enter a ranking
+	for (; i+4 <= numCorrelations; i+=4) {
+		__m128d threshold = _mm_set1_pd(topk->threshold);
+		__m128d lower = _mm_set1_pd(topk->lower);
+		__m128d lo = _mm_loadu_pd(&correlations[i]);
+		__m128d hi = _mm_loadu_pd(&correlations[i+2]);
+		__m128d pass = _mm_or_pd(_mm_or_pd(_mm_cmpge_pd(lo, threshold), _mm_cmpge_pd(hi, threshold)),
+					_mm_or_pd(_mm_cmple_pd(lo, lower), _mm_cmple_pd(hi, lower)));
+		if (_mm_movemask_pd(pass) == 0)
+			continue;
+		for (uint64_t k=i; k<i+4; k++)
+			correlation_topk_push (topk, correlations[k], position+k, indices[2*k], indices[2*k+1]);
+	}
+#endif
+
+	for (; i<numCorrelations; i++)
+		correlation_topk_push (topk, correlations[i], position+i, indices[2*i], indices[2*i+1]);
+}
+
+void correlation_topk_merge (correlation_topk_t* topk, const correlation_topk_t* other) {
+
+	for (int r=0; r<topk->numRanks && r<other->numRanks; r++) {
+
+		correlation_topk_heap_t* heap = &topk->ranks[r];
+		const correlation_topk_heap_t* other_heap = &other->ranks[r];
+
+		for (int k=0; k<other_heap->count; k++)
+			if (other_heap->heap[k].score >= heap->threshold)
+				heap_insert (heap, topk->numTopScores, &other_heap->heap[k]);
+	}
+
+	update_bounds (topk);
+}
+
+int correlation_topk_result (const correlation_topk_t* topk, double* correlations_top, uint32_t* indices_top) {
+
+	int count = 0;
+
+	for (int r=0; r<topk->numRanks; r++) {
+
+		const correlation_topk_heap_t* heap = &topk->ranks[r];
+		double* correlations = &correlations_top[r*topk->numTopScores];
+		uint32_t* indices = &indices_top[2*r*topk->numTopScores];
+		correlation_topk_entry_t* sorted = topk->sorted;
+
+		// Heap sort of a copy: the worst entry goes to the back, so the best one ends up first
+		for (int k=0; k<heap->count; k++)
+			sorted[k] = heap->heap[k];
+		for (int n=heap->count-1; n>0; n--) {
+			correlation_topk_entry_t worst = sorted[0];
+			sorted[0] = sorted[n];
+			sorted[n] = worst;
+			sift_down (sorted, n, 0);
+		}
+
+		for (int k=0; k<heap->count; k++) {
+			correlations[k] = sorted[k].correlation;
+			indices[2*k] = sorted[k].indices[0];
+			indices[2*k+1] = sorted[k].indices[1];
+		}
+
+		count += heap->count;
+	}
+
+	return count;
+}
+
+void topCorrelations (const double* correlations, const uint32_t* indices, uint64_t numCorrelations, double* correlations_top, uint32_t* indices_top, int numTopScores) {
+
+	correlation_topk_t topk;
+
+	correlation_topk_init (&topk, numTopScores);
+	correlation_topk_push_array (&topk, correlations, indices, numCorrelations, 0);
+	correlation_topk_result (&topk, correlations_top, indices_top);
+	correlation_topk_free (&topk);
+}
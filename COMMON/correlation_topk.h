@@ -0,0 +1,160 @@
+/**
+ * File: correlation_topk.h
+ * Purpose: bounded top-K selection of correlation scores, shared by ORIG, SPLIT and the DFE host code
+ *
+ * The selector keeps the numTopScores best candidates in a min-heap whose root is the worst kept
+ * candidate, so M candidates cost O(M log K). A candidate is better than another if its score is
+ * higher or, on equal scores, if its position in the input is lower. The final result is therefore
+ * identical to a stable descending sort of the whole input truncated to K entries.
+ *
+ * A selector can keep several rankings of the same candidates at once, one heap each: the most
+ * positive correlations (the score is r), the most negative ones (-r) and the strongest ones (|r|).
+ * One pass over the candidates then fills all of them. Candidates are tested against two bounds
+ * covering all rankings, threshold from above and lower from below. A selector of the top ranking
+ * only is flagged topOnly and inserts straight into its one heap; callers that know they hold such a
+ * selector offer candidates with correlation_topk_push_top, which tests threshold alone, so they pay
+ * exactly what a plain top-K selector does.
+ *
+ */
+
+#ifndef CORRELATION_TOPK_H
+#define CORRELATION_TOPK_H
+
+#include <stdint.h>
+
+// Rankings a selector keeps, or-ed together; results come in this order
+typedef enum {
+	CORRELATION_RANK_TOP = 1,	/* Most positive correlations first */
+	CORRELATION_RANK_BOTTOM = 2,	/* Most negative correlations first */
+	CORRELATION_RANK_ABS = 4	/* Largest |r| first */
+} correlation_rank_t;
+
+#define correlation_topkMaxRanks (3)
+
+typedef struct {
+	double score;			/* Ranking score: r, -r or |r| */
+	double correlation;		/* Correlation */
+	uint64_t position;		/* Position of the candidate in the input, breaks ties */
+	uint32_t indices[2];		/* Pair of timeseries indices, in the order of the input */
+} correlation_topk_entry_t;
+
+typedef struct {
+	correlation_rank_t rank;		/* Ranking */
+	int count;				/* Number of candidates kept so far */
+	double threshold;			/* Score of the worst kept candidate, -INFINITY until count reaches K */
+	correlation_topk_entry_t* heap;		/* Kept candidates, worst one at heap[0] */
+} correlation_topk_heap_t;
+
+typedef struct {
+	int numTopScores;			/* Number of candidates to keep per ranking (K) */
+	int numRanks;				/* Number of rankings */
+	correlation_topk_heap_t ranks[correlation_topkMaxRanks];	/* Rankings, in the order of correlation_rank_t */
+	double threshold;			/* Correlations >= threshold may enter a ranking */
+	double lower;				/* Correlations <= lower may enter a ranking */
+	int topOnly;				/* Top ranking only: lower is -INFINITY and threshold is that of ranks[0] */
+	correlation_topk_entry_t* sorted;	/* numTopScores entries correlation_topk_result sorts in */
+} correlation_topk_t;
+
+
+/* Allocate an empty selector for the numTopScores most positive candidates */
+void correlation_topk_init (
+	correlation_topk_t* topk,	/* Selector */
+	int numTopScores		/* Number of candidates to keep */
+);
+
+/* Allocate an empty selector for numTopScores candidates in each of several rankings */
+void correlation_topk_init_ranks (
+	correlation_topk_t* topk,	/* Selector */
+	int numTopScores,		/* Number of candidates to keep per ranking */
+	unsigned rankings		/* correlation_rank_t values or-ed together */
+);
+
+/* Number of rankings in a set of them */
+static inline int correlation_topk_num_ranks (unsigned rankings) {
+	return __builtin_popcount (rankings & (CORRELATION_RANK_TOP | CORRELATION_RANK_BOTTOM | CORRELATION_RANK_ABS));
+}
+
+/* Correlations written by correlation_topk_result: numTopScores for every ranking */
+static inline int correlation_topk_num_scores (const correlation_topk_t* topk) {
+	return topk->numTopScores*topk->numRanks;
+}
+
+/* Whether candidates are tested against lower as well as threshold */
+static inline int correlation_topk_two_sided (const correlation_topk_t* topk) {
+	return topk->numRanks > 1 || topk->ranks[0].rank != CORRELATION_RANK_TOP;
+}
+
+/* Drop all kept candidates */
+void correlation_topk_reset (
+	correlation_topk_t* topk	/* Selector */
+);
+
+/* Release memory held by the selector */
+void correlation_topk_free (
+	correlation_topk_t* topk	/* Selector */
+);
+
+/* Offer one candidate that already passed the threshold check (slow path of correlation_topk_push) */
+void correlation_topk_insert (
+	correlation_topk_t* topk,	/* Selector */
+	double score,			/* Correlation */
+	uint64_t position,		/* Position in the input */
+	uint32_t index_0,		/* First index of the pair */
+	uint32_t index_1		/* Second index of the pair */
+);
+
+/* Offer one candidate to a topOnly selector that already passed the threshold check (slow path of correlation_topk_push_top) */
+void correlation_topk_insert_top (
+	correlation_topk_t* topk,	/* Selector */
+	double score,			/* Correlation */
+	uint64_t position,		/* Position in the input */
+	uint32_t index_0,		/* First index of the pair */
+	uint32_t index_1		/* Second index of the pair */
+);
+
+/* Offer one candidate. Anything no ranking can take (and NaN) is rejected with two compares. */
+static inline void correlation_topk_push (correlation_topk_t* topk, double score, uint64_t position, uint32_t index_0, uint32_t index_1) {
+	if (score >= topk->threshold || score <= topk->lower)
+		correlation_topk_insert (topk, score, position, index_0, index_1);
+}
+
+/* Offer one candidate to a topOnly selector. Anything it cannot take (and NaN) is rejected with one compare. */
+static inline void correlation_topk_push_top (correlation_topk_t* topk, double score, uint64_t position, uint32_t index_0, uint32_t index_1) {
+	if (score >= topk->threshold)
+		correlation_topk_insert_top (topk, score, position, index_0, index_1);
+}
+
+/* Offer an array of candidates, rejecting whole vectors against the current K-th score */
+void correlation_topk_push_array (
+	correlation_topk_t* topk,	/* Selector */
+	const double* correlations,	/* Candidate correlations */
+	const uint32_t* indices,	/* Pairs of indices, 2 per candidate */
+	uint64_t numCorrelations,	/* Number of candidates */
+	uint64_t position		/* Position of correlations[0] in the input */
+);
+
+/* Offer every candidate kept by another selector of the same rankings */
+void correlation_topk_merge (
+	correlation_topk_t* topk,		/* Selector */
+	const correlation_topk_t* other		/* Selector to merge from */
+);
+
+/* Write the kept correlations of every ranking best first, ranking k from k*numTopScores on.
+ * Returns the number written over all rankings, at most numTopScores each. */
+int correlation_topk_result (
+	const correlation_topk_t* topk,	/* Selector */
+	double* correlations_top,	/* Output correlations */
+	uint32_t* indices_top		/* Output pairs of indices */
+);
+
+/* Calculate top numTopScores correlations; inputs are left unchanged */
+void topCorrelations (
+	const double* correlations,	/* All correlations */
+	const uint32_t* indices,	/* Corresponding pairs of indices */
+	uint64_t numCorrelations,	/* Number of correlations */
+	double* correlations_top,	/* Output top correlations */
+	uint32_t* indices_top,		/* Output corresponding pairs of indices */
+	int numTopScores		/* Number of top correlations */
+);
+
+#endif /* CORRELATION_TOPK_H */
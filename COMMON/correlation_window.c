@@ -0,0 +1,49 @@
+/**
+ * File: correlation_window.c
+ * Purpose: time-major ring buffer holding the last windowSize+1 cross-sections of all timeseries
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "correlation_window.h"
+
+
+void correlation_window_init (correlation_window_t* window, uint64_t numTimeseries, uint64_t windowSize) {
+
+	window->numTimeseries = numTimeseries;
+	window->windowSize = windowSize;
+	window->rows = (double*) malloc ((windowSize+1)*numTimeseries*sizeof(double));
+	window->zeros = (double*) calloc (numTimeseries, sizeof(double));
+	correlation_window_reset (window);
+}
+
+void correlation_window_reset (correlation_window_t* window) {
+	window->numSteps = 0;
+}
+
+void correlation_window_free (correlation_window_t* window) {
+	free (window->rows);
+	free (window->zeros);
+}
+
+static double* next_row (correlation_window_t* window) {
+	double* row = &window->rows[(window->numSteps % (window->windowSize+1))*window->numTimeseries];
+	window->numSteps++;
+	return row;
+}
+
+void correlation_window_push (correlation_window_t* window, const double* values) {
+	memcpy (next_row(window), values, window->numTimeseries*sizeof(double));
+}
+
+void correlation_window_push_series (correlation_window_t* window, double** data, uint64_t s) {
+
+	double* row = next_row (window);
+
+	for (uint64_t i=0; i<window->numTimeseries; i++)
+		row[i] = data[i][s];
+}
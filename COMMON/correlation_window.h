@@ -0,0 +1,77 @@
+/**
+ * File: correlation_window.h
+ * Purpose: time-major ring buffer holding the last windowSize+1 cross-sections of all timeseries
+ *
+ * Every timestep is stored as one contiguous vector of numTimeseries values. After pushing x[s],
+ * correlation_window_new returns x[s] and correlation_window_old returns x[s-n] (a vector of zeros
+ * while s<n), both as contiguous vectors. Memory is bounded by the window, not by the history.
+ *
+ * Time-major input (data[s*numTimeseries + i]) is pushed with correlation_window_push; the old
+ * one-row-per-timeseries layout (data[i][s]) is pushed with correlation_window_push_series.
+ *
+ */
+
+#ifndef CORRELATION_WINDOW_H
+#define CORRELATION_WINDOW_H
+
+#include <stdint.h>
+
+typedef struct {
+	uint64_t numTimeseries;		/* Number of Timeseries */
+	uint64_t windowSize;		/* Window for correlation */
+	uint64_t numSteps;		/* Number of cross-sections pushed so far */
+	double* rows;			/* windowSize+1 cross-sections, row s at (s % (windowSize+1)) */
+	double* zeros;			/* x[s-n] while s<n */
+} correlation_window_t;
+
+
+/* Allocate an empty window */
+void correlation_window_init (
+	correlation_window_t* window,	/* Window */
+	uint64_t numTimeseries,		/* Number of Timeseries */
+	uint64_t windowSize		/* Window for correlation */
+);
+
+/* Forget all pushed cross-sections */
+void correlation_window_reset (
+	correlation_window_t* window	/* Window */
+);
+
+/* Release memory held by the window */
+void correlation_window_free (
+	correlation_window_t* window	/* Window */
+);
+
+/* Append the cross-section x[s] of all timeseries, s = number of cross-sections pushed before */
+void correlation_window_push (
+	correlation_window_t* window,	/* Window */
+	const double* values		/* x[s] of every Timeseries, contiguous */
+);
+
+/* Append the cross-section x[s] gathered from one row per timeseries (old double** layout) */
+void correlation_window_push_series (
+	correlation_window_t* window,	/* Window */
+	double** data,			/* Array of Timeseries */
+	uint64_t s			/* Timestep to gather */
+);
+
+/* x[s] of every Timeseries, s being the last pushed timestep */
+static inline const double* correlation_window_new (const correlation_window_t* window) {
+	return &window->rows[((window->numSteps-1) % (window->windowSize+1))*window->numTimeseries];
+}
+
+/* x[s-n] of every Timeseries, zeros while s<n */
+static inline const double* correlation_window_old (const correlation_window_t* window) {
+	if (window->numSteps <= window->windowSize)
+		return window->zeros;
+	return &window->rows[((window->numSteps-1-window->windowSize) % (window->windowSize+1))*window->numTimeseries];
+}
+
+/* x[s] of every Timeseries for any of the last windowSize+1 pushed timesteps, zeros for s<0 */
+static inline const double* correlation_window_at (const correlation_window_t* window, int64_t s) {
+	if (s < 0)
+		return window->zeros;
+	return &window->rows[((uint64_t)s % (window->windowSize+1))*window->numTimeseries];
+}
+
+#endif /* CORRELATION_WINDOW_H */
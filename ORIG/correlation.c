@@ -19,10 +19,19 @@
 #include <sys/time.h>
 #include <string.h>
 
+#include "correlation_session.h"
+#include "correlation_session_f32.h"
+#include "correlation_file.h"
+#include "correlation_arena.h"
+#include "correlation_random.h"
+
 #define correlation_maxNumTimeseries (6000)
 #define correlation_numTopScores (10)
 
 
+// Built without main (and its helpers) when linked into another program, e.g. the benchmarks in BENCH
+#ifndef CORRELATION_NO_MAIN
+
 //Time measuring
 double gettime(void) {
 	struct timeval tv;
@@ -30,46 +39,92 @@ double gettime(void) {
 	return tv.tv_sec + 1e-6 * tv.tv_usec;
 }
 
-//Generating random data
-void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries) {
-
-	srand(time(NULL));
+//Generating random data, the same for the same seed
+void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries, uint64_t seed) {
 
-	for (uint64_t i=0; i<numTimeseries; i++) {
-		for (uint64_t j=0; j<sizeTimeseries; j++) {
-			data[i][j] = ((double)rand()/(double)RAND_MAX);
-		}
-	}
+	correlation_random_t model;
+	correlation_random_init (&model, seed);
+	correlation_random_series (&model, data, numTimeseries, 0, sizeTimeseries);
 }
+
+#endif /* CORRELATION_NO_MAIN */
      
-//Calculate top correlations
-void topCorrelations (double* correlations, uint32_t* indices, uint64_t numCorrelations, double* correlations_top, uint32_t* indices_top, int numTopScores) {
-	
-	for (uint64_t step=0; step<numCorrelations-1; ++step) {
-		for (uint64_t i=0; i<numCorrelations-step-1; ++i) {
-			if (correlations[i]<correlations[i+1]) {
-				double temp_corr = correlations[i];
-				uint32_t temp_in1 = indices[2*i];
-				uint32_t temp_in2 = indices[2*i+1];
-				
-				correlations[i] = correlations[i+1];
-				indices[2*i] = indices[2*(i+1)];
-				indices[2*i+1] = indices[2*(i+1)+1];
+/*
+ * SUM(x,y) of a call is sliced from an arena, so repeated calls in the same arena neither allocate
+ * nor fault it in. The _r functions take the arena from the caller and reset it at the start of the
+ * call, or allocate SUM(x,y) for the call with a NULL arena; calls in different arenas can run at
+ * the same time. The others are wrappers sharing one static arena and are not reentrant.
+ */
+static correlation_arena_t arena;
+static int arena_ready = 0;
 
-				correlations[i+1] = temp_corr;
-				indices[2*(i+1)] = temp_in1;
-				indices[2*(i+1)+1] = temp_in2;
-					
-			}	
-		}	
+static correlation_arena_t* shared_arena (void) {
+	if (!arena_ready) {
+		correlation_arena_init (&arena, 0);
+		arena_ready = 1;
 	}
+	return &arena;
+}
 
-	memcpy(correlations_top, correlations, numTopScores*sizeof(double));
-	memcpy(indices_top, indices, 2*numTopScores*sizeof(uint32_t));
+// Start a call in the caller's arena
+static correlation_arena_t* run_arena (correlation_arena_t* arena) {
+	if (arena)
+		correlation_arena_reset (arena);
+	return arena;
 }
- 
 
-void correlation (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize, double* correlations, uint32_t* indices) {
+// Give back the memory of the shared arena
+void correlation_free_buffers (void) {
+	if (arena_ready)
+		correlation_arena_free (&arena);
+	arena_ready = 0;
+}
+
+// Correlations written per timestep by a call keeping the numTopScores best of each of the rankings
+// (correlation_rank_t or-ed together): numTopScores of every ranking, ranking after ranking
+int correlation_num_scores (int numTopScores, unsigned rankings) {
+	return numTopScores*correlation_topk_num_ranks (rankings);
+}
+
+// Correlations of the step being sorted by reference_top, for the comparison of qsort
+static const double* reference_correlations;
+
+// Higher correlation first, on equal ones the earlier pair; NaN last
+static int reference_order (const void* a, const void* b) {
+
+	uint64_t p = *(const uint64_t*) a;
+	uint64_t q = *(const uint64_t*) b;
+	double x = reference_correlations[p];
+	double y = reference_correlations[q];
+
+	if (x > y || (!isnan(x) && isnan(y)))
+		return -1;
+	if (x < y || (isnan(x) && !isnan(y)))
+		return 1;
+	return p < q ? -1 : p > q;
+}
+
+// Stable sort of all correlations of a step, best first, and the first numTopScores of them
+static void reference_top (const double* correlations, const uint32_t* indices, uint64_t numCorrelations, uint64_t* order,
+				double* correlations_top, uint32_t* indices_top, int numTopScores) {
+
+	for (uint64_t i=0; i<numCorrelations; i++)
+		order[i] = i;
+
+	reference_correlations = correlations;
+	qsort (order, numCorrelations, sizeof(uint64_t), reference_order);
+
+	for (int k=0; k<numTopScores; k++) {
+		correlations_top[k] = correlations[order[k]];
+		indices_top[2*k] = indices[2*order[k]];
+		indices_top[2*k+1] = indices[2*order[k]+1];
+	}
+}
+
+// The original algorithm: every correlation of every step is stored and fully sorted. It shares no
+// code with the engines and is kept as the reference they are checked against; not thread-safe.
+void correlation_reference (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize, int numTopScores,
+				double* correlations, uint32_t* indices) {
 
 	if (numTimeseries > correlation_maxNumTimeseries) {
 		fprintf(stderr, "Number of Time series should be less or equal to %d. Terminating!\n", correlation_maxNumTimeseries);
@@ -91,13 +146,18 @@ void correlation (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries
 
 	uint64_t numCorrelations = (numTimeseries*(numTimeseries-1))/2;
 
+	if ((uint64_t)numTopScores > numCorrelations) {
+		fprintf(stderr, "Number of top scores should be less or equal to the number of pairs. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
 	double* sums = (double*) calloc (numTimeseries,sizeof(double));  
 	double* sums_sq = (double*) calloc (numTimeseries, sizeof(double));
 	double* sums_xy = (double*) calloc (numCorrelations, sizeof(double));
 	double* correlations_step = (double*) calloc (numCorrelations, sizeof(double)); 		// all correlations in current step
 	uint32_t* indices_step = (uint32_t*) calloc (2*numCorrelations, sizeof(uint32_t)); 		// corresponding indices for correlations_step
-	double* correlations_top = (double*) malloc (correlation_numTopScores*sizeof(double)); 		// top correlations in current step
-	uint32_t* indices_top = (uint32_t*) malloc (2*correlation_numTopScores*sizeof(uint32_t));	// corresponding indices for correlations_top
+	uint64_t* order_step = (uint64_t*) malloc (numCorrelations*sizeof(uint64_t));			// correlations_step best first
 
 	uint64_t index_correlation;
 	
@@ -136,11 +196,7 @@ void correlation (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries
 				
 			}
 		}
-		topCorrelations (correlations_step, indices_step, numCorrelations, correlations_top, indices_top, correlation_numTopScores);
-		
-		memcpy(&correlations[s*correlation_numTopScores], correlations_top, correlation_numTopScores*sizeof(double));
-		memcpy(&indices[2*s*correlation_numTopScores], indices_top, 2*correlation_numTopScores*sizeof(uint32_t));
-
+		reference_top (correlations_step, indices_step, numCorrelations, order_step, &correlations[s*numTopScores], &indices[2*s*numTopScores], numTopScores);
 	}
 
 	free(sums);
@@ -148,18 +204,245 @@ void correlation (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries
 	free(sums_xy);
 	free(correlations_step);
 	free(indices_step);
-	free(correlations_top);
-	free(indices_top);
+	free(order_step);
+}
+
+// Input is either time-major (data_rows[s*numTimeseries + i]) or one row per timeseries (data_series[i][s])
+static void correlate_steps (correlation_arena_t* arena, const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+				int single, int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	if (numTimesteps > sizeTimeseries) {
+		fprintf(stderr, "Number of Time steps should be less or equal to size of Time series. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	// Running sums and the window advance one cross-section at a time, as for live data
+	correlation_session_t session;
+	correlation_session_f32_t session_f32;
+
+	if (single)
+		correlation_session_f32_init (&session_f32, numTimeseries, windowSize, numTopScores, rankings, 0, correlation_resyncInterval, run_arena (arena));
+	else
+		correlation_session_init (&session, numTimeseries, windowSize, numTopScores, rankings, 0, run_arena (arena));
+
+	uint64_t numScores = correlation_num_scores (numTopScores, rankings);
+
+	for (uint64_t s=0; s<numTimesteps; s++) {
+
+		double* correlations_top = &correlations[s*numScores];
+		uint32_t* indices_top = &indices[2*s*numScores];
+
+		if (single && data_rows)
+			correlation_session_f32_push (&session_f32, &data_rows[s*numTimeseries], correlations_top, indices_top);
+		else if (single)
+			correlation_session_f32_push_series (&session_f32, data_series, s, correlations_top, indices_top);
+		else if (data_rows)
+			correlation_session_push (&session, &data_rows[s*numTimeseries], correlations_top, indices_top);
+		else
+			correlation_session_push_series (&session, data_series, s, correlations_top, indices_top);
+	}
+
+	if (single)
+		correlation_session_f32_free (&session_f32);
+	else
+		correlation_session_free (&session);
+}
+
+// Time-major input: data[s*numTimeseries + i] is x[s] of timeseries i
+void correlation_rows_r (correlation_arena_t* arena, const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+				int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlate_steps (arena, data, NULL, sizeTimeseries, numTimeseries, numTimesteps, windowSize, 0, numTopScores, rankings, correlations, indices);
+}
+
+void correlation_rows (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlation_rows_r (shared_arena(), data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numTopScores, rankings, correlations, indices);
 }
 
+// One row per timeseries: data[i][s] is x[s] of timeseries i
+void correlation_r (correlation_arena_t* arena, double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlate_steps (arena, NULL, data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, 0, numTopScores, rankings, correlations, indices);
+}
 
-int main () {
+void correlation (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlation_r (shared_arena(), data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numTopScores, rankings, correlations, indices);
+}
+
+// Same as correlation, in single precision
+void correlation_f32_r (correlation_arena_t* arena, double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlate_steps (arena, NULL, data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, 1, numTopScores, rankings, correlations, indices);
+}
+
+void correlation_f32 (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+			int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlation_f32_r (shared_arena(), data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numTopScores, rankings, correlations, indices);
+}
+
+// Time-major input, top correlations only every checkpointInterval timesteps and at the last one (historical backfill)
+uint64_t correlation_checkpoints_r (correlation_arena_t* arena, const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+					uint64_t checkpointInterval, int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	if (numTimesteps > sizeTimeseries) {
+		fprintf(stderr, "Number of Time steps should be less or equal to size of Time series. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	correlation_session_t session;
+	correlation_session_init (&session, numTimeseries, windowSize, numTopScores, rankings, 0, run_arena (arena));
+
+	uint64_t numCheckpoints = correlation_session_push_batch (&session, data, numTimesteps, checkpointInterval, correlations, indices);
+
+	correlation_session_free (&session);
+
+	return numCheckpoints;
+}
+
+uint64_t correlation_checkpoints (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, uint64_t windowSize,
+					uint64_t checkpointInterval, int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	return correlation_checkpoints_r (shared_arena(), data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, checkpointInterval, numTopScores, rankings, correlations, indices);
+}
+
+// Time-major input mapped from a timeseries file, all of its timesteps, read ahead and released chunk by chunk
+void correlation_mapped_r (correlation_arena_t* arena, const correlation_file_t* file, uint64_t windowSize, int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+
+	if (windowSize <2) {
+		fprintf(stderr, "Window size must be equal or greater than 2. Terminating!\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	uint64_t numTimeseries = file->numTimeseries;
+	uint64_t numTimesteps = file->numTimesteps;
+
+	correlation_session_t session;
+	correlation_session_init (&session, numTimeseries, windowSize, numTopScores, rankings, 0, run_arena (arena));
+
+	// Float32 files are converted a chunk at a time, float64 files are read in place
+	double* buffer = correlation_file_rows (file) ? NULL : (double*) malloc (correlation_fileChunkSteps*numTimeseries*sizeof(double));
+
+	uint64_t numScores = correlation_num_scores (numTopScores, rankings);
+
+	correlation_file_prefetch (file, 0, correlation_fileChunkSteps);
+
+	for (uint64_t first=0; first<numTimesteps; first+=correlation_fileChunkSteps) {
+
+		uint64_t numSteps = first+correlation_fileChunkSteps < numTimesteps ? correlation_fileChunkSteps : numTimesteps-first;
+		const double* rows = correlation_file_chunk (file, first, numSteps, buffer);
+
+		correlation_file_prefetch (file, first+numSteps, correlation_fileChunkSteps);
+
+		for (uint64_t s=first; s<first+numSteps; s++)
+			correlation_session_push (&session, &rows[(s-first)*numTimeseries], &correlations[s*numScores], &indices[2*s*numScores]);
+
+		// The window keeps its own copy of the cross-sections it still needs
+		correlation_file_release (file, first, numSteps);
+	}
+
+	free (buffer);
+	correlation_session_free (&session);
+}
+
+void correlation_mapped (const correlation_file_t* file, uint64_t windowSize, int numTopScores, unsigned rankings, double* correlations, uint32_t* indices) {
+	correlation_mapped_r (shared_arena(), file, windowSize, numTopScores, rankings, correlations, indices);
+}
+
+#ifndef CORRELATION_NO_MAIN
+
+// Largest difference of the k-th correlations and number of top pairs that are not in the reference top of their group,
+// numGroups lists of numTopScores (one ranking of one step) each. A pair that is missing but ties the last reference
+// correlation of its group within tolerance is counted in numTies instead: the windows of the first steps are mostly
+// zero padding, so many pairs tie there and either side may keep any of them.
+static void compare (uint64_t numGroups, int numTopScores, const double* correlations, const uint32_t* indices, const double* correlations_ref,
+			const uint32_t* indices_ref, double tolerance, double* max_error, uint64_t* numMismatches, uint64_t* numTies) {
+
+	*max_error = 0;
+	*numMismatches = 0;
+	*numTies = 0;
+
+	for (uint64_t g=0; g<numGroups; g++) {
+		for (int k=0; k<numTopScores; k++) {
+
+			uint64_t n = g*numTopScores + k;
+			double error = fabs(correlations[n] - correlations_ref[n]);
+			if (error > *max_error)
+				*max_error = error;
+
+			int found = 0;
+			for (int r=0; r<numTopScores && !found; r++) {
+				uint64_t m = g*numTopScores + r;
+				found = indices[2*n] == indices_ref[2*m] && indices[2*n+1] == indices_ref[2*m+1];
+			}
+			if (found)
+				continue;
+
+			if (fabs(correlations[n] - correlations_ref[g*numTopScores + numTopScores-1]) <= tolerance)
+				(*numTies)++;
+			else
+				(*numMismatches)++;
+		}
+	}
+}
+
+
+// Correlate all timesteps of a timeseries file and print the best pair of the last one
+static int main_file (const char* path, uint64_t windowSize) {
+
+	correlation_file_t file;
+	correlation_file_open (&file, path);
+
+	uint64_t numTimesteps = file.numTimesteps;
+	printf("Correlate %lu timeseries, %lu timesteps from %s.\n", file.numTimeseries, numTimesteps, path);
+
+	uint64_t numScores = correlation_num_scores (correlation_numTopScores, CORRELATION_RANK_TOP);
+	double* correlations = (double*) malloc (numTimesteps*numScores*sizeof(double));
+	uint32_t* indices = (uint32_t*) malloc (2*numTimesteps*numScores*sizeof(uint32_t));
+
+	double time = gettime();
+	correlation_mapped (&file, windowSize, correlation_numTopScores, CORRELATION_RANK_TOP, correlations, indices);
+	printf("Total correlation time: %.5lfs\n", gettime()-time);
+
+	if (numTimesteps > 0) {
+		uint64_t n = (numTimesteps-1)*numScores;
+		printf("Top correlation of the last step: %.6f (%u, %u)\n", correlations[n], indices[2*n], indices[2*n+1]);
+	}
+
+	free (correlations);
+	free (indices);
+	correlation_free_buffers ();
+	correlation_file_close (&file);
+
+	return 0;
+}
+
+// With a timeseries file (correlation_file.h) as argument, correlate it; otherwise random data
+int main (int argc, char** argv) {
 
 	uint64_t numTimesteps = 12; 
 	uint64_t numTimeseries = 200; 	 
 	double windowSize = 9;
 
+	if (argc > 1)
+		return main_file (argv[1], argc > 2 ? strtoull (argv[2], NULL, 10) : (uint64_t)windowSize);
+
 	uint64_t sizeTimeseries = 100;
+	uint64_t seed = 1;
 
 	double time;
 	
@@ -171,19 +454,136 @@ int main () {
 	uint32_t* indices = (uint32_t*) malloc (2*numTimesteps*correlation_numTopScores*sizeof(uint32_t));
 
 	printf("Generating random data.\n");
-	random_data (data, numTimeseries, sizeTimeseries);
+	random_data (data, numTimeseries, sizeTimeseries, seed);
+
+	printf("Correlate (%s kernel).\n", correlation_kernel_isa_name(correlation_kernel_get_isa()));
+	time = gettime();
+	correlation (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, correlation_numTopScores, CORRELATION_RANK_TOP, correlations, indices);	
+	printf("Total correlation time: %.5lfs\n", gettime()-time);
+
+	double* correlations_ref = (double*) malloc (numTimesteps*correlation_numTopScores*sizeof(double));
+	uint32_t* indices_ref = (uint32_t*) malloc (2*numTimesteps*correlation_numTopScores*sizeof(uint32_t));
+	double max_error;
+	uint64_t numMismatches, numTies;
+
+	printf("Correlate with the reference algorithm.\n");
+	time = gettime();
+	correlation_reference (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, correlation_numTopScores, correlations_ref, indices_ref);
+	printf("Total correlation time: %.5lfs\n", gettime()-time);
+
+	compare (numTimesteps, correlation_numTopScores, correlations, indices, correlations_ref, indices_ref, 1e-9, &max_error, &numMismatches, &numTies);
+	printf("Reference error: %.3e max, %lu of %lu top pairs differ, %lu tie the last reference pair\n", max_error, numMismatches,
+		numTimesteps*correlation_numTopScores, numTies);
+
+	printf("Correlate again, in the buffers of the first call.\n");
+	time = gettime();
+	correlation (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, correlation_numTopScores, CORRELATION_RANK_TOP, correlations, indices);	
+	printf("Total correlation time: %.5lfs\n", gettime()-time);
 
-	printf("Correlate.\n");
+	double* correlations_f32 = (double*) malloc (numTimesteps*correlation_numTopScores*sizeof(double));
+	uint32_t* indices_f32 = (uint32_t*) malloc (2*numTimesteps*correlation_numTopScores*sizeof(uint32_t));
+
+	printf("Correlate in single precision.\n");
+	time = gettime();
+	correlation_f32 (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, correlation_numTopScores, CORRELATION_RANK_TOP, correlations_f32, indices_f32);
+	printf("Total correlation time: %.5lfs\n", gettime()-time);
+
+	compare (numTimesteps, correlation_numTopScores, correlations_f32, indices_f32, correlations, indices, 1e-5, &max_error, &numMismatches, &numTies);
+	printf("Single precision error: %.3e max, %lu of %lu top pairs differ, %lu tie the last reference pair\n", max_error, numMismatches,
+		numTimesteps*correlation_numTopScores, numTies);
+
+	// Same data, time-major, with the top correlations of every checkpointInterval-th step only
+	uint64_t checkpointInterval = 4;
+	double* data_rows = (double*) malloc (numTimesteps*numTimeseries*sizeof(double));
+	for (uint64_t s=0; s<numTimesteps; s++)
+		for (uint64_t i=0; i<numTimeseries; i++)
+			data_rows[s*numTimeseries + i] = data[i][s];
+
+	printf("Correlate in batches, every %lu steps.\n", checkpointInterval);
+	time = gettime();
+	uint64_t numCheckpoints = correlation_checkpoints (data_rows, sizeTimeseries, numTimeseries, numTimesteps, windowSize, checkpointInterval,
+								correlation_numTopScores, CORRELATION_RANK_TOP,
+								correlations_f32, indices_f32);
+	printf("Total correlation time: %.5lfs\n", gettime()-time);
+
+	// Checkpoint c is step (c+1)*checkpointInterval-1, or the last step
+	for (uint64_t c=0; c<numCheckpoints; c++) {
+		uint64_t s = (c+1)*checkpointInterval-1 < numTimesteps ? (c+1)*checkpointInterval-1 : numTimesteps-1;
+		memcpy (&correlations[c*correlation_numTopScores], &correlations[s*correlation_numTopScores], correlation_numTopScores*sizeof(double));
+		memcpy (&indices[2*c*correlation_numTopScores], &indices[2*s*correlation_numTopScores], 2*correlation_numTopScores*sizeof(uint32_t));
+	}
+	compare (numCheckpoints, correlation_numTopScores, correlations_f32, indices_f32, correlations, indices, 0, &max_error, &numMismatches, &numTies);
+	printf("Batched error: %.3e max, %lu of %lu top pairs differ, %lu tie the last reference pair\n", max_error, numMismatches,
+		numCheckpoints*correlation_numTopScores, numTies);
+
+	// Most positive, most negative and strongest 50 pairs of every step, all in one pass
+	int numRankedScores = 50;
+	unsigned rankings = CORRELATION_RANK_TOP | CORRELATION_RANK_BOTTOM | CORRELATION_RANK_ABS;
+
+	uint64_t numScores = correlation_num_scores (numRankedScores, rankings);
+	double* correlations_ranked = (double*) malloc (numTimesteps*numScores*sizeof(double));
+	uint32_t* indices_ranked = (uint32_t*) malloc (2*numTimesteps*numScores*sizeof(uint32_t));
+
+	printf("Correlate with top, bottom and |r| rankings of %d pairs.\n", numRankedScores);
 	time = gettime();
-	correlation (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, correlations, indices);	
+	correlation (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numRankedScores, rankings, correlations_ranked, indices_ranked);
 	printf("Total correlation time: %.5lfs\n", gettime()-time);
+
+	uint64_t n = (numTimesteps-1)*numScores + numRankedScores;
+	printf("Most negative correlation of the last step: %.6f (%u, %u)\n", correlations_ranked[n], indices_ranked[2*n], indices_ranked[2*n+1]);
+
+	// The top ranking has to be the one of a top-only run
+	double* correlations_top = (double*) malloc (numTimesteps*numRankedScores*sizeof(double));
+	uint32_t* indices_top = (uint32_t*) malloc (2*numTimesteps*numRankedScores*sizeof(uint32_t));
+	correlation (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, numRankedScores, CORRELATION_RANK_TOP, correlations_top, indices_top);
+
+	for (uint64_t s=0; s<numTimesteps; s++) {
+		memmove (&correlations_ranked[s*numRankedScores], &correlations_ranked[s*numScores], numRankedScores*sizeof(double));
+		memmove (&indices_ranked[2*s*numRankedScores], &indices_ranked[2*s*numScores], 2*numRankedScores*sizeof(uint32_t));
+	}
+	compare (numTimesteps, numRankedScores, correlations_ranked, indices_ranked, correlations_top, indices_top, 0, &max_error, &numMismatches, &numTies);
+	printf("Ranked error: %.3e max, %lu of %lu top pairs differ, %lu tie the last reference pair\n", max_error, numMismatches,
+		numTimesteps*numRankedScores, numTies);
+
+	// Planted pairs: with the window over the whole series they are the top correlations of the last step
+	correlation_random_t model;
+	correlation_random_init (&model, seed);
+	correlation_random_plant (&model, correlation_numTopScores, 2, 0.9);
+	correlation_random_series (&model, data, numTimeseries, 0, sizeTimeseries);
+
+	double* correlations_planted = (double*) malloc (sizeTimeseries*correlation_numTopScores*sizeof(double));
+	uint32_t* indices_planted = (uint32_t*) malloc (2*sizeTimeseries*correlation_numTopScores*sizeof(uint32_t));
+
+	printf("Correlate %lu planted pairs.\n", correlation_random_num_planted (&model, numTimeseries));
+	correlation (data, sizeTimeseries, numTimeseries, sizeTimeseries, sizeTimeseries, correlation_numTopScores, CORRELATION_RANK_TOP, correlations_planted, indices_planted);
+
+	uint64_t numFound = 0;
+	for (int k=0; k<correlation_numTopScores; k++) {
+		uint64_t n = (sizeTimeseries-1)*correlation_numTopScores + k;
+		numFound += correlation_random_planted (&model, indices_planted[2*n], indices_planted[2*n+1]) > 0;
+	}
+	printf("Planted pairs in the top %d of the last step: %lu\n", correlation_numTopScores, numFound);
 	 	
 	//Deallocating memory
+	free (correlations_planted);
+	free (indices_planted);
+	free (correlations_top);
+	free (indices_top);
+	free (correlations_ranked);
+	free (indices_ranked);
+	free (data_rows);
+	free (correlations_ref);
+	free (indices_ref);
+	free (correlations_f32);
+	free (indices_f32);
 	free (correlations);
 	free (indices);	
+	correlation_free_buffers ();
 	for (uint64_t i=0; i<numTimeseries; i++)
 		free (data[i]);
 	free (data);
 
 	return 0;
 }
+
+#endif /* CORRELATION_NO_MAIN */
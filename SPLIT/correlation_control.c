@@ -21,14 +21,29 @@
 #include <sys/time.h>
 #include <string.h>
 
+#include "correlation_encoder.h"
+#include "correlation_topk.h"
+#include "correlation_arena.h"
+#include "correlation_file.h"
+#include "correlation_random.h"
+
 #define correlation_maxNumTimeseries (6000)
+
 #define correlation_numTopScores (10)
 
 // Function is from correlation_data.c
-void correlation_data_flow (uint64_t numTimesteps, uint64_t numTimeSeries, uint64_t windowSize,
+void correlation_data_flow (uint64_t numTimesteps, uint64_t numTimeSeries, uint64_t windowSize, int numTopScores, unsigned rankings,
 				double* precalculations, double*data_pairs,
 				double* correlations, uint32_t* indices);
+void correlation_data_flow_r (correlation_arena_t* arena, uint64_t numTimesteps, uint64_t numTimeSeries, uint64_t windowSize, int numTopScores, unsigned rankings,
+				double* precalculations, double*data_pairs,
+				double* correlations, uint32_t* indices);
+int correlation_data_flow_num_scores (int numTopScores, unsigned rankings);
+void correlation_data_flow_free_buffers (void);
+
 
+// Built without main (and its helpers) when linked into another program, e.g. the benchmarks in BENCH
+#ifndef CORRELATION_NO_MAIN
 
 //Time measuring
 double gettime(void) {
@@ -37,8 +52,10 @@ double gettime(void) {
    return tv.tv_sec + 1e-6 * tv.tv_usec;
 }
 
+#endif /* CORRELATION_NO_MAIN */
 
-void correlation_control_flow (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+
+static void check_arguments (uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize) {
 
 	if (numTimeseries > correlation_maxNumTimeseries) {
 		fprintf(stderr, "Number of Time series should be less or equal to %d. Terminating!\n", correlation_maxNumTimeseries);
@@ -57,118 +74,139 @@ void correlation_control_flow (double** data, uint64_t sizeTimeseries, uint64_t
 		fflush(stderr);
 		exit(-1);
 	}
+}
+
+// Input is either time-major (data_rows[s*numTimeseries + i]) or one row per timeseries (data_series[i][s])
+static void correlation_control_flow_steps (const double* data_rows, double** data_series, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+
+	check_arguments (sizeTimeseries, numTimeseries, numTimesteps, windowSize);
 	
-	int64_t old_index;
-	double old, new;
-	
-	double** sums = (double**) malloc (numTimesteps*sizeof (double*));
-	double** sums_sq = (double**) malloc (numTimesteps*sizeof (double*));
-	double** inv = (double**) malloc (numTimesteps*sizeof (double*));
-
-	for (uint64_t i=0; i < numTimesteps; i++) {
-		sums[i] = (double*) malloc (numTimeseries*sizeof(double));
-		sums_sq[i] = (double*) malloc (numTimeseries*sizeof(double));
-		inv[i] = (double*) malloc (numTimeseries*sizeof(double));
-	}
+	// Running SUM(x), SUM(x^2) and the window are the only state
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, numTimeseries, (uint64_t)windowSize);
 
 	// 2 DFE input streams: precalculations and data pairs 
-	for (uint64_t i=0; i<numTimesteps; i++) {
-
-		old_index = i - (uint64_t)windowSize;
-
-		for (uint64_t j=0; j<numTimeseries; j++) {
-			if (old_index<0)
-				old = 0;
-			else
-				old = data [j][old_index];
-
-			new = data [j][i];
-
-			if (i==0) {
-				sums [i][j] = new;
-				sums_sq [i][j] = new*new;
-			}
-			else {
-				sums [i][j] = sums [i-1][j] + new - old;
-				sums_sq [i][j] = sums_sq [i-1][j] + new*new - old*old;
-			}
-			
-			inv [i][j] = 1/sqrt((uint64_t)windowSize*sums_sq[i][j] - sums[i][j]*sums[i][j]);
-			
-			//Precalculations REORDERED in DFE ORDER
-			precalculations [2*i*numTimeseries + 2*j] = sums[i][j];
-			precalculations [2*i*numTimeseries + 2*j + 1] = inv [i][j];
-
-			//Data pairs REORDERED in DFE ORDER
-			data_pairs[2*i*numTimeseries + 2*j] = new;
-			data_pairs[2*i*numTimeseries + 2*j + 1] = old;
-		}
-	}
+	if (data_rows)
+		correlation_encoder_push_block (&encoder, data_rows, numTimesteps, precalculations, data_pairs);
+	else
+		correlation_encoder_push_series_block (&encoder, data_series, 0, numTimesteps, precalculations, data_pairs);
 
-	for (uint64_t i=0; i<numTimesteps; i++) {
-		free (sums[i]);
-		free (sums_sq[i]);
-		free (inv[i]);
-	}
-	
-	free (sums);
-	free (sums_sq);
-	free (inv);
-			
+	correlation_encoder_free (&encoder);
 }
 
-void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries) {
+// Time-major input: data[s*numTimeseries + i] is x[s] of timeseries i
+void correlation_control_flow_rows (const double* data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+	correlation_control_flow_steps (data, NULL, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
+}
 
-	srand(0);
-	
-	for (uint64_t i=0; i<numTimeseries; i++) {
-		for (uint64_t j=0; j<sizeTimeseries; j++) {
-			data[i][j] = ((double)rand()/(double)RAND_MAX);
-		}
+// One row per timeseries: data[i][s] is x[s] of timeseries i
+void correlation_control_flow (double** data, uint64_t sizeTimeseries, uint64_t numTimeseries, uint64_t numTimesteps, double windowSize, double* precalculations, double* data_pairs) {
+	correlation_control_flow_steps (NULL, data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
+}
+
+// All timesteps of a timeseries file (correlation_file.h), encoded a chunk at a time
+void correlation_control_flow_file (const correlation_file_t* file, double windowSize, double* precalculations, double* data_pairs) {
+
+	uint64_t numTimeseries = file->numTimeseries;
+	uint64_t numTimesteps = file->numTimesteps;
+
+	check_arguments (numTimesteps, numTimeseries, numTimesteps, windowSize);
+
+	correlation_encoder_t encoder;
+	correlation_encoder_init (&encoder, numTimeseries, (uint64_t)windowSize);
+
+	// Float32 files are converted a chunk at a time, float64 files are read in place
+	double* buffer = correlation_file_rows (file) ? NULL : (double*) malloc (correlation_fileChunkSteps*numTimeseries*sizeof(double));
+
+	correlation_file_prefetch (file, 0, correlation_fileChunkSteps);
+
+	for (uint64_t first=0; first<numTimesteps; first+=correlation_fileChunkSteps) {
+
+		uint64_t numSteps = first+correlation_fileChunkSteps < numTimesteps ? correlation_fileChunkSteps : numTimesteps-first;
+		const double* rows = correlation_file_chunk (file, first, numSteps, buffer);
+
+		correlation_file_prefetch (file, first+numSteps, correlation_fileChunkSteps);
+
+		correlation_encoder_push_block (&encoder, rows, numSteps, &precalculations[2*first*numTimeseries], &data_pairs[2*first*numTimeseries]);
+
+		// The encoder keeps its own copy of the cross-sections it still needs
+		correlation_file_release (file, first, numSteps);
 	}
+
+	free (buffer);
+	correlation_encoder_free (&encoder);
+}
+
+#ifndef CORRELATION_NO_MAIN
+
+// The same data for the same seed
+void random_data (double** data, uint64_t numTimeseries, uint64_t sizeTimeseries, uint64_t seed) {
+
+	correlation_random_t model;
+	correlation_random_init (&model, seed);
+	correlation_random_series (&model, data, numTimeseries, 0, sizeTimeseries);
 }
 
 
-int main () {
+// With a timeseries file (correlation_file.h) as argument, correlate it; otherwise random data
+int main (int argc, char** argv) {
 
 	uint64_t numTimesteps = 12;		
 	uint64_t numTimeseries = 200;	
 	uint64_t windowSize = 9;
 
 	uint64_t sizeTimeseries = 100;	// number of elements in the timeseries
+	uint64_t seed = 0;		// of the random data
 
 	double start_time, reorder_time, dataflow_time, total_time;
 
 	
 	/*===================== INITIALIZING =====================*/
 	
-	double** data = (double**) malloc (numTimeseries*sizeof (double*));
-	for (uint64_t i=0; i < numTimeseries; i++) 
-		data[i] = (double*) malloc (sizeTimeseries*sizeof(double));
+	correlation_file_t file;
+	double** data = NULL;
+
+	if (argc > 1) {
+		printf("Mapping %s!\n", argv[1]);
+		correlation_file_open (&file, argv[1]);
+		numTimeseries = file.numTimeseries;
+		numTimesteps = sizeTimeseries = file.numTimesteps;
+		if (argc > 2)
+			windowSize = strtoull (argv[2], NULL, 10);
+	}
+	else {
+		data = (double**) malloc (numTimeseries*sizeof (double*));
+		for (uint64_t i=0; i < numTimeseries; i++) 
+			data[i] = (double*) malloc (sizeTimeseries*sizeof(double));
 
-	printf("Generating data!\n");
-	random_data (data, numTimeseries, sizeTimeseries);		
+		printf("Generating data!\n");
+		random_data (data, numTimeseries, sizeTimeseries, seed);		
+	}
 
 	double* precalculations = (double*) malloc (2 * numTimeseries * numTimesteps * sizeof(double));
 	double* data_pairs = (double*) malloc (2 * numTimeseries * numTimesteps * sizeof(double));
 	
 	// Correlations_data_flow outputs	
-	double* correlations = (double*) malloc (correlation_numTopScores*numTimesteps*sizeof(double));
-	uint32_t* indices = (uint32_t*) malloc (2 * correlation_numTopScores*numTimesteps*sizeof(double));
+	uint64_t numScores = correlation_data_flow_num_scores (correlation_numTopScores, CORRELATION_RANK_TOP);
+	double* correlations = (double*) malloc (numScores*numTimesteps*sizeof(double));
+	uint32_t* indices = (uint32_t*) malloc (2 * numScores*numTimesteps*sizeof(double));
 	
 	
 	/*==================== SPLIT CONTROL FLOW ====================*/
 	
 	printf("SPLITING CONTROL FLOW.\n");
 	start_time = gettime();
-	correlation_control_flow (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
+	if (!data)
+		correlation_control_flow_file (&file, windowSize, precalculations, data_pairs);
+	else
+		correlation_control_flow (data, sizeTimeseries, numTimeseries, numTimesteps, windowSize, precalculations, data_pairs);
 	reorder_time = gettime() - start_time;
 		
 	/*==================== SPLIT DATA FLOW ====================*/
 
 	printf("CORRELATE!\n");
 	start_time = gettime();
-	correlation_data_flow (numTimesteps, numTimeseries, windowSize, precalculations, data_pairs, correlations, indices);	
+	correlation_data_flow (numTimesteps, numTimeseries, windowSize, correlation_numTopScores, CORRELATION_RANK_TOP, precalculations, data_pairs, correlations, indices);	
 	dataflow_time = gettime() - start_time;
 	
 	total_time = reorder_time + dataflow_time;
@@ -182,9 +220,16 @@ int main () {
 	free (precalculations);
 	free (correlations);
 	free (indices);
+	correlation_data_flow_free_buffers ();
 
-	for (uint64_t i=0; i<numTimeseries; i++)
-		free (data[i]);
-	free (data);
+	if (data) {
+		for (uint64_t i=0; i<numTimeseries; i++)
+			free (data[i]);
+		free (data);
+	}
+	else
+		correlation_file_close (&file);
 	return 0;
 }
+
+#endif /* CORRELATION_NO_MAIN */
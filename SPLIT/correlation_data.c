@@ -6,86 +6,77 @@
 #include <sys/time.h>
 #include <string.h>
 
+#include "correlation_engine.h"
+#include "correlation_arena.h"
+
 #define correlation_maxNumTimeseries (6000)
-#define correlation_numTopScores (10)
 
-//Calculate top correlations
-void topCorrelations (double* correlations, uint32_t* indices, uint64_t numCorrelations, double* correlations_top, uint32_t* indices_top, int numTopScores) {
-	
-	for (uint64_t step=0; step<numCorrelations-1; ++step) {
-		for (uint64_t i=0; i<numCorrelations-step-1; ++i) {
-			if (correlations[i]<correlations[i+1]) {
-				double temp_corr = correlations[i];
-				uint32_t temp_in1 = indices[2*i];
-				uint32_t temp_in2 = indices[2*i+1];
-				
-				correlations[i] = correlations[i+1];
-				indices[2*i] = indices[2*(i+1)];
-				indices[2*i+1] = indices[2*(i+1)+1];
+// Buffers of correlation_data_flow are sliced from here, so repeated calls neither allocate nor fault them in;
+// correlation_data_flow_r takes an arena of its own from the caller and can run in several threads at once
+static correlation_arena_t arena;
+static int arena_ready = 0;
 
-				correlations[i+1] = temp_corr;
-				indices[2*(i+1)] = temp_in1;
-				indices[2*(i+1)+1] = temp_in2;
-					
-			}	
-		}	
-	}
-
-	memcpy(correlations_top, correlations, numTopScores*sizeof(double));
-	memcpy(indices_top, indices, 2*numTopScores*sizeof(uint32_t));
+// Give back the memory of the shared arena
+void correlation_data_flow_free_buffers (void) {
+	if (arena_ready)
+		correlation_arena_free (&arena);
+	arena_ready = 0;
 }
 
-void correlation_data_flow (uint64_t numTimesteps, uint64_t numTimeseries, uint64_t windowSize, double* precalculations, double* data_pairs, double* correlations, uint32_t* indices) {
+// Correlations written per timestep when keeping the numTopScores best correlations of every step in each
+// of the rankings (correlation_rank_t or-ed together): numTopScores of every ranking, ranking after ranking
+int correlation_data_flow_num_scores (int numTopScores, unsigned rankings) {
+	return numTopScores*correlation_topk_num_ranks (rankings);
+}
 
-	uint64_t numCorrelations = (numTimeseries*(numTimeseries-1))/2;
-	uint64_t index_correlation;
-	
-	double* sums_xy = (double*) calloc (numCorrelations, sizeof(double));
-	double* correlations_step = (double*) calloc (numCorrelations, sizeof(double)); 		// all correlations in current step
-	uint32_t* indices_step = (uint32_t*) calloc (2*numCorrelations, sizeof(uint32_t)); 		// corresponding indices for correlations_step
-	double* correlations_top = (double*) malloc (correlation_numTopScores*sizeof(double)); 		// top correlations in current step
-	uint32_t* indices_top = (uint32_t*) malloc (2*correlation_numTopScores*sizeof(uint32_t));	// corresponding indices for correlations_top
-	
-	for (uint64_t s=0; s<numTimesteps; s++) {
+// Buffers are sliced from arena, reset at the start of the call; with a NULL arena, from one that lives for the call only
+void correlation_data_flow_r (correlation_arena_t* arena, uint64_t numTimesteps, uint64_t numTimeseries, uint64_t windowSize, int numTopScores, unsigned rankings,
+				double* precalculations, double* data_pairs, double* correlations, uint32_t* indices) {
 
-		index_correlation = 0;
-		
-		for (uint64_t i=0; i<numTimeseries; i++) {
+	correlation_arena_t call_arena;
+	if (!arena)
+		correlation_arena_init (&call_arena, 0);
 
-			double old_x = data_pairs[2*s*numTimeseries + 2*i + 1];
-			double new_x = data_pairs[2*s*numTimeseries + 2*i];	
+	correlation_arena_t* buffers = arena ? arena : &call_arena;
+	correlation_arena_reset (buffers);
 
-			for (uint64_t j=i+1; j<numTimeseries; j++) {
-	
-				double old_y = data_pairs[2*s*numTimeseries + 2*j + 1];
-				double new_y = data_pairs[2*s*numTimeseries + 2*j];
+	// DFE order interleaves {SUM(x), SQRT_INVERSE(x)} and {x[s], x[s-n]}; the kernel reads them as separate vectors
+	double* new_values = (double*) correlation_arena_alloc (buffers, numTimeseries*sizeof(double), 0);
+	double* old_values = (double*) correlation_arena_alloc (buffers, numTimeseries*sizeof(double), 0);
+	double* sums = (double*) correlation_arena_alloc (buffers, numTimeseries*sizeof(double), 0);
+	double* inv = (double*) correlation_arena_alloc (buffers, numTimeseries*sizeof(double), 0);
 
+	// Correlations of the current step are folded straight into per-thread selectors, never stored
+	correlation_engine_t engine;
+	correlation_engine_init (&engine, numTimeseries, windowSize, numTopScores, rankings, 0, buffers);
+	uint64_t numScores = correlation_data_flow_num_scores (numTopScores, rankings);
 	
-				sums_xy[index_correlation] += new_x*new_y - old_x*old_y;		
-
-				correlations_step[index_correlation]	= 	(windowSize*sums_xy[index_correlation]-
-										precalculations[2*s*numTimeseries + 2*i]*precalculations[2*s*numTimeseries + 2*j])*
-										precalculations[2*s*numTimeseries + 2*i+1]*precalculations[2*s*numTimeseries + 2*j+1];
+	for (uint64_t s=0; s<numTimesteps; s++) {
 		
-				indices_step[2*index_correlation] = j;
-				indices_step[2*index_correlation+1] = i;
-	
-				index_correlation++;
-				
-			}
+		for (uint64_t i=0; i<numTimeseries; i++) {
+			new_values[i] = data_pairs[2*s*numTimeseries + 2*i];
+			old_values[i] = data_pairs[2*s*numTimeseries + 2*i + 1];
+			sums[i] = precalculations[2*s*numTimeseries + 2*i];
+			inv[i] = precalculations[2*s*numTimeseries + 2*i + 1];
 		}
-		topCorrelations (correlations_step, indices_step, numCorrelations, correlations_top, indices_top, correlation_numTopScores);
-		
-		memcpy(&correlations[s*correlation_numTopScores], correlations_top, correlation_numTopScores*sizeof(double));
-		memcpy(&indices[2*s*correlation_numTopScores], indices_top, 2*correlation_numTopScores*sizeof(uint32_t));
+
+		correlation_engine_step (&engine, new_values, old_values, sums, inv,
+					&correlations[s*numScores], &indices[2*s*numScores]);
 
 	}
 	
-	free(sums_xy);
-	free(correlations_step);
-	free(indices_step);
-	free(correlations_top);
-	free(indices_top);
+	correlation_engine_free (&engine);
 
+	if (!arena)
+		correlation_arena_free (&call_arena);
 }
 
+void correlation_data_flow (uint64_t numTimesteps, uint64_t numTimeseries, uint64_t windowSize, int numTopScores, unsigned rankings,
+				double* precalculations, double* data_pairs, double* correlations, uint32_t* indices) {
+
+	if (!arena_ready) {
+		correlation_arena_init (&arena, 0);
+		arena_ready = 1;
+	}
+	correlation_data_flow_r (&arena, numTimesteps, numTimeseries, windowSize, numTopScores, rankings, precalculations, data_pairs, correlations, indices);
+}